@@ -17,9 +17,14 @@
 #include <getopt.h>
 #include <rte_eal.h>
 #include <rte_ethdev.h>
+#include <rte_cycles.h>
 
 #include "cmdlargs.h"
+#include "flow_hash.h"
+#include "fwd_engine.h"
+#include "kernels.h"
 #include "mpls.h"
+#include "port_drv.h"
 
 
 
@@ -29,6 +34,34 @@ enum {
 	LARG_MPLS_ON_DEV,
 	LARG_GABBY,
 	LARG_NUM_CORES,
+	LARG_SYM_RSS,
+	LARG_SW_RSS,
+	LARG_SW_RSS_HASH,
+	LARG_LABEL_QUEUE,
+	LARG_LABEL_STEER_SW,
+	LARG_REORDER,
+	LARG_REORDER_TIMEOUT,
+	LARG_DRAIN_TIMEOUT,
+	LARG_HANDOFF,
+	LARG_TAKEOVER,
+	LARG_PREFAULT,
+	LARG_MEM_REPORT,
+	LARG_AUTO_CORES,
+	LARG_WATCHDOG,
+	LARG_WATCHDOG_ABORT,
+	LARG_SERVICE_CORES,
+	LARG_STATS_PERIOD,
+	LARG_MIRROR,
+	LARG_MIRROR_RING_SIZE,
+	LARG_MEMIF_RSIZE,
+	LARG_MEMIF_BSIZE,
+	LARG_AF_XDP_BUSY_BUDGET,
+	LARG_ENCAP,
+	LARG_FEC,
+	LARG_MTU_CHECK,
+	LARG_SLOW_RING_SIZE,
+	LARG_TSO,
+	LARG_CPU_ISA,
 };
 
 
@@ -37,7 +70,8 @@ usage(char const *progname)
 {
 	printf("\nUsage: %s [EAL options] -- [mplsfwd options]\n\n", progname);
 	printf("  --help | -h      : Display this message and quit.\n"
-	       "  --gabby          : Print additional information at startup.\n"
+	       "  --gabby          : Print additional information and the time of each\n"
+	       "                     step at startup.\n"
 	       "  --mpls-label=<N> : MPLS label value (default=%u).\n"
 	       "  --mpls-ttl=<N>   : TTL value (default=%u, maximum=255).\n"
 	       "  --mpls-on-dev=NAME\n"
@@ -48,8 +82,107 @@ usage(char const *progname)
 	       "                   : list of cores for packet stream processing.\n"
 	       "                     When the list is not given, packet processing is launched\n"
 	       "                     on the main core only. Each core uses a separate pair\n"
-	       "                     of RX and TX queues for packets forwarding."
-	       "\n", MPLS_DEFAULT_LABEL, MPLS_DEFAULT_TTL);
+	       "                     of RX and TX queues for packets forwarding.\n"
+	       " --auto-cores=<N>  : instead of --core-list, choose N enabled cores on the\n"
+	       "                     socket of the ports, one per physical core, without\n"
+	       "                     the SMT siblings of the main and software RSS cores.\n"
+	       " --sym-rss         : program the symmetric RSS key on both ports, so both\n"
+	       "                     directions of a flow are processed by the same core.\n"
+	       "                     The MPLS side is verified with a software hash of\n"
+	       "                     the inner IP header.\n"
+	       " --sw-rss=<N,...,M|N-M|N-M,X>\n"
+	       "                   : list of cores receiving MPLS frames. A software hash\n"
+	       "                     of the inner IP addresses and ports (labels skipped)\n"
+	       "                     is computed and frames are redistributed to the\n"
+	       "                     processing cores. Use it when the NIC cannot hash\n"
+	       "                     past the label.\n"
+	       " --sw-rss-hash=toeplitz|crc|round-robin\n"
+	       "                   : software hash function (default=toeplitz). Toeplitz\n"
+	       "                     matches the NIC hash set by --sym-rss, crc is faster.\n"
+	       "                     round-robin deals frames to the cores in turn: the\n"
+	       "                     load is balanced, but the order of a flow is lost\n"
+	       "                     unless --reorder is given.\n"
+	       " --reorder[=<N>]   : the software RSS cores restore the order of the MPLS\n"
+	       "                     frames processed by the workers before sending them.\n"
+	       "                     N is the reorder window (power of 2, default=%u).\n"
+	       " --reorder-timeout=<us>\n"
+	       "                   : frames waiting for a missing one are sent after this\n"
+	       "                     time without progress (default=%u).\n"
+	       " --drain-timeout=<ms>\n"
+	       "                   : on SIGINT/SIGTERM, forward the frames already received\n"
+	       "                     and wait for their transmission for at most this time\n"
+	       "                     (default=%u, 0 = quit at once). A second signal quits.\n"
+	       " --handoff=<path>  : listen on the unix socket for a new instance taking over\n"
+	       "                     the ports (hitless restart).\n"
+	       " --takeover=<path> : take over the ports of the instance listening on the\n"
+	       "                     socket: it drains, releases the devices and passes its\n"
+	       "                     configuration, label steering and counters.\n"
+	       " --label-queue=<L>[-<L>]:<Q>\n"
+	       "                   : MPLS frames with the top label L (or in the range) are\n"
+	       "                     processed by the core that owns queue Q (the Q-th core\n"
+	       "                     of --core-list). May be given multiple times. Rules are\n"
+	       "                     installed with rte_flow, software steering is used\n"
+	       "                     when the NIC rejects them.\n"
+	       " --label-steer-sw  : don't use rte_flow, always steer labels in software.\n"
+	       " --prefault        : touch every page of the mbuf pools and rings before\n"
+	       "                     the ports are started.\n"
+	       " --mem-report      : print the hugepage memory used per socket and per\n"
+	       "                     component once the cores are running.\n"
+	       " --watchdog=<ms>   : report a forwarding core which makes no progress for\n"
+	       "                     this time, with the state of its queues and ports.\n"
+	       " --watchdog-abort  : abort the process when the watchdog fires.\n"
+	       " --service-cores=<N,...,M|N-M>\n"
+	       "                   : cores running the control services (watchdog,\n"
+	       "                     statistics). Without them the services run on the\n"
+	       "                     main core, or on a control thread when the main core\n"
+	       "                     forwards.\n"
+	       " --stats-period=<s>: print the forwarding rates every s seconds. A secondary\n"
+	       "                     process prints the counters of the primary with this\n"
+	       "                     period.\n"
+	       " --mirror=<push|pop|both>[:<L>[-<L>]]\n"
+	       "                   : pass a reference of the frames sent in the direction\n"
+	       "                     (with the top label L or in the range) to the rings\n"
+	       "                     of an analytics process. Frames are dropped from the\n"
+	       "                     mirror when its ring is full.\n"
+	       " --mirror-ring-size=<N>\n"
+	       "                   : size of each mirror ring (default=%u, power of 2).\n"
+	       " --memif-rsize=<N> : rings of 2^N descriptors for the memif ports which\n"
+	       "                     don't set rsize (1-%u, driver default=%u).\n"
+	       " --memif-bsize=<B> : buffers of B bytes for the memif ports which don't\n"
+	       "                     set bsize (%u-%u). Ignored in zero-copy mode.\n"
+	       " --af-xdp-busy-budget=<N>\n"
+	       "                   : busy polling budget of the AF_XDP ports which don't\n"
+	       "                     set busy_budget (0-%u, 0 = interrupts).\n"
+	       " --encap=<udp|gre>:<local>,<remote>[,<ttl>]\n"
+	       "                   : carry the MPLS frames of the output port in IPv4 or\n"
+	       "                     IPv6 between the local and remote addresses, over UDP\n"
+	       "                     (port 6635) or GRE (default ttl=%u). Frames received\n"
+	       "                     this way are decapsulated.\n"
+	       " --fec=<prefix>/<len>:<L>[,<L>...]\n"
+	       "                   : push the segment list (top label first, at most %u)\n"
+	       "                     on the IP packets to the prefix instead of the MPLS\n"
+	       "                     label. May be given multiple times (at most %u), the\n"
+	       "                     longest prefix matches.\n"
+	       " --mtu-check       : IPv4 packets which don't fit in the MTU of the output\n"
+	       "                     port once labelled are fragmented, IPv6 and DF ones\n"
+	       "                     are passed to the slow path rings (or dropped).\n"
+	       " --slow-ring-size=<N>\n"
+	       "                   : size of each slow path ring (power of 2, max %u), read\n"
+	       "                     by the process answering with ICMP Packet Too Big.\n"
+	       " --tso             : forward the large TCP segments of VMs (vhost ports\n"
+	       "                     offer TSO) labelled, segmented by the output port or\n"
+	       "                     in software (TCP over IPv4) when it can't.\n"
+	       " --cpu-isa=auto|scalar|sse4.2|avx2|avx512|neon\n"
+	       "                   : instruction set of the data-path kernels (default=auto,\n"
+	       "                     the best one of the CPU within the EAL limit of the\n"
+	       "                     SIMD width). The kernels without a variant for it use\n"
+	       "                     the closest lower one."
+	       "\n", MPLS_DEFAULT_LABEL, MPLS_DEFAULT_TTL,
+	       REORDER_DEFAULT_SIZE, REORDER_DEFAULT_TIMEOUT_US, DRAIN_DEFAULT_TIMEOUT_MS,
+	       MIRROR_DEFAULT_RING_SIZE, PORT_MEMIF_MAX_LOG2_RING_SIZE,
+	       PORT_MEMIF_DEFAULT_LOG2_RING, PORT_MEMIF_MIN_BUF_SIZE, PORT_MEMIF_MAX_BUF_SIZE,
+	       PORT_AF_XDP_MAX_BUSY_BUDGET, ENCAP_DEFAULT_TTL, FEC_MAX_LABELS, FEC_MAX_RULES,
+	       SLOW_MAX_RING_SIZE);
 }
 
 
@@ -175,6 +308,96 @@ parse_core_list(char const *list, unsigned int *cores, unsigned int cores_len)
 }
 
 
+/*
+ * Parse a label steering rule in the format '<label>:<queue>' or
+ * '<first>-<last>:<queue>' and add it to the sorted array of rules.
+ *
+ * Return 0 on success, -EINVAL on syntax error, -EEXIST when the range overlaps
+ * an already defined one, -ENOSPC when there are too many rules.
+ */
+static int
+parse_label_queue(char const *arg, struct label_steer_rule *rules, unsigned int *n_rules)
+{
+	struct label_steer_rule rule;
+	char *end;
+	long val;
+
+	errno = 0;
+	val = strtol(arg, &end, 10);
+	if (errno || end == arg || val < 0 || (val & ~MPLS_HDR_LABEL_MASK))
+		return -EINVAL;
+	rule.first = rule.last = (uint32_t)val;
+
+	if (*end == '-') {
+		arg = end + 1;
+		val = strtol(arg, &end, 10);
+		if (errno || end == arg || val < rule.first || (val & ~MPLS_HDR_LABEL_MASK))
+			return -EINVAL;
+		rule.last = (uint32_t)val;
+	}
+
+	if (*end != ':')
+		return -EINVAL;
+	arg = end + 1;
+	val = strtol(arg, &end, 10);
+	if (errno || end == arg || *end != '\0' || val < 0 || val >= QUEUEID_MAX)
+		return -EINVAL;
+	rule.queue = (uint16_t)val;
+
+	return label_steer_rule_add(rules, n_rules, &rule);
+}
+
+
+/*
+ * Parse the analytics mirror in the format '<push|pop|both>' optionally followed
+ * by ':<label>' or ':<first>-<last>'.
+ *
+ * Return 0 on success, -EINVAL on syntax error.
+ */
+static int
+parse_mirror(char const *arg, struct cmdline_config *conf)
+{
+	char const *sep;
+	size_t len;
+	char *end;
+	long val;
+
+	sep = strchr(arg, ':');
+	len = sep != NULL ? (size_t)(sep - arg) : strlen(arg);
+	if (len == 4 && !strncmp(arg, "push", len))
+		conf->mirror_dirs = FWD_MIRROR_PUSH;
+	else if (len == 3 && !strncmp(arg, "pop", len))
+		conf->mirror_dirs = FWD_MIRROR_POP;
+	else if (len == 4 && !strncmp(arg, "both", len))
+		conf->mirror_dirs = FWD_MIRROR_PUSH | FWD_MIRROR_POP;
+	else
+		return -EINVAL;
+
+	conf->mirror_first = 0;
+	conf->mirror_last = MPLS_HDR_LABEL_MASK;
+	if (sep == NULL)
+		return 0;
+
+	arg = sep + 1;
+	errno = 0;
+	val = strtol(arg, &end, 10);
+	if (errno || end == arg || val < 0 || (val & ~MPLS_HDR_LABEL_MASK))
+		return -EINVAL;
+	conf->mirror_first = conf->mirror_last = (uint32_t)val;
+
+	if (*end == '-') {
+		arg = end + 1;
+		val = strtol(arg, &end, 10);
+		if (errno || end == arg || val < conf->mirror_first ||
+		    (val & ~MPLS_HDR_LABEL_MASK))
+			return -EINVAL;
+		conf->mirror_last = (uint32_t)val;
+	}
+
+	return *end == '\0' ? 0 : -EINVAL;
+}
+
+
 /*
  * The main function to parse the user's command line arguments and store all
  * information in the configuration structure.
@@ -194,6 +417,34 @@ do_args_parse(int argc, char **argv, struct cmdline_config *conf)
 		{ "mpls-ttl",      1, NULL, LARG_MPLS_TTL },
 		{ "mpls-on-dev",   1, NULL, LARG_MPLS_ON_DEV },
 		{ "core-list",     1, NULL, LARG_NUM_CORES },
+		{ "sym-rss",       0, NULL, LARG_SYM_RSS },
+		{ "sw-rss",        1, NULL, LARG_SW_RSS },
+		{ "sw-rss-hash",   1, NULL, LARG_SW_RSS_HASH },
+		{ "label-queue",   1, NULL, LARG_LABEL_QUEUE },
+		{ "label-steer-sw", 0, NULL, LARG_LABEL_STEER_SW },
+		{ "reorder",       2, NULL, LARG_REORDER },
+		{ "reorder-timeout", 1, NULL, LARG_REORDER_TIMEOUT },
+		{ "drain-timeout", 1, NULL, LARG_DRAIN_TIMEOUT },
+		{ "handoff",       1, NULL, LARG_HANDOFF },
+		{ "takeover",      1, NULL, LARG_TAKEOVER },
+		{ "prefault",      0, NULL, LARG_PREFAULT },
+		{ "mem-report",    0, NULL, LARG_MEM_REPORT },
+		{ "auto-cores",    1, NULL, LARG_AUTO_CORES },
+		{ "watchdog",      1, NULL, LARG_WATCHDOG },
+		{ "watchdog-abort", 0, NULL, LARG_WATCHDOG_ABORT },
+		{ "service-cores", 1, NULL, LARG_SERVICE_CORES },
+		{ "stats-period",  1, NULL, LARG_STATS_PERIOD },
+		{ "mirror",        1, NULL, LARG_MIRROR },
+		{ "mirror-ring-size", 1, NULL, LARG_MIRROR_RING_SIZE },
+		{ "memif-rsize",   1, NULL, LARG_MEMIF_RSIZE },
+		{ "memif-bsize",   1, NULL, LARG_MEMIF_BSIZE },
+		{ "af-xdp-busy-budget", 1, NULL, LARG_AF_XDP_BUSY_BUDGET },
+		{ "encap",         1, NULL, LARG_ENCAP },
+		{ "fec",           1, NULL, LARG_FEC },
+		{ "mtu-check",     0, NULL, LARG_MTU_CHECK },
+		{ "slow-ring-size", 1, NULL, LARG_SLOW_RING_SIZE },
+		{ "tso",           0, NULL, LARG_TSO },
+		{ "cpu-isa",       1, NULL, LARG_CPU_ISA },
 		{ NULL, 0, NULL, 0 },
 	};
 
@@ -216,6 +467,7 @@ do_args_parse(int argc, char **argv, struct cmdline_config *conf)
 				exit_app(EXIT_FAILURE);
 			}
 			conf->mpls_label = (uint32_t)val;
+			conf->given |= CONF_GIVEN_MPLS_LABEL;
 			break;
 
 		case LARG_MPLS_TTL:
@@ -232,6 +484,7 @@ do_args_parse(int argc, char **argv, struct cmdline_config *conf)
 				exit_app(EXIT_FAILURE);
 			}
 			conf->mpls_ttl = (uint32_t)val;
+			conf->given |= CONF_GIVEN_MPLS_TTL;
 			break;
 
 		case LARG_MPLS_ON_DEV:
@@ -240,13 +493,8 @@ do_args_parse(int argc, char **argv, struct cmdline_config *conf)
 					optarg);
 				exit_app(EXIT_FAILURE);
 			}
-
-			r = rte_eth_dev_get_port_by_name(optarg, &conf->mpls_in_port);
-			if (r < 0) {
-				fprintf(stderr, "Error: couldn't find port-id by given name '%s': %s\n",
-					optarg, rte_strerror(-r));
-				exit_app(EXIT_FAILURE);
-			}
+			/* With --takeover the device is probed later */
+			snprintf(conf->mpls_in_dev, sizeof(conf->mpls_in_dev), "%s", optarg);
 			break;
 
 		case LARG_NUM_CORES:
@@ -259,10 +507,280 @@ do_args_parse(int argc, char **argv, struct cmdline_config *conf)
 			}
 			break;
 
+		case LARG_AUTO_CORES:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val <= 0 || val > CORES_MAX_NUM) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->auto_cores = (unsigned int)val;
+			break;
+
+		case LARG_LABEL_QUEUE:
+			r = parse_label_queue(optarg, conf->steer_rules, &conf->num_steer_rules);
+			if (r < 0) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'%s\n",
+					optarg, lopts_vec[opt_idx].name,
+					r == -EEXIST ? " (overlapping label range)" : "");
+				exit_app(EXIT_FAILURE);
+			}
+			break;
+
+		case LARG_LABEL_STEER_SW:
+			conf->steer_sw_only = 1;
+			break;
+
 		case LARG_GABBY:
 			conf->print = 1;
 			break;
 
+		case LARG_PREFAULT:
+			conf->prefault = 1;
+			break;
+
+		case LARG_MEM_REPORT:
+			conf->mem_report = 1;
+			break;
+
+		case LARG_SYM_RSS:
+			conf->sym_rss = 1;
+			break;
+
+		case LARG_SW_RSS:
+			conf->num_dist_cores = parse_core_list(optarg, conf->dist_cores,
+				RTE_DIM(conf->dist_cores));
+			if (conf->num_dist_cores == 0) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			break;
+
+		case LARG_SW_RSS_HASH:
+			if (!strcmp(optarg, "toeplitz"))
+				conf->dist_hash = FLOW_HASH_TOEPLITZ;
+			else if (!strcmp(optarg, "crc"))
+				conf->dist_hash = FLOW_HASH_CRC;
+			else if (!strcmp(optarg, "round-robin"))
+				conf->dist_hash = FLOW_HASH_ROUND_ROBIN;
+			else {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			break;
+
+		case LARG_REORDER:
+			conf->reorder_size = REORDER_DEFAULT_SIZE;
+			if (optarg == NULL)
+				break;
+
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val < MAX_PKT_BURST || val > REORDER_MAX_SIZE ||
+			    !rte_is_power_of_2((uint32_t)val)) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s' "
+					"(power of 2, %u-%u)\n", optarg, lopts_vec[opt_idx].name,
+					MAX_PKT_BURST, REORDER_MAX_SIZE);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->reorder_size = (unsigned int)val;
+			break;
+
+		case LARG_REORDER_TIMEOUT:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val <= 0 || val > US_PER_S) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->reorder_timeout_us = (unsigned int)val;
+			break;
+
+		case LARG_DRAIN_TIMEOUT:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val < 0 || val > 60 * MS_PER_S) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->drain_timeout_ms = (unsigned int)val;
+			break;
+
+		case LARG_WATCHDOG:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val <= 0 || val > 3600 * MS_PER_S) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->watchdog_ms = (unsigned int)val;
+			break;
+
+		case LARG_WATCHDOG_ABORT:
+			conf->watchdog_abort = 1;
+			break;
+
+		case LARG_SERVICE_CORES:
+			conf->num_service_cores = parse_core_list(optarg, conf->service_cores,
+				RTE_DIM(conf->service_cores));
+			if (conf->num_service_cores == 0) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			break;
+
+		case LARG_STATS_PERIOD:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val <= 0 || val > 3600) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->stats_period_s = (unsigned int)val;
+			break;
+
+		case LARG_MIRROR:
+			if (parse_mirror(optarg, conf) != 0) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			break;
+
+		case LARG_MIRROR_RING_SIZE:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val < MAX_PKT_BURST || val > MIRROR_MAX_RING_SIZE ||
+			    !rte_is_power_of_2((uint32_t)val)) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s' "
+					"(power of 2, %u-%u)\n", optarg, lopts_vec[opt_idx].name,
+					MAX_PKT_BURST, MIRROR_MAX_RING_SIZE);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->mirror_ring_size = (unsigned int)val;
+			break;
+
+		case LARG_MEMIF_RSIZE:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val < 1 || val > PORT_MEMIF_MAX_LOG2_RING_SIZE) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s' "
+					"(1-%u)\n", optarg, lopts_vec[opt_idx].name,
+					PORT_MEMIF_MAX_LOG2_RING_SIZE);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->memif_rsize = (unsigned int)val;
+			break;
+
+		case LARG_MEMIF_BSIZE:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val < PORT_MEMIF_MIN_BUF_SIZE || val > PORT_MEMIF_MAX_BUF_SIZE) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s' "
+					"(%u-%u)\n", optarg, lopts_vec[opt_idx].name,
+					PORT_MEMIF_MIN_BUF_SIZE, PORT_MEMIF_MAX_BUF_SIZE);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->memif_bsize = (unsigned int)val;
+			break;
+
+		case LARG_AF_XDP_BUSY_BUDGET:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val < 0 || val > PORT_AF_XDP_MAX_BUSY_BUDGET) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s' "
+					"(0-%u)\n", optarg, lopts_vec[opt_idx].name,
+					PORT_AF_XDP_MAX_BUSY_BUDGET);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->af_xdp_busy_budget = (int)val;
+			break;
+
+		case LARG_MTU_CHECK:
+			conf->mtu_check = 1;
+			break;
+
+		case LARG_TSO:
+			conf->tso = 1;
+			break;
+
+		case LARG_CPU_ISA:
+			r = kernels_isa_parse(optarg);
+			if (r < 0) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->cpu_isa = (unsigned int)r;
+			break;
+
+		case LARG_SLOW_RING_SIZE:
+			errno = 0;
+			val = strtol(optarg, &endptr, 10);
+			if (errno != 0 || endptr == optarg || *endptr != '\0' ||
+			    val < MAX_PKT_BURST || val > SLOW_MAX_RING_SIZE ||
+			    !rte_is_power_of_2((uint32_t)val)) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s' "
+					"(power of 2, %u-%u)\n", optarg, lopts_vec[opt_idx].name,
+					MAX_PKT_BURST, SLOW_MAX_RING_SIZE);
+				exit_app(EXIT_FAILURE);
+			}
+			conf->slow_ring_size = (unsigned int)val;
+			break;
+
+		case LARG_FEC:
+			if (conf->num_fec_rules == FEC_MAX_RULES) {
+				fprintf(stderr, "Error: too many '%s' options (max %u)\n",
+					lopts_vec[opt_idx].name, FEC_MAX_RULES);
+				exit_app(EXIT_FAILURE);
+			}
+			r = fec_rule_parse(optarg, &conf->fec_rules[conf->num_fec_rules]);
+			if (r < 0) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'%s\n",
+					optarg, lopts_vec[opt_idx].name,
+					r == -ENOSPC ? " (too many labels)" : "");
+				exit_app(EXIT_FAILURE);
+			}
+			conf->num_fec_rules++;
+			break;
+
+		case LARG_ENCAP:
+			if (encap_parse(optarg, &conf->encap) != 0) {
+				fprintf(stderr, "Error: invalid arg '%s' for option '%s'\n",
+					optarg, lopts_vec[opt_idx].name);
+				exit_app(EXIT_FAILURE);
+			}
+			break;
+
+		case LARG_HANDOFF:
+		case LARG_TAKEOVER:
+			if (strlen(optarg) == 0 || strlen(optarg) + 1 > HANDOFF_PATH_MAX_LEN) {
+				fprintf(stderr, "Error: invalid length of the socket path: '%s'\n",
+					optarg);
+				exit_app(EXIT_FAILURE);
+			}
+			snprintf(opt == LARG_HANDOFF ? conf->handoff_path : conf->takeover_path,
+				HANDOFF_PATH_MAX_LEN, "%s", optarg);
+			break;
+
 		case 'h':
 			usage(argv[0]);
 			exit_app(EXIT_SUCCESS);
@@ -284,6 +802,38 @@ do_args_parse(int argc, char **argv, struct cmdline_config *conf)
 		}
 	}
 
+	if (conf->watchdog_abort != 0 && conf->watchdog_ms == 0) {
+		fprintf(stderr, "Error: --watchdog-abort requires --watchdog\n");
+		exit_app(EXIT_FAILURE);
+	}
+
+	if (conf->mirror_ring_size != 0 && conf->mirror_dirs == 0) {
+		fprintf(stderr, "Error: --mirror-ring-size requires --mirror\n");
+		exit_app(EXIT_FAILURE);
+	}
+	if (conf->mirror_dirs != 0 && conf->mirror_ring_size == 0)
+		conf->mirror_ring_size = MIRROR_DEFAULT_RING_SIZE;
+
+	if (conf->slow_ring_size != 0 && conf->mtu_check == 0) {
+		fprintf(stderr, "Error: --slow-ring-size requires --mtu-check\n");
+		exit_app(EXIT_FAILURE);
+	}
+
+	if (conf->tso != 0 && conf->encap.type != ENCAP_NONE) {
+		fprintf(stderr, "Error: --tso and --encap are exclusive\n");
+		exit_app(EXIT_FAILURE);
+	}
+
+	if (conf->num_fec_rules != 0 && conf->encap.type != ENCAP_NONE) {
+		fprintf(stderr, "Error: --fec and --encap are exclusive\n");
+		exit_app(EXIT_FAILURE);
+	}
+
+	if (conf->auto_cores != 0 && conf->num_cores != 0) {
+		fprintf(stderr, "Error: --auto-cores and --core-list are exclusive\n");
+		exit_app(EXIT_FAILURE);
+	}
+
 	opterr = opterr_save;
 	optind = 0;
 }
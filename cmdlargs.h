@@ -12,11 +12,32 @@
 
 #include <rte_dev.h>
 
+#include "label_steer.h"
+#include "encap.h"
+#include "fec.h"
+
 
 #define MPLS_DEFAULT_LABEL 16
 #define MPLS_DEFAULT_TTL   64
 #define DEV_NAME_MAX_LEN   RTE_DEV_NAME_MAX_LEN
 
+#define REORDER_DEFAULT_SIZE        1024
+#define REORDER_MAX_SIZE            65536
+
+#define DRAIN_DEFAULT_TIMEOUT_MS    500
+
+#define HANDOFF_PATH_MAX_LEN        108   /* sun_path */
+
+#define MIRROR_DEFAULT_RING_SIZE    1024
+#define MIRROR_MAX_RING_SIZE        65536
+
+#define SLOW_MAX_RING_SIZE          65536
+
+/* Options given on the command line (cmdline_config.given) */
+#define CONF_GIVEN_MPLS_LABEL  (1u << 0)
+#define CONF_GIVEN_MPLS_TTL    (1u << 1)
+#define REORDER_DEFAULT_TIMEOUT_US  100
+
 #ifdef RTE_MAX_LCORE
 #define CORES_MAX_NUM  RTE_MAX_LCORE
 #else
@@ -28,12 +49,82 @@ struct cmdline_config {
 	uint32_t mpls_label;
 	uint32_t mpls_ttl;
 
-	/* The port-ID of a device for which the MPLS header is added for each incoming packet */
+	/* The port-ID of a device for which the MPLS header is added for each incoming packet,
+	 * resolved from the name once the devices are probed */
 	uint16_t mpls_in_port;
+	char mpls_in_dev[DEV_NAME_MAX_LEN];
 	uint16_t print;
 
+	/* Use the symmetric RSS key on both ports (both flow directions on one core) */
+	uint16_t sym_rss;
+
 	unsigned int cores[CORES_MAX_NUM];
 	unsigned int num_cores;
+	unsigned int auto_cores;	/* choose this number of cores (instead of cores[]) */
+
+	/* Cores receiving MPLS frames and distributing them to the workers (software RSS) */
+	unsigned int dist_cores[CORES_MAX_NUM];
+	unsigned int num_dist_cores;
+	unsigned int dist_hash;		/* enum flow_hash_type */
+
+	/* Restore the order of the frames processed by the workers, 0 = disabled */
+	unsigned int reorder_size;
+	unsigned int reorder_timeout_us;
+
+	/* Forward in-flight frames on SIGINT/SIGTERM for at most this time, 0 = quit at once */
+	unsigned int drain_timeout_ms;
+
+	/* Hitless restart: listen for a successor / take over from a running instance */
+	char handoff_path[HANDOFF_PATH_MAX_LEN];
+	char takeover_path[HANDOFF_PATH_MAX_LEN];
+
+	unsigned int given;		/* CONF_GIVEN_* */
+
+	unsigned int prefault;		/* touch the hugepages before starting the ports */
+	unsigned int mem_report;	/* print the hugepage usage at startup */
+
+	/* Report cores without progress for this time (0 = disabled), abort if set */
+	unsigned int watchdog_ms;
+	unsigned int watchdog_abort;
+
+	/* Cores running the control services (watchdog, statistics) */
+	unsigned int service_cores[CORES_MAX_NUM];
+	unsigned int num_service_cores;
+	unsigned int stats_period_s;	/* print the rates every period, 0 = don't */
+
+	/* Analytics mirror: directions (FWD_MIRROR_*, 0 = disabled), top label range */
+	unsigned int mirror_dirs;
+	uint32_t mirror_first;
+	uint32_t mirror_last;
+	unsigned int mirror_ring_size;
+
+	/* memif ring size (log2) and buffer size, 0 = set by the devargs/driver */
+	unsigned int memif_rsize;
+	unsigned int memif_bsize;
+	int af_xdp_busy_budget;		/* -1 = driver default */
+
+	/* MPLS over UDP/GRE on the output port (ENCAP_NONE = over Ethernet) */
+	struct encap_conf encap;
+
+	/* SR-MPLS segment lists per destination prefix */
+	struct fec_rule fec_rules[FEC_MAX_RULES];
+	unsigned int num_fec_rules;
+
+	/* Fragment (IPv4) or pass to the slow path the packets over the MTU once
+	 * labelled, slow path ring size (0 = no slow path, they are dropped) */
+	unsigned int mtu_check;
+	unsigned int slow_ring_size;
+
+	/* Keep the TSO of large TCP segments through the push */
+	unsigned int tso;
+
+	/* Instruction set of the data-path kernels (enum kernels_isa, 0 = auto) */
+	unsigned int cpu_isa;
+
+	/* MPLS label (range) to RX queue steering, sorted by label */
+	struct label_steer_rule steer_rules[LABEL_STEER_MAX_RULES];
+	unsigned int num_steer_rules;
+	unsigned int steer_sw_only;	/* don't try rte_flow, steer in software */
 };
 
 typedef struct cmdline_config cmdline_conf_t;
@@ -0,0 +1,261 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <pthread.h>
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_launch.h>
+#include <rte_pause.h>
+#include <rte_cycles.h>
+#include <rte_service.h>
+#include <rte_service_component.h>
+
+#include "ctl_service.h"
+
+
+/*
+ * Control duties (watchdog, statistics, ...) are rte_service components, so the
+ * forwarding cores never run them. They are mapped to the service cores given by
+ * the user; without service cores they run on the main core while it waits for
+ * the forwarding cores, or on a control thread when the main core forwards too.
+ * Each service paces itself and must not block.
+ */
+
+#define CTL_SERVICE_THREAD_US  1000
+
+static struct {
+	unsigned int n_lcores;
+	unsigned int lcores[RTE_MAX_LCORE];
+
+	unsigned int n_services;
+	uint32_t ids[CTL_SERVICE_MAX_NUM];
+
+	unsigned int on_thread;
+	pthread_t thread;
+	volatile unsigned int stop;
+} g_svc;
+
+
+/* ************************************************************************** */
+
+/*
+ * Use the lcores as service cores. An lcore must be enabled in EAL (-l) or
+ * already be a service core (-s/-S), and must not be the main one.
+ */
+int
+ctl_service_lcores_set(unsigned int const *lcores, unsigned int n_lcores)
+{
+	unsigned int n, lcore;
+	int r;
+
+	for (n = 0; n < n_lcores; n++) {
+		lcore = lcores[n];
+		if (lcore >= RTE_MAX_LCORE || lcore == rte_get_main_lcore()) {
+			fprintf(stderr, "Error: core %u cannot be a service core\n", lcore);
+			return -1;
+		}
+
+		if (rte_eal_lcore_role(lcore) != ROLE_SERVICE) {
+			r = rte_service_lcore_add(lcore);
+			if (r != 0 && r != -EALREADY) {
+				fprintf(stderr, "Error: cannot make core %u a service core: %s\n",
+					lcore, rte_strerror(-r));
+				return -1;
+			}
+		}
+		g_svc.lcores[g_svc.n_lcores++] = lcore;
+	}
+
+	return 0;
+}
+
+
+unsigned int
+ctl_service_lcores_num(void)
+{
+	return g_svc.n_lcores;
+}
+
+
+/*
+ * Register a control service. It's serialized (not multi-thread safe), so
+ * the callback needs no locking against itself.
+ */
+int
+ctl_service_register(char const *name, rte_service_func fn, void *arg)
+{
+	struct rte_service_spec spec;
+	uint32_t id;
+	int r;
+
+	if (g_svc.n_services >= CTL_SERVICE_MAX_NUM) {
+		fprintf(stderr, "Error: too many services\n");
+		return -1;
+	}
+
+	memset(&spec, 0, sizeof(spec));
+	snprintf(spec.name, sizeof(spec.name), "%s", name);
+	spec.callback = fn;
+	spec.callback_userdata = arg;
+	spec.socket_id = (int)rte_socket_id();
+
+	r = rte_service_component_register(&spec, &id);
+	if (r != 0) {
+		fprintf(stderr, "Error: cannot register service '%s': %s\n", name,
+			rte_strerror(-r));
+		return -1;
+	}
+	rte_service_component_runstate_set(id, 1);
+	rte_service_set_stats_enable(id, 1);
+	g_svc.ids[g_svc.n_services++] = id;
+
+	return 0;
+}
+
+
+/*
+ * Services need an lcore id to run on the calling thread: the control thread
+ * registers itself as a non-EAL lcore.
+ */
+static void *
+ctl_service_thread(void *arg __rte_unused)
+{
+	if (rte_thread_register() != 0) {
+		fprintf(stderr, "Error: cannot register the service thread: %s\n",
+			rte_strerror(rte_errno));
+		return NULL;
+	}
+
+	while (g_svc.stop == 0) {
+		ctl_service_run();
+		rte_delay_us_sleep(CTL_SERVICE_THREAD_US);
+	}
+
+	rte_thread_unregister();
+	return NULL;
+}
+
+
+/*
+ * Start the registered services: on the service cores, otherwise they are run
+ * by ctl_service_run(), called by the main core when main_free is set or by
+ * a control thread.
+ */
+int
+ctl_service_start(int main_free)
+{
+	unsigned int s, n;
+	int r;
+
+
+	if (g_svc.n_services == 0)
+		return 0;
+
+	for (s = 0; s < g_svc.n_services; s++) {
+		for (n = 0; n < g_svc.n_lcores; n++)
+			rte_service_map_lcore_set(g_svc.ids[s], g_svc.lcores[n], 1);
+		rte_service_runstate_set(g_svc.ids[s], 1);
+	}
+
+	for (n = 0; n < g_svc.n_lcores; n++) {
+		r = rte_service_lcore_start(g_svc.lcores[n]);
+		if (r != 0 && r != -EALREADY) {
+			fprintf(stderr, "Error: cannot start service core %u: %s\n",
+				g_svc.lcores[n], rte_strerror(-r));
+			return -1;
+		}
+	}
+
+	if (g_svc.n_lcores == 0 && !main_free) {
+		r = rte_ctrl_thread_create(&g_svc.thread, "mplsfwd-service", NULL,
+			ctl_service_thread, NULL);
+		if (r != 0) {
+			fprintf(stderr, "Error: cannot create the service thread: %s\n",
+				strerror(r));
+			return -1;
+		}
+		g_svc.on_thread = 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * One iteration of every service, on the calling core (no service cores).
+ */
+void
+ctl_service_run(void)
+{
+	unsigned int s;
+
+	for (s = 0; s < g_svc.n_services; s++)
+		rte_service_run_iter_on_app_lcore(g_svc.ids[s], 1);
+}
+
+
+void
+ctl_service_stop(void)
+{
+	unsigned int s, n;
+
+	if (g_svc.stop != 0)
+		return;
+
+	g_svc.stop = 1;
+	if (g_svc.on_thread)
+		pthread_join(g_svc.thread, NULL);
+
+	for (s = 0; s < g_svc.n_services; s++)
+		rte_service_runstate_set(g_svc.ids[s], 0);
+
+	for (n = 0; n < g_svc.n_lcores; n++) {
+		for (s = 0; s < g_svc.n_services; s++) {
+			while (rte_service_may_be_active(g_svc.ids[s]) == 1)
+				rte_pause();
+		}
+		rte_service_lcore_stop(g_svc.lcores[n]);
+		rte_eal_wait_lcore(g_svc.lcores[n]);
+	}
+}
+
+
+/*
+ * Print the calls and cycles of each service, and where they run.
+ */
+void
+ctl_service_print(void)
+{
+	uint64_t calls, cycles;
+	unsigned int s, n;
+
+	if (g_svc.n_services == 0)
+		return;
+
+	printf("Services (");
+	if (g_svc.n_lcores == 0)
+		printf(g_svc.on_thread ? "control thread" : "main core");
+	for (n = 0; n < g_svc.n_lcores; n++)
+		printf("%score %u", n ? ", " : "", g_svc.lcores[n]);
+	printf("):\n");
+
+	for (s = 0; s < g_svc.n_services; s++) {
+		calls = cycles = 0;
+		rte_service_attr_get(g_svc.ids[s], RTE_SERVICE_ATTR_CALL_COUNT, &calls);
+		rte_service_attr_get(g_svc.ids[s], RTE_SERVICE_ATTR_CYCLES, &cycles);
+		printf("  %-20s calls=%"PRIu64" cycles=%"PRIu64" (%"PRIu64" per call)\n",
+			rte_service_get_name(g_svc.ids[s]), calls, cycles,
+			calls != 0 ? cycles / calls : 0);
+	}
+}
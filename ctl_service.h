@@ -0,0 +1,27 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_CTL_SERVICE_H__
+#define __INCLUDED_CTL_SERVICE_H__
+
+#include <stdint.h>
+#include <rte_service.h>
+
+
+#define CTL_SERVICE_MAX_NUM 8
+
+int ctl_service_lcores_set(unsigned int const *lcores, unsigned int n_lcores);
+unsigned int ctl_service_lcores_num(void);
+int ctl_service_register(char const *name, rte_service_func fn, void *arg);
+int ctl_service_start(int main_free);
+void ctl_service_run(void);
+void ctl_service_stop(void);
+void ctl_service_print(void);
+
+#endif /* __INCLUDED_CTL_SERVICE_H__ */
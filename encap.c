@@ -0,0 +1,186 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <rte_common.h>
+#include <rte_ethdev.h>
+
+#include "encap.h"
+
+
+/*
+ * MPLS over UDP or GRE: the forwarder is a tunnel endpoint. The MPLS frames sent
+ * on the output port are carried in IP to the remote endpoint, the frames received
+ * from it are decapsulated before the label is removed.
+ */
+
+#define ENCAP_ADDR_MAX_LEN  INET6_ADDRSTRLEN
+
+
+/*
+ * <udp|gre>:<local>,<remote>[,<ttl>], both addresses IPv4 or IPv6.
+ */
+int
+encap_parse(char const *arg, struct encap_conf *conf)
+{
+	char local[ENCAP_ADDR_MAX_LEN], remote[ENCAP_ADDR_MAX_LEN];
+	char const *p, *q;
+	char *end;
+	unsigned long ttl = ENCAP_DEFAULT_TTL;
+	int family;
+
+	memset(conf, 0, sizeof(*conf));
+
+	if (!strncmp(arg, "udp:", 4))
+		conf->type = ENCAP_UDP;
+	else if (!strncmp(arg, "gre:", 4))
+		conf->type = ENCAP_GRE;
+	else
+		return -1;
+	p = arg + 4;
+
+	q = strchr(p, ',');
+	if (q == NULL || (size_t)(q - p) >= sizeof(local))
+		return -1;
+	snprintf(local, sizeof(local), "%.*s", (int)(q - p), p);
+
+	p = q + 1;
+	q = strchr(p, ',');
+	if (q == NULL)
+		q = p + strlen(p);
+	if ((size_t)(q - p) >= sizeof(remote))
+		return -1;
+	snprintf(remote, sizeof(remote), "%.*s", (int)(q - p), p);
+
+	if (*q == ',') {
+		errno = 0;
+		ttl = strtoul(q + 1, &end, 10);
+		if (errno != 0 || end == q + 1 || *end != '\0' || ttl == 0 || ttl > UINT8_MAX)
+			return -1;
+	}
+	conf->ttl = (uint8_t)ttl;
+
+	conf->ipv6 = strchr(local, ':') != NULL;
+	family = conf->ipv6 ? AF_INET6 : AF_INET;
+	if (inet_pton(family, local, conf->local) != 1 ||
+	    inet_pton(family, remote, conf->remote) != 1)
+		return -1;
+
+	return 0;
+}
+
+
+/*
+ * TX offloads of the output port used by the encapsulation: the outer IPv4
+ * header checksum, the UDP checksum over IPv6. Over IPv4 the UDP checksum is 0.
+ */
+uint64_t
+encap_tx_offloads(struct encap_conf const *conf, uint64_t tx_offload_capa)
+{
+	if (conf->type == ENCAP_NONE)
+		return 0;
+	if (!conf->ipv6)
+		return tx_offload_capa & RTE_ETH_TX_OFFLOAD_IPV4_CKSUM;
+	if (conf->type == ENCAP_UDP)
+		return tx_offload_capa & RTE_ETH_TX_OFFLOAD_UDP_CKSUM;
+
+	return 0;
+}
+
+
+/*
+ * Build the outer header of the frames. tx_offloads are the offloads enabled on
+ * the output port, the checksums they don't cover are computed per frame.
+ */
+int
+encap_tmpl_init(struct encap_tmpl *t, struct encap_conf const *conf,
+	uint32_t label, uint32_t ttl, uint64_t tx_offloads)
+{
+	struct rte_ipv4_hdr *ip4;
+	struct rte_ipv6_hdr *ip6;
+	struct rte_udp_hdr *udp;
+	struct rte_gre_hdr *gre;
+	mpls_header_t mpls_hdr = 0;
+	uint8_t *p;
+
+	if (conf->type != ENCAP_UDP && conf->type != ENCAP_GRE) {
+		fprintf(stderr, "Error: %s() invoked with invalid argument\n", __func__);
+		return -1;
+	}
+
+	memset(t, 0, sizeof(*t));
+	t->type = conf->type;
+	t->ipv6 = conf->ipv6;
+	memcpy(t->local, conf->local, sizeof(t->local));
+
+	if (conf->ipv6) {
+		ip6 = (struct rte_ipv6_hdr *)t->hdr;
+		ip6->vtc_flow = rte_cpu_to_be_32(6u << 28);
+		ip6->proto = conf->type == ENCAP_UDP ? IPPROTO_UDP : IPPROTO_GRE;
+		ip6->hop_limits = conf->ttl;
+		memcpy(ip6->src_addr, conf->local, sizeof(ip6->src_addr));
+		memcpy(ip6->dst_addr, conf->remote, sizeof(ip6->dst_addr));
+		t->l3_len = sizeof(*ip6);
+		if (conf->type == ENCAP_UDP && (tx_offloads & RTE_ETH_TX_OFFLOAD_UDP_CKSUM))
+			t->ol_flags = RTE_MBUF_F_TX_IPV6 | RTE_MBUF_F_TX_UDP_CKSUM;
+	} else {
+		ip4 = (struct rte_ipv4_hdr *)t->hdr;
+		ip4->version_ihl = RTE_IPV4_VHL_DEF;
+		ip4->fragment_offset = rte_cpu_to_be_16(RTE_IPV4_HDR_DF_FLAG);
+		ip4->time_to_live = conf->ttl;
+		ip4->next_proto_id = conf->type == ENCAP_UDP ? IPPROTO_UDP : IPPROTO_GRE;
+		memcpy(&ip4->src_addr, conf->local, sizeof(ip4->src_addr));
+		memcpy(&ip4->dst_addr, conf->remote, sizeof(ip4->dst_addr));
+		t->l3_len = sizeof(*ip4);
+		t->ip4_sum = rte_raw_cksum(ip4, sizeof(*ip4));
+		if (tx_offloads & RTE_ETH_TX_OFFLOAD_IPV4_CKSUM)
+			t->ol_flags = RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM;
+	}
+
+	p = t->hdr + t->l3_len;
+	if (conf->type == ENCAP_UDP) {
+		udp = (struct rte_udp_hdr *)p;
+		udp->dst_port = rte_cpu_to_be_16(ENCAP_MPLS_UDP_PORT);
+		p += sizeof(*udp);
+	} else {
+		gre = (struct rte_gre_hdr *)p;
+		gre->proto = rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS);
+		p += sizeof(*gre);
+	}
+
+	mpls_set_label(&mpls_hdr, label);
+	mpls_set_eos(&mpls_hdr, 1);
+	mpls_set_ttl(&mpls_hdr, ttl);
+	*(mpls_header_t *)p = rte_cpu_to_be_32(mpls_hdr);
+	p += MPLS_HDR_LEN;
+
+	t->len = (uint16_t)(p - t->hdr);
+
+	return 0;
+}
+
+
+void
+encap_print(struct encap_conf const *conf)
+{
+	char local[ENCAP_ADDR_MAX_LEN], remote[ENCAP_ADDR_MAX_LEN];
+	int family = conf->ipv6 ? AF_INET6 : AF_INET;
+
+	if (conf->type == ENCAP_NONE)
+		return;
+
+	inet_ntop(family, conf->local, local, sizeof(local));
+	inet_ntop(family, conf->remote, remote, sizeof(remote));
+	printf("Encapsulation: MPLS over %s, %s -> %s, ttl %u\n",
+		conf->type == ENCAP_UDP ? "UDP" : "GRE", local, remote, conf->ttl);
+}
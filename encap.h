@@ -0,0 +1,246 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_ENCAP_H__
+#define __INCLUDED_ENCAP_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_gre.h>
+#include <rte_memcpy.h>
+
+#include "mpls.h"
+#include "flow_hash.h"
+
+
+/* Encapsulation of the MPLS frames on the output port */
+enum encap_type {
+	ENCAP_NONE = 0,          /* MPLS over Ethernet */
+	ENCAP_UDP,               /* MPLS over UDP over IP (RFC 7510) */
+	ENCAP_GRE,               /* MPLS over GRE over IP (RFC 4023) */
+};
+
+#define ENCAP_MPLS_UDP_PORT    6635     /* RFC 7510 */
+#define ENCAP_UDP_SPORT_BASE   49152    /* entropy in the dynamic port range */
+#define ENCAP_UDP_SPORT_MASK   0x3fff
+#define ENCAP_IP6_FLOW_MASK    0xfffff
+#define ENCAP_DEFAULT_TTL      64
+
+#define ENCAP_GRE_C            0x8000   /* GRE flags: checksum, key, sequence */
+#define ENCAP_GRE_K            0x2000
+#define ENCAP_GRE_S            0x1000
+#define ENCAP_GRE_VER          0x0007
+
+/* Longest outer header: IPv6 + UDP + the label */
+#define ENCAP_HDR_MAX_LEN \
+	(sizeof(struct rte_ipv6_hdr) + sizeof(struct rte_udp_hdr) + MPLS_HDR_LEN)
+
+/* Outer addresses, given on the command line */
+struct encap_conf {
+	unsigned int type;              /* enum encap_type */
+	unsigned int ipv6;
+	uint8_t local[16];              /* network order, 4 bytes used for IPv4 */
+	uint8_t remote[16];
+	uint8_t ttl;
+};
+
+/*
+ * Outer IP + UDP/GRE + MPLS header, built once and copied in front of each frame.
+ * Only the lengths, the UDP source port (IPv6 flow label) and the checksums are
+ * set per frame. Read-only once built, shared by all cores.
+ */
+struct encap_tmpl {
+	unsigned int type;
+	unsigned int ipv6;
+	uint16_t len;                   /* of hdr[] */
+	uint16_t l3_len;
+	uint64_t ol_flags;              /* TX checksum offloads, 0 = computed here */
+	uint32_t ip4_sum;               /* IPv4 header sum, without the total length */
+	uint8_t local[16];
+	uint8_t hdr[ENCAP_HDR_MAX_LEN];
+};
+
+
+int encap_parse(char const *arg, struct encap_conf *conf);
+uint64_t encap_tx_offloads(struct encap_conf const *conf, uint64_t tx_offload_capa);
+int encap_tmpl_init(struct encap_tmpl *t, struct encap_conf const *conf,
+	uint32_t label, uint32_t ttl, uint64_t tx_offloads);
+void encap_print(struct encap_conf const *conf);
+
+
+/*
+ * Replace the Ethertype of an IP frame by the outer header and the label, with
+ * a single copy of the template. The UDP source port is taken from the flow hash
+ * (of the NIC when it's there), so the transit routers spread the flows.
+ * return
+ *   0: On success
+ *   -EINVAL: the mbuf is shared
+ *   -ENOSPC: not enough headroom
+ */
+static inline int
+encap_push(struct encap_tmpl const *t, struct rte_mbuf *m)
+{
+	struct rte_ether_hdr *eth;
+	struct rte_ipv4_hdr *ip4;
+	struct rte_ipv6_hdr *ip6;
+	struct rte_udp_hdr *udp = NULL;
+	uint32_t hash = 0, len, sum;
+	uint8_t *l3;
+
+	if (!RTE_MBUF_DIRECT(m) || rte_mbuf_refcnt_read(m) > 1)
+		return -EINVAL;
+	if (unlikely(rte_pktmbuf_data_len(m) < RTE_ETHER_HDR_LEN))
+		return -ENOSPC;
+
+	if (t->type == ENCAP_UDP || t->ipv6)
+		hash = (m->ol_flags & RTE_MBUF_F_RX_RSS_HASH) ? m->hash.rss :
+			flow_hash_sym_crc(m);
+
+	eth = (struct rte_ether_hdr *)rte_pktmbuf_prepend(m, t->len);
+	if (unlikely(eth == NULL))
+		return -ENOSPC;
+
+	memmove(eth, (uint8_t *)eth + t->len, RTE_ETHER_HDR_LEN);
+	eth->ether_type = rte_cpu_to_be_16(t->ipv6 ? RTE_ETHER_TYPE_IPV6 :
+		RTE_ETHER_TYPE_IPV4);
+	l3 = (uint8_t *)(eth + 1);
+	rte_memcpy(l3, t->hdr, t->len);
+
+	len = rte_pktmbuf_pkt_len(m) - RTE_ETHER_HDR_LEN;
+	if (t->type == ENCAP_UDP) {
+		udp = (struct rte_udp_hdr *)(l3 + t->l3_len);
+		udp->src_port = rte_cpu_to_be_16(ENCAP_UDP_SPORT_BASE |
+			(hash & ENCAP_UDP_SPORT_MASK));
+		udp->dgram_len = rte_cpu_to_be_16((uint16_t)(len - t->l3_len));
+	}
+
+	if (t->ipv6) {
+		ip6 = (struct rte_ipv6_hdr *)l3;
+		ip6->vtc_flow |= rte_cpu_to_be_32(hash & ENCAP_IP6_FLOW_MASK);
+		ip6->payload_len = rte_cpu_to_be_16((uint16_t)(len - t->l3_len));
+		/* UDP over IPv6 needs its checksum */
+		if (udp != NULL && t->ol_flags != 0)
+			udp->dgram_cksum = rte_ipv6_phdr_cksum(ip6, t->ol_flags);
+		else if (udp != NULL)
+			udp->dgram_cksum = rte_ipv6_udptcp_cksum_mbuf(m, ip6,
+				RTE_ETHER_HDR_LEN + t->l3_len);
+	} else {
+		ip4 = (struct rte_ipv4_hdr *)l3;
+		ip4->total_length = rte_cpu_to_be_16((uint16_t)len);
+		if (t->ol_flags == 0) {
+			sum = t->ip4_sum + ip4->total_length;
+			sum = (sum & 0xffff) + (sum >> 16);
+			sum = (sum & 0xffff) + (sum >> 16);
+			ip4->hdr_checksum = (uint16_t)~sum;
+		}
+	}
+
+	if (t->ol_flags != 0) {
+		m->ol_flags |= t->ol_flags;
+		m->l2_len = RTE_ETHER_HDR_LEN;
+		m->l3_len = t->l3_len;
+		if (udp != NULL)
+			m->l4_len = sizeof(*udp);
+	}
+
+	return 0;
+}
+
+
+/*
+ * Remove the outer header of a frame sent to the local address: the frame is
+ * left as an MPLS frame (Ethernet + labels), as if it was received without
+ * encapsulation. Frames of other protocols, addresses or IPv4 fragments are
+ * left unchanged.
+ * return
+ *   0: On success
+ *   1: Not an encapsulated frame
+ */
+static inline int
+encap_pop(struct encap_tmpl const *t, struct rte_mbuf *m)
+{
+	struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	uint8_t *l3 = (uint8_t *)(eth + 1);
+	uint32_t data_len = rte_pktmbuf_data_len(m);
+	uint32_t l3_len, l4_len, ip_len;
+	uint16_t flags;
+	uint8_t proto;
+
+	if (eth->ether_type != rte_cpu_to_be_16(t->ipv6 ? RTE_ETHER_TYPE_IPV6 :
+	    RTE_ETHER_TYPE_IPV4))
+		return 1;
+
+	if (t->ipv6) {
+		struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)l3;
+
+		if (unlikely(data_len < RTE_ETHER_HDR_LEN + sizeof(*ip6)) ||
+		    memcmp(ip6->dst_addr, t->local, sizeof(ip6->dst_addr)) != 0)
+			return 1;
+		l3_len = sizeof(*ip6);
+		ip_len = l3_len + rte_be_to_cpu_16(ip6->payload_len);
+		proto = ip6->proto;
+	} else {
+		struct rte_ipv4_hdr *ip4 = (struct rte_ipv4_hdr *)l3;
+
+		if (unlikely(data_len < RTE_ETHER_HDR_LEN + sizeof(*ip4)) ||
+		    memcmp(&ip4->dst_addr, t->local, sizeof(ip4->dst_addr)) != 0 ||
+		    rte_ipv4_frag_pkt_is_fragmented(ip4))
+			return 1;
+		l3_len = rte_ipv4_hdr_len(ip4);
+		ip_len = rte_be_to_cpu_16(ip4->total_length);
+		proto = ip4->next_proto_id;
+	}
+
+	if (proto == IPPROTO_UDP && t->type == ENCAP_UDP) {
+		struct rte_udp_hdr *udp = (struct rte_udp_hdr *)(l3 + l3_len);
+
+		l4_len = sizeof(*udp);
+		if (unlikely(data_len < RTE_ETHER_HDR_LEN + l3_len + l4_len) ||
+		    udp->dst_port != rte_cpu_to_be_16(ENCAP_MPLS_UDP_PORT))
+			return 1;
+	} else if (proto == IPPROTO_GRE && t->type == ENCAP_GRE) {
+		struct rte_gre_hdr *gre = (struct rte_gre_hdr *)(l3 + l3_len);
+
+		if (unlikely(data_len < RTE_ETHER_HDR_LEN + l3_len + sizeof(*gre)) ||
+		    gre->proto != rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS))
+			return 1;
+		flags = rte_be_to_cpu_16(*(uint16_t *)gre);
+		if (flags & ENCAP_GRE_VER)
+			return 1;
+		l4_len = sizeof(*gre) + 4 * (!!(flags & ENCAP_GRE_C) +
+			!!(flags & ENCAP_GRE_K) + !!(flags & ENCAP_GRE_S));
+	} else {
+		return 1;
+	}
+
+	if (unlikely(data_len < RTE_ETHER_HDR_LEN + l3_len + l4_len + MPLS_HDR_LEN))
+		return 1;
+
+	/* Ethernet padding of short frames */
+	if (rte_pktmbuf_pkt_len(m) > RTE_ETHER_HDR_LEN + ip_len)
+		rte_pktmbuf_trim(m, (uint16_t)(rte_pktmbuf_pkt_len(m) - RTE_ETHER_HDR_LEN -
+			ip_len));
+
+	rte_pktmbuf_adj(m, (uint16_t)(l3_len + l4_len));
+	memmove(rte_pktmbuf_mtod(m, uint8_t *), eth, RTE_ETHER_HDR_LEN);
+	eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS);
+
+	return 0;
+}
+
+#endif /* __INCLUDED_ENCAP_H__ */
@@ -0,0 +1,208 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <rte_common.h>
+#include <rte_errno.h>
+#include <rte_malloc.h>
+
+#include "fec.h"
+
+
+/*
+ * SR-MPLS: the segment list of each FEC (a destination prefix) is written as
+ * a byte image when the table is built, so pushing it is a single copy.
+ */
+
+#define FEC_LPM4_NAME       "mplsfwd_fec4"
+#define FEC_LPM6_NAME       "mplsfwd_fec6"
+#define FEC_LPM_TBL8S       256
+#define FEC_ADDR_MAX_LEN    INET6_ADDRSTRLEN
+
+
+/*
+ * <prefix>/<len>:<L>[,<L>...] - IPv4 or IPv6 prefix, the top label first.
+ */
+int
+fec_rule_parse(char const *arg, struct fec_rule *rule)
+{
+	char addr[FEC_ADDR_MAX_LEN];
+	char const *slash, *p;
+	char *end;
+	unsigned long val;
+
+	memset(rule, 0, sizeof(*rule));
+
+	slash = strchr(arg, '/');
+	if (slash == NULL || (size_t)(slash - arg) >= sizeof(addr))
+		return -1;
+	snprintf(addr, sizeof(addr), "%.*s", (int)(slash - arg), arg);
+
+	rule->ipv6 = strchr(addr, ':') != NULL;
+	if (inet_pton(rule->ipv6 ? AF_INET6 : AF_INET, addr, rule->addr) != 1)
+		return -1;
+
+	errno = 0;
+	val = strtoul(slash + 1, &end, 10);
+	if (errno != 0 || end == slash + 1 || *end != ':' || val > (rule->ipv6 ? 128 : 32))
+		return -1;
+	rule->depth = (uint8_t)val;
+
+	p = end + 1;
+	do {
+		if (rule->n_labels == FEC_MAX_LABELS)
+			return -ENOSPC;
+		errno = 0;
+		val = strtoul(p, &end, 10);
+		if (errno != 0 || end == p || (*end != ',' && *end != '\0') ||
+		    val > MPLS_HDR_LABEL_MASK)
+			return -1;
+		rule->labels[rule->n_labels++] = (uint32_t)val;
+		p = end + 1;
+	} while (*end == ',');
+
+	return 0;
+}
+
+
+static void
+fec_entry_build(struct fec_entry *e, struct fec_rule const *rule, uint32_t ttl)
+{
+	mpls_header_t mh;
+	unsigned int n;
+
+	for (n = 0; n < rule->n_labels; n++) {
+		mh = 0;
+		mpls_set_label(&mh, rule->labels[n]);
+		mpls_set_eos(&mh, n == rule->n_labels - 1);
+		mpls_set_ttl(&mh, ttl);
+		mh = rte_cpu_to_be_32(mh);
+		memcpy(&e->image[n * MPLS_HDR_LEN], &mh, MPLS_HDR_LEN);
+	}
+	e->len = (uint16_t)(rule->n_labels * MPLS_HDR_LEN);
+}
+
+
+/*
+ * Build the table. Each stack must fit in the headroom of the mbufs, which
+ * is checked here rather than for each frame.
+ */
+int
+fec_table_create(struct fec_table *t, struct fec_rule const *rules,
+	unsigned int n_rules, uint32_t ttl, unsigned int headroom, int socket_id)
+{
+	struct rte_lpm_config lpm4_conf = {
+		.max_rules = n_rules,
+		.number_tbl8s = FEC_LPM_TBL8S,
+	};
+	struct rte_lpm6_config lpm6_conf = {
+		.max_rules = n_rules,
+		.number_tbl8s = FEC_LPM_TBL8S,
+	};
+	unsigned int n, n4 = 0, n6 = 0;
+	uint32_t addr4;
+	int r;
+
+
+	memset(t, 0, sizeof(*t));
+	if (n_rules == 0)
+		return 0;
+
+	for (n = 0; n < n_rules; n++) {
+		if (rules[n].n_labels * MPLS_HDR_LEN > headroom) {
+			fprintf(stderr, "Error: FEC %u: %u labels don't fit in the mbuf headroom "
+				"(%u bytes)\n", n, rules[n].n_labels, headroom);
+			return -1;
+		}
+		if (rules[n].ipv6)
+			n6++;
+		else
+			n4++;
+	}
+
+	t->entries = rte_zmalloc_socket("fec_entries", n_rules * sizeof(*t->entries),
+		RTE_CACHE_LINE_SIZE, socket_id);
+	if (t->entries == NULL) {
+		fprintf(stderr, "Error: cannot allocate the FEC table\n");
+		return -1;
+	}
+	t->n_entries = n_rules;
+
+	if (n4 != 0) {
+		t->lpm4 = rte_lpm_create(FEC_LPM4_NAME, socket_id, &lpm4_conf);
+		if (t->lpm4 == NULL)
+			goto __error_lpm;
+	}
+	if (n6 != 0) {
+		t->lpm6 = rte_lpm6_create(FEC_LPM6_NAME, socket_id, &lpm6_conf);
+		if (t->lpm6 == NULL)
+			goto __error_lpm;
+	}
+
+	for (n = 0; n < n_rules; n++) {
+		fec_entry_build(&t->entries[n], &rules[n], ttl);
+		if (rules[n].ipv6) {
+			r = rte_lpm6_add(t->lpm6, rules[n].addr, rules[n].depth, n);
+		} else {
+			memcpy(&addr4, rules[n].addr, sizeof(addr4));
+			r = rte_lpm_add(t->lpm4, rte_be_to_cpu_32(addr4), rules[n].depth, n);
+		}
+		if (r != 0) {
+			fprintf(stderr, "Error: cannot add FEC %u: %s\n", n, rte_strerror(-r));
+			fec_table_free(t);
+			return -1;
+		}
+	}
+
+	return 0;
+
+__error_lpm:
+	fprintf(stderr, "Error: cannot create the FEC lookup table: %s\n",
+		rte_strerror(rte_errno));
+	fec_table_free(t);
+	return -1;
+}
+
+
+void
+fec_table_free(struct fec_table *t)
+{
+	if (t->lpm4 != NULL)
+		rte_lpm_free(t->lpm4);
+	if (t->lpm6 != NULL)
+		rte_lpm6_free(t->lpm6);
+	rte_free(t->entries);
+	memset(t, 0, sizeof(*t));
+}
+
+
+void
+fec_print(struct fec_rule const *rules, unsigned int n_rules)
+{
+	char addr[FEC_ADDR_MAX_LEN];
+	unsigned int n, l;
+
+	if (n_rules == 0)
+		return;
+
+	printf("SR-MPLS segment lists:\n");
+	for (n = 0; n < n_rules; n++) {
+		inet_ntop(rules[n].ipv6 ? AF_INET6 : AF_INET, rules[n].addr, addr,
+			sizeof(addr));
+		printf("  %s/%u ->", addr, rules[n].depth);
+		for (l = 0; l < rules[n].n_labels; l++)
+			printf(" %u", rules[n].labels[l]);
+		printf("\n");
+	}
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_FEC_H__
+#define __INCLUDED_FEC_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_memcpy.h>
+#include <rte_lpm.h>
+#include <rte_lpm6.h>
+
+#include "mpls.h"
+
+
+#define FEC_MAX_RULES       256
+#define FEC_MAX_LABELS      10          /* SIDs of a segment list */
+#define FEC_IMAGE_MAX_LEN   (FEC_MAX_LABELS * MPLS_HDR_LEN)
+
+/*
+ * SR-MPLS: IP packets to the prefix get the segment list, labels[0] on top.
+ */
+struct fec_rule {
+	unsigned int ipv6;
+	uint8_t addr[16];               /* network order, 4 bytes used for IPv4 */
+	uint8_t depth;
+	unsigned int n_labels;
+	uint32_t labels[FEC_MAX_LABELS];
+};
+
+/* Label stack of a FEC as it's written in the frame */
+struct fec_entry {
+	uint16_t len;
+	uint8_t image[FEC_IMAGE_MAX_LEN];
+};
+
+/*
+ * Longest prefix match of the destination address, the next hop is the index
+ * of the entry. Read-only once the workers are started.
+ */
+struct fec_table {
+	struct rte_lpm *lpm4;
+	struct rte_lpm6 *lpm6;
+	unsigned int n_entries;
+	struct fec_entry *entries;
+};
+
+
+int fec_rule_parse(char const *arg, struct fec_rule *rule);
+int fec_table_create(struct fec_table *t, struct fec_rule const *rules,
+	unsigned int n_rules, uint32_t ttl, unsigned int headroom, int socket_id);
+void fec_table_free(struct fec_table *t);
+void fec_print(struct fec_rule const *rules, unsigned int n_rules);
+
+
+/*
+ * Returns the entry of the IP packet carried in the frame, or NULL when the
+ * frame isn't IP or its destination isn't covered.
+ */
+static inline struct fec_entry const *
+fec_lookup(struct fec_table const *t, struct rte_mbuf *m)
+{
+	struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	uint32_t data_len = rte_pktmbuf_data_len(m);
+	uint32_t nh;
+
+	if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+		struct rte_ipv4_hdr *ip4 = (struct rte_ipv4_hdr *)(eth + 1);
+
+		if (t->lpm4 == NULL ||
+		    unlikely(data_len < RTE_ETHER_HDR_LEN + sizeof(*ip4)) ||
+		    rte_lpm_lookup(t->lpm4, rte_be_to_cpu_32(ip4->dst_addr), &nh) != 0)
+			return NULL;
+	} else if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6)) {
+		struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(eth + 1);
+
+		if (t->lpm6 == NULL ||
+		    unlikely(data_len < RTE_ETHER_HDR_LEN + sizeof(*ip6)) ||
+		    rte_lpm6_lookup(t->lpm6, ip6->dst_addr, &nh) != 0)
+			return NULL;
+	} else {
+		return NULL;
+	}
+
+	return &t->entries[nh];
+}
+
+
+/*
+ * Insert the whole label stack after the Ethernet header: one copy of the image,
+ * whatever the depth. The headroom is checked against the deepest stack when
+ * the table is created.
+ * return
+ *   0: On success
+ *   -EINVAL: the mbuf is shared
+ *   -ENOSPC: not enough headroom
+ */
+static inline int
+fec_push(struct fec_entry const *e, struct rte_mbuf *m)
+{
+	struct rte_ether_hdr *eth;
+
+	if (!RTE_MBUF_DIRECT(m) || rte_mbuf_refcnt_read(m) > 1)
+		return -EINVAL;
+	if (unlikely(rte_pktmbuf_data_len(m) < RTE_ETHER_HDR_LEN))
+		return -ENOSPC;
+
+	eth = (struct rte_ether_hdr *)rte_pktmbuf_prepend(m, e->len);
+	if (unlikely(eth == NULL))
+		return -ENOSPC;
+
+	memmove(eth, (uint8_t *)eth + e->len, RTE_ETHER_HDR_LEN);
+	eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS);
+	rte_memcpy(eth + 1, e->image, e->len);
+
+	/* TX offloads (TSO) see the labels as part of the L2 header */
+	if (m->ol_flags & RTE_MBUF_F_TX_OFFLOAD_MASK)
+		m->l2_len += e->len;
+
+	return 0;
+}
+
+#endif /* __INCLUDED_FEC_H__ */
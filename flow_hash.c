@@ -0,0 +1,39 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+
+#include "flow_hash.h"
+
+
+
+#define SYM_KEY_BYTE0 0x6d
+#define SYM_KEY_BYTE1 0x5a
+
+const uint8_t flow_hash_sym_key[FLOW_HASH_SYM_KEY_LEN] = {
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+};
+
+
+/*
+ * Fill the RSS key of any length (as reported by dev_info.hash_key_size) with
+ * the symmetric pattern.
+ */
+void
+flow_hash_sym_key_fill(uint8_t *key, unsigned int key_len)
+{
+	unsigned int i;
+
+	for (i = 0; i < key_len; i++)
+		key[i] = (i & 1) ? SYM_KEY_BYTE1 : SYM_KEY_BYTE0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_FLOW_HASH_H__
+#define __INCLUDED_FLOW_HASH_H__
+
+#include <stdint.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+#include <rte_thash.h>
+#include <rte_hash_crc.h>
+
+#include "mpls.h"
+
+
+/*
+ * Symmetric Toeplitz key: the 0x6d5a pattern repeats every 16 bits, so swapping
+ * the source and destination addresses (and ports) gives the same hash value.
+ * The software hash needs 40 bytes at most (IPv6 + L4 ports), NICs may use
+ * longer keys which are filled with the same pattern by flow_hash_sym_key_fill().
+ */
+#define FLOW_HASH_SYM_KEY_LEN  40
+
+/* Software hash functions used to distribute MPLS frames between cores */
+enum flow_hash_type {
+	FLOW_HASH_TOEPLITZ = 0,   /* same value as the NIC with the symmetric key */
+	FLOW_HASH_CRC,            /* faster, but unrelated to the NIC hash */
+	FLOW_HASH_ROUND_ROBIN,    /* no hash: frames are dealt to the cores in turn */
+};
+
+extern const uint8_t flow_hash_sym_key[FLOW_HASH_SYM_KEY_LEN];
+
+void flow_hash_sym_key_fill(uint8_t *key, unsigned int key_len);
+
+
+/*
+ * Returns a pointer to the first byte after the Ethernet header and all MPLS
+ * labels (if any), or NULL when the label stack doesn't fit in the first segment.
+ */
+static __rte_always_inline uint8_t *
+flow_hash_l3_ptr(struct rte_mbuf *m)
+{
+	struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	uint8_t *p = (uint8_t *)(eth + 1);
+	uint8_t *end = rte_pktmbuf_mtod_offset(m, uint8_t *, rte_pktmbuf_data_len(m));
+	mpls_header_t mh;
+
+	if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS))
+		return p;
+
+	do {
+		if (unlikely(p + MPLS_HDR_LEN > end))
+			return NULL;
+		mh = rte_be_to_cpu_32(*(mpls_header_t *)p);
+		p += MPLS_HDR_LEN;
+	} while (mpls_get_eos(mh) == 0);
+
+	return p;
+}
+
+
+/*
+ * Extracts the IP addresses (and TCP/UDP ports unless the packet is a fragment)
+ * of the packet carried in the frame, skipping MPLS labels. The tuple is stored
+ * in CPU order as expected by rte_softrss(). Returns the length of the tuple in
+ * 32-bit words (RTE_THASH_V*_L*_LEN), or 0 for non-IP traffic.
+ */
+static inline uint32_t
+flow_hash_tuple(struct rte_mbuf *m, union rte_thash_tuple *tuple)
+{
+	uint8_t *l3, *end;
+	uint32_t len;
+	uint8_t proto;
+	uint16_t *ports = NULL;
+
+	l3 = flow_hash_l3_ptr(m);
+	if (unlikely(l3 == NULL))
+		return 0;
+	end = rte_pktmbuf_mtod_offset(m, uint8_t *, rte_pktmbuf_data_len(m));
+
+	switch (*l3 & 0xf0) {
+	case 0x40: {
+		struct rte_ipv4_hdr *ip4 = (struct rte_ipv4_hdr *)l3;
+
+		if (unlikely(l3 + sizeof(*ip4) > end))
+			return 0;
+		tuple->v4.src_addr = rte_be_to_cpu_32(ip4->src_addr);
+		tuple->v4.dst_addr = rte_be_to_cpu_32(ip4->dst_addr);
+		len = RTE_THASH_V4_L3_LEN;
+		proto = ip4->next_proto_id;
+		if (!rte_ipv4_frag_pkt_is_fragmented(ip4))
+			ports = (uint16_t *)(l3 + rte_ipv4_hdr_len(ip4));
+		break;
+	}
+	case 0x60: {
+		struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)l3;
+
+		if (unlikely(l3 + sizeof(*ip6) > end))
+			return 0;
+		rte_thash_load_v6_addrs(ip6, tuple);
+		len = RTE_THASH_V6_L3_LEN;
+		proto = ip6->proto;
+		ports = (uint16_t *)(ip6 + 1);
+		break;
+	}
+	default:
+		return 0;
+	}
+
+	if (ports != NULL && (proto == IPPROTO_TCP || proto == IPPROTO_UDP) &&
+	    (uint8_t *)(ports + 2) <= end) {
+		if (len == RTE_THASH_V4_L3_LEN) {
+			tuple->v4.sport = rte_be_to_cpu_16(ports[0]);
+			tuple->v4.dport = rte_be_to_cpu_16(ports[1]);
+			len = RTE_THASH_V4_L4_LEN;
+		} else {
+			tuple->v6.sport = rte_be_to_cpu_16(ports[0]);
+			tuple->v6.dport = rte_be_to_cpu_16(ports[1]);
+			len = RTE_THASH_V6_L4_LEN;
+		}
+	}
+
+	return len;
+}
+
+
+/*
+ * Software symmetric RSS hash of the IP packet carried in the frame. MPLS labels
+ * are skipped, so the value computed for a labelled frame is the same as the one
+ * computed by a NIC (configured with the symmetric key) for the unlabelled frame
+ * of the reverse direction. TCP/UDP ports are included unless the packet is
+ * a fragment, which matches the RTE_ETH_RSS_IP|TCP|UDP NIC configuration.
+ * Returns 0 for non-IP traffic.
+ */
+static inline uint32_t
+flow_hash_sym(struct rte_mbuf *m)
+{
+	union rte_thash_tuple tuple;
+	uint32_t len;
+
+	len = flow_hash_tuple(m, &tuple);
+	if (len == 0)
+		return 0;
+
+	return rte_softrss((uint32_t *)&tuple, len, flow_hash_sym_key);
+}
+
+
+#define FLOW_HASH_CRC_INIT 0xffffffff
+
+/*
+ * Cheaper symmetric hash based on the CRC32C instruction (SSE4.2 / ARMv8 CRC)
+ * used by rte_hash_crc(). Addresses and ports are sorted before hashing, so
+ * both directions of a flow give the same value. The result is unrelated to the
+ * NIC Toeplitz hash. Returns 0 for non-IP traffic.
+ */
+static inline uint32_t
+flow_hash_sym_crc(struct rte_mbuf *m)
+{
+	union rte_thash_tuple tuple;
+	uint32_t len, hash, lo, hi;
+	uint16_t sport, dport;
+
+	len = flow_hash_tuple(m, &tuple);
+
+	switch (len) {
+	case RTE_THASH_V4_L3_LEN:
+	case RTE_THASH_V4_L4_LEN:
+		lo = RTE_MIN(tuple.v4.src_addr, tuple.v4.dst_addr);
+		hi = RTE_MAX(tuple.v4.src_addr, tuple.v4.dst_addr);
+		hash = rte_hash_crc_4byte(lo, FLOW_HASH_CRC_INIT);
+		hash = rte_hash_crc_4byte(hi, hash);
+		sport = tuple.v4.sport;
+		dport = tuple.v4.dport;
+		break;
+	case RTE_THASH_V6_L3_LEN:
+	case RTE_THASH_V6_L4_LEN:
+		if (memcmp(tuple.v6.src_addr, tuple.v6.dst_addr, sizeof(tuple.v6.src_addr)) < 0) {
+			hash = rte_hash_crc(tuple.v6.src_addr, sizeof(tuple.v6.src_addr),
+			                    FLOW_HASH_CRC_INIT);
+			hash = rte_hash_crc(tuple.v6.dst_addr, sizeof(tuple.v6.dst_addr), hash);
+		} else {
+			hash = rte_hash_crc(tuple.v6.dst_addr, sizeof(tuple.v6.dst_addr),
+			                    FLOW_HASH_CRC_INIT);
+			hash = rte_hash_crc(tuple.v6.src_addr, sizeof(tuple.v6.src_addr), hash);
+		}
+		sport = tuple.v6.sport;
+		dport = tuple.v6.dport;
+		break;
+	default:
+		return 0;
+	}
+
+	if (len == RTE_THASH_V4_L4_LEN || len == RTE_THASH_V6_L4_LEN)
+		hash = rte_hash_crc_4byte((uint32_t)RTE_MIN(sport, dport) << 16 |
+		                          RTE_MAX(sport, dport), hash);
+
+	return hash;
+}
+
+
+/*
+ * Maps a hash value to an RX queue in the same way as a NIC whose redirection
+ * table was programmed by the forwarder: reta[i] = i % n_queues. A device
+ * without the redirection table (reta_size == 0) is treated as a plain modulo.
+ */
+static __rte_always_inline uint16_t
+flow_hash_to_queue(uint32_t hash, uint16_t reta_size, uint16_t n_queues)
+{
+	if (reta_size != 0)
+		hash %= reta_size;
+	return (uint16_t)(hash % n_queues);
+}
+
+#endif /* __INCLUDED_FLOW_HASH_H__ */
@@ -12,8 +12,18 @@
 #include <inttypes.h>
 #include <rte_ethdev.h>
 #include <rte_lcore.h>
+#include <rte_ring.h>
+#include <rte_cycles.h>
+#include <rte_pause.h>
+#include <rte_mbuf_dyn.h>
+#include <rte_reorder.h>
+#include <rte_ip_frag.h>
+#include <rte_gso.h>
+#include <rte_version.h>
 
 #include "fwd_engine.h"
+#include "flow_hash.h"
+#include "kernels.h"
 #include "common.h"
 #include "mpls.h"
 
@@ -22,8 +32,34 @@
 #define QUIT_TRUE  1
 #define QUIT_FALSE 0
 
+/* TX offloads whose mbuf flags may need rte_eth_tx_prepare() */
+#define FWD_TX_PREP_OFFLOADS \
+	(RTE_ETH_TX_OFFLOAD_IPV4_CKSUM | RTE_ETH_TX_OFFLOAD_UDP_CKSUM | \
+	 RTE_ETH_TX_OFFLOAD_TCP_CKSUM | RTE_ETH_TX_OFFLOAD_TCP_TSO)
+
 static volatile unsigned lets_quit = QUIT_FALSE;
 
+/* Cores done with their setup, which forward packets */
+static uint32_t cores_ready;
+
+/* Graceful drain: the cores still receiving from the ports and the workers which
+ * may still pass frames to other cores */
+static volatile unsigned drain_req;
+static uint64_t drain_start_tsc;
+static uint64_t drain_deadline_tsc;
+static int32_t drain_n_rx_active;
+static int32_t drain_n_fwd_active;
+static uint32_t drain_n_timeout;
+
+/* Reorder: id of the distributor which numbered the frame */
+static int dist_id_dynfield_offset = -1;
+
+static inline uint16_t *
+fwd_dist_id(struct rte_mbuf *m)
+{
+	return RTE_MBUF_DYNFIELD(m, dist_id_dynfield_offset, uint16_t *);
+}
+
 
 /* ************************************************************************** */
 
@@ -34,142 +70,997 @@ void fwd_engine_stop()
 
 
 /*
- * return
- *   0: On success
- *   -ENOSPC: invalid argument
- *
- * NOTE: VLAN support is not implemented
- *       MPLS labels stack (BoS) is not implemented
+ * Number of cores which have built their tables and forward packets.
  */
+unsigned int
+fwd_engine_cores_ready(void)
+{
+	return __atomic_load_n(&cores_ready, __ATOMIC_ACQUIRE);
+}
+
+
+/*
+ * Start the graceful drain: the frames received before are forwarded, then the
+ * cores exit. Cores which are not done within the timeout exit anyway.
+ * May be called from a signal handler.
+ */
+void
+fwd_engine_drain(unsigned int timeout_ms)
+{
+	drain_start_tsc = rte_get_tsc_cycles();
+	drain_deadline_tsc = drain_start_tsc + rte_get_tsc_hz() / MS_PER_S * timeout_ms;
+	rte_smp_wmb();
+	drain_req = 1;
+}
+
+
+int
+fwd_engine_draining(void)
+{
+	return drain_req != 0;
+}
+
+
+/* TSC value the drain (including the TX completion) must be done by */
+uint64_t
+fwd_engine_drain_deadline(void)
+{
+	return drain_deadline_tsc;
+}
+
+
 static inline int
-mpls_header_strip(struct rte_mbuf *pktmb, uint16_t ethertype)
+fwd_drain_expired(void)
 {
-	struct rte_ether_hdr *eth
-		 = rte_pktmbuf_mtod(pktmb, struct rte_ether_hdr *);
+	return drain_req != 0 && rte_get_tsc_cycles() > drain_deadline_tsc;
+}
 
-	if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS))
-		return 0;
 
-	eth = (struct rte_ether_hdr *)rte_pktmbuf_adj(pktmb, sizeof(mpls_header_t));
-	if (unlikely(eth == NULL))
-		return -ENOSPC;
+void
+fwd_engine_drain_print(void)
+{
+	uint64_t us;
 
-	memmove(eth, (uint8_t *)eth - sizeof(mpls_header_t), RTE_ETHER_HDR_LEN);
-	eth->ether_type = rte_cpu_to_be_16(ethertype);
+	if (drain_req == 0)
+		return;
 
-	return 0;
+	us = (rte_get_tsc_cycles() - drain_start_tsc) * US_PER_S / rte_get_tsc_hz();
+	printf("Drain: %"PRIu64" us", us);
+	if (drain_n_timeout != 0)
+		printf(", %u core(s) timed out (in-flight frames lost)", drain_n_timeout);
+	printf("\n");
 }
 
 
-#define IPVERSION_SHIFT 4
-#define IPVERSION_MASK  0xf0
-#define IP4_VERSION     0x40
-#define IP6_VERSION     0x60
+/*
+ * Number of frames to receive from the queue until it's drained: what the queue
+ * holds now, or until it's empty when the driver cannot tell.
+ */
+static uint32_t
+fwd_drain_rx_budget(portid_t port_id, queueid_t queue_id)
+{
+	int r;
+
+	if (queue_id == QUEUEID_MAX)
+		return 0;
+
+	r = rte_eth_rx_queue_count(port_id, queue_id);
+	return (r < 0) ? UINT32_MAX : (uint32_t)r;
+}
 
+
+/*
+ * RX burst limited to the frames received before the drain started.
+ */
 static inline uint16_t
-mpls_deduce_ethertype(struct rte_mbuf *pmb)
+fwd_rx_burst(portid_t port_id, queueid_t queue_id, uint32_t drain, uint32_t *rx_left,
+	struct rte_mbuf **pkts)
 {
-	struct rte_ether_hdr *e = rte_pktmbuf_mtod(pmb, struct rte_ether_hdr *);
-	uint8_t *p = (uint8_t *)(e + 1);
+	uint16_t n, max = MAX_PKT_BURST;
+
+	if (queue_id == QUEUEID_MAX)
+		return 0;
+
+	if (unlikely(drain != 0)) {
+		if (*rx_left == 0)
+			return 0;
+		max = (uint16_t)RTE_MIN(*rx_left, (uint32_t)MAX_PKT_BURST);
+	}
 
-	if (e->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS))
-		p += sizeof(mpls_header_t);
+	n = rte_eth_rx_burst(port_id, queue_id, pkts, max);
 
-	switch(*p & IPVERSION_MASK) {
-	case IP4_VERSION:
-		return RTE_ETHER_TYPE_IPV4;
-	case IP6_VERSION:
-		return RTE_ETHER_TYPE_IPV6;
+	if (unlikely(drain != 0))
+		*rx_left = (n == 0) ? 0 : *rx_left - n;
+	return n;
+}
+
+
+/*
+ * Advance the drain state of a worker. Returns non-zero when the worker is done.
+ */
+static int
+fwd_drain_step(struct fwd_stream *s)
+{
+	switch (s->drain_state) {
+	case FWD_DRAIN_NONE:
+		s->input_port.rx_left = fwd_drain_rx_budget(s->input_port.id,
+			s->input_port.rx_queue_id);
+		s->output_port.rx_left = fwd_drain_rx_budget(s->output_port.id,
+			s->output_port.rx_queue_id);
+		s->input_port.drain = s->output_port.drain = 1;
+		s->drain_state = FWD_DRAIN_RX;
+		/* fall through */
+	case FWD_DRAIN_RX:
+		if (s->input_port.rx_left != 0 || s->output_port.rx_left != 0)
+			break;
+		/* All frames this core passes to others are enqueued */
+		__atomic_sub_fetch(&drain_n_rx_active, 1, __ATOMIC_RELEASE);
+		s->drain_state = FWD_DRAIN_RINGS;
+		/* fall through */
+	case FWD_DRAIN_RINGS:
+		if (__atomic_load_n(&drain_n_rx_active, __ATOMIC_ACQUIRE) != 0 ||
+		    (s->pop_ring != NULL && !rte_ring_empty(s->pop_ring)))
+			break;
+		__atomic_sub_fetch(&drain_n_fwd_active, 1, __ATOMIC_RELEASE);
+		s->drain_state = FWD_DRAIN_TX;
+		/* fall through */
+	case FWD_DRAIN_TX:
+		if (__atomic_load_n(&drain_n_fwd_active, __ATOMIC_ACQUIRE) != 0 ||
+		    (s->input_port.tx_drain_ring != NULL &&
+		     !rte_ring_empty(s->input_port.tx_drain_ring)) ||
+		    (s->output_port.tx_drain_ring != NULL &&
+		     !rte_ring_empty(s->output_port.tx_drain_ring)))
+			break;
+		s->drain_state = FWD_DRAIN_DONE;
+		/* fall through */
 	default:
-		break;
+		return 1;
 	}
 
+	if (fwd_drain_expired()) {
+		__atomic_add_fetch(&drain_n_timeout, 1, __ATOMIC_RELAXED);
+		return 1;
+	}
 	return 0;
 }
 
 
 /*
+ * Called by a forwarding core when the main core requests a pause: acknowledge
+ * and wait until released (or the application quits).
  */
-static inline void
-mpls_remove_hdr_burst(struct rte_mbuf **pkts, unsigned int n_pkts)
+static void
+fwd_ctl_wait(struct fwd_ctl *c)
+{
+	c->paused = 1;
+	rte_smp_mb();
+	while (c->pause_req != 0 && lets_quit == QUIT_FALSE && !fwd_drain_expired())
+		rte_pause();
+	rte_smp_mb();
+	c->paused = 0;
+}
+
+
+static inline int
+fwd_ctl_is_paused(struct fwd_ctl const *c)
+{
+	return c->running == 0 || c->paused != 0;
+}
+
+
+/*
+ * Pause all forwarding cores. Returns 0 when all of them stopped touching the
+ * ports, -1 on timeout (the request is withdrawn, the cores which paused
+ * forward again).
+ */
+int
+fwd_engine_pause(struct fwd_stream *strm, unsigned int n_stream,
+	struct fwd_dist *dist, unsigned int n_dist, unsigned int timeout_ms)
+{
+	uint64_t deadline;
+	unsigned int n, n_paused;
+
+	for (n = 0; n < n_stream; n++)
+		strm[n].ctl.pause_req = 1;
+	for (n = 0; n < n_dist; n++)
+		dist[n].ctl.pause_req = 1;
+	rte_smp_mb();
+
+	deadline = rte_get_timer_cycles() + rte_get_timer_hz() / MS_PER_S * timeout_ms;
+	do {
+		n_paused = 0;
+		for (n = 0; n < n_stream; n++)
+			n_paused += fwd_ctl_is_paused(&strm[n].ctl);
+		for (n = 0; n < n_dist; n++)
+			n_paused += fwd_ctl_is_paused(&dist[n].ctl);
+		if (n_paused == n_stream + n_dist)
+			return 0;
+		rte_pause();
+	} while (rte_get_timer_cycles() < deadline);
+
+	fwd_engine_resume(strm, n_stream, dist, n_dist);
+	return -1;
+}
+
+
+void
+fwd_engine_resume(struct fwd_stream *strm, unsigned int n_stream,
+	struct fwd_dist *dist, unsigned int n_dist)
 {
 	unsigned int n;
+
+	rte_smp_mb();
+	for (n = 0; n < n_stream; n++)
+		strm[n].ctl.pause_req = 0;
+	for (n = 0; n < n_dist; n++)
+		dist[n].ctl.pause_req = 0;
+}
+
+
+/*
+ * Register the mbuf field used by the reorder stage. The sequence number field is
+ * registered by rte_reorder_create().
+ */
+int
+fwd_reorder_init(void)
+{
+	static const struct rte_mbuf_dynfield dist_id_desc = {
+		.name = "mplsfwd_dynfield_dist_id",
+		.size = sizeof(uint16_t),
+		.align = __alignof__(uint16_t),
+	};
+
+	dist_id_dynfield_offset = rte_mbuf_dynfield_register(&dist_id_desc);
+	if (dist_id_dynfield_offset < 0) {
+		fprintf(stderr, "Failed to register mbuf field '%s': %s\n",
+			dist_id_desc.name, rte_strerror(rte_errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * SR-MPLS: the segment list of the FEC of each frame, the label for the frames
+ * without one. Returns the number of frames which got a segment list.
+ */
+static inline unsigned int
+mpls_fec_burst(struct fec_table const *t, struct rte_mbuf **pkts, unsigned int n_pkts,
+		mpls_header_t header)
+{
+	struct fec_entry const *e;
+	unsigned int n, n_fec = 0;
 	int r;
-	uint16_t etype;
 
 	for (n = 0; n < n_pkts; n++) {
-		etype = mpls_deduce_ethertype(pkts[n]);
-		if (unlikely(etype == 0))
-			continue; /* Ignore unknown packet type */
+		e = fec_lookup(t, pkts[n]);
+		if (e != NULL) {
+			r = fec_push(e, pkts[n]);
+			n_fec += (r == 0);
+		} else {
+			r = mpls_header_insert(pkts[n], header);
+		}
+		if (r < 0) {
+			fprintf(stderr, "Unable to add header to mbuf %u: %s\n",
+				n, rte_strerror(-r));
+		}
+	}
+
+	return n_fec;
+}
+
+
+/*
+ * MPLS over UDP/GRE: the outer header and the label in one go.
+ */
+static inline void
+mpls_encap_burst(struct encap_tmpl const *t, struct rte_mbuf **pkts, unsigned int n_pkts)
+{
+	unsigned int n;
+	int r;
 
-		r = mpls_header_strip(pkts[n], etype);
+	for (n = 0; n < n_pkts; n++) {
+		r = encap_push(t, pkts[n]);
 		if (r < 0) {
-			fprintf(stderr, "Unable to remove mpls header in mbuf %u/%u\n",
-				n, n_pkts);
+			fprintf(stderr, "Unable to encapsulate mbuf %u: %s\n",
+				n, rte_strerror(-r));
 		}
 	}
 }
 
 
 /*
- * return
- *   0: On success
- *   -EINVAL: invalid argument - operation would be unsafe
- *   -ENOSPC: not enough headroom in mbuf
- *
- * NOTE:
- *      VLAN processing is not supported (RTE_ETHER_TYPE_VLAN)
- *      MPLS labels stack (BoS) processing is not support
+ * MPLS over UDP/GRE: received frames become MPLS frames, the others are left
+ * as they are.
  */
-static inline int
-mpls_header_insert(struct rte_mbuf *pktmb, mpls_header_t mpls_hdr)
+static inline void
+mpls_decap_burst(struct encap_tmpl const *t, struct rte_mbuf **pkts, unsigned int n_pkts)
+{
+	unsigned int n;
+
+	for (n = 0; n < n_pkts; n++)
+		encap_pop(t, pkts[n]);
+}
+
+
+/*
+ * Computes the symmetric hash of each MPLS frame (the NIC cannot hash past
+ * the label) and checks whether the reverse direction of the flow, hashed by
+ * the NIC on the input port, lands on the queue served by this core.
+ */
+static inline void
+fwd_sym_hash_burst(struct fwd_stream *s, struct rte_mbuf **pkts, unsigned int n_pkts)
+{
+	unsigned int n;
+
+	g_kernels.hash(pkts, n_pkts, FLOW_HASH_TOEPLITZ);
+	for (n = 0; n < n_pkts; n++) {
+		if (flow_hash_to_queue(pkts[n]->hash.rss, s->input_port.reta_size,
+		    s->input_port.nb_rx_queues) != s->input_port.rx_queue_id)
+			s->stats.rss_miss++;
+	}
+}
+
+
+/*
+ * Transmit a burst on the port, or pass it to the core owning the shared TX queue.
+ * Returns the number of frames sent (or enqueued).
+ */
+static inline uint16_t
+fwd_port_tx(struct fwd_stream *s, struct streaming_port *port,
+	struct rte_mbuf **pkts, uint16_t n_pkts)
+{
+	uint16_t n;
+
+	if (port->tx_ring == NULL)
+		return rte_eth_tx_burst(port->id, port->tx_queue_id, pkts, n_pkts);
+
+	n = (uint16_t)rte_ring_mp_enqueue_burst(port->tx_ring, (void **)pkts, n_pkts, NULL);
+	s->stats.tx_ring_drop += n_pkts - n;
+	return n;
+}
+
+
+/*
+ * Transmit the frames other cores enqueued for the TX queue owned by this core.
+ */
+static inline void
+fwd_port_tx_drain(struct fwd_stream *s, struct streaming_port *port)
+{
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	uint16_t num_deq, num_tx;
+
+	num_deq = (uint16_t)rte_ring_sc_dequeue_burst(port->tx_drain_ring, (void **)pkts,
+		MAX_PKT_BURST, NULL);
+	if (num_deq == 0)
+		return;
+
+	num_tx = rte_eth_tx_burst(port->id, port->tx_queue_id, pkts, num_deq);
+	s->stats.tx_shared += num_tx;
+	if (unlikely(num_tx < num_deq)) {
+		s->stats.tx_shared_drop += num_deq - num_tx;
+		rte_pktmbuf_free_bulk(&pkts[num_tx], num_deq - num_tx);
+	}
+}
+
+
+/*
+ * Analytics mirror: select the MPLS frames with the top label in the mirrored
+ * range. Called before the label is removed, or once the segment lists are pushed.
+ * Returns the number of frames stored in sel[].
+ */
+static inline uint16_t
+fwd_mirror_select(struct fwd_stream const *s, struct rte_mbuf **pkts, uint16_t n_pkts,
+	struct rte_mbuf **sel)
+{
+	struct rte_ether_hdr *eth;
+	uint16_t n, n_sel = 0;
+	uint32_t label;
+
+	for (n = 0; n < n_pkts; n++) {
+		eth = rte_pktmbuf_mtod(pkts[n], struct rte_ether_hdr *);
+		if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS) ||
+		    unlikely(rte_pktmbuf_data_len(pkts[n]) < RTE_ETHER_HDR_LEN + MPLS_HDR_LEN))
+			continue;
+
+		label = mpls_get_label(rte_be_to_cpu_32(*(mpls_header_t *)(eth + 1)));
+		if (label >= s->mirror_first && label <= s->mirror_last)
+			sel[n_sel++] = pkts[n];
+	}
+
+	return n_sel;
+}
+
+
+/*
+ * Pass a reference of the frames to the analytics consumer: no copy, the frame
+ * is freed once both the TX and the consumer are done with it. Frames which don't
+ * fit in the ring aren't mirrored, forwarding never waits for the consumer.
+ * Must be called once the frames are final and before they are sent (the TX may
+ * free them at once).
+ */
+static inline void
+fwd_mirror_burst(struct fwd_stream *s, struct rte_mbuf **pkts, uint16_t n_pkts)
+{
+	unsigned int n, n_enq;
+
+	for (n = 0; n < n_pkts; n++)
+		rte_pktmbuf_refcnt_update(pkts[n], 1);
+
+	n_enq = rte_ring_sp_enqueue_burst(s->mirror_ring, (void **)pkts, n_pkts, NULL);
+	s->stats.mirror_tx += n_enq;
+	if (unlikely(n_enq < n_pkts)) {
+		s->stats.mirror_drop += n_pkts - n_enq;
+		for (n = n_enq; n < n_pkts; n++)
+			rte_pktmbuf_refcnt_update(pkts[n], -1);
+	}
+}
+
+
+/*
+ * Checksum offloads: the burst is checked by the driver (and the pseudo header
+ * checksums fixed where it needs it) only when a frame asks for an offload.
+ * Frames the port can't send as they are dropped.
+ * Returns the number of frames left in pkts[].
+ */
+static inline uint16_t
+fwd_tx_prepare(struct fwd_stream *s, struct streaming_port *port,
+	struct rte_mbuf **pkts, uint16_t n_pkts)
+{
+	uint64_t ol_flags = 0;
+	uint16_t n;
+
+	for (n = 0; n < n_pkts; n++)
+		ol_flags |= pkts[n]->ol_flags;
+	if (likely(!(ol_flags & RTE_MBUF_F_TX_OFFLOAD_MASK)))
+		return n_pkts;
+
+	n = 0;
+	while (n < n_pkts) {
+		n += rte_eth_tx_prepare(port->id, port->tx_queue_id, &pkts[n], n_pkts - n);
+		if (n == n_pkts)
+			break;
+		s->stats.tx_prep_drop++;
+		rte_pktmbuf_free(pkts[n]);
+		memmove(&pkts[n], &pkts[n + 1], (n_pkts - n - 1) * sizeof(*pkts));
+		n_pkts--;
+	}
+
+	return n_pkts;
+}
+
+
+/*
+ * Checksum of an IPv4 header with one 16-bit word changed (RFC 1624), the
+ * words in network order.
+ */
+static inline uint16_t
+fwd_ip4_cksum_update(uint16_t cksum, uint16_t old, uint16_t new)
+{
+	uint32_t sum;
+
+	sum = (uint16_t)~cksum + (uint16_t)~old + new;
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return (uint16_t)~sum;
+}
+
+
+/*
+ * Mirror and transmission of a burst of labelled frames on the output port.
+ */
+static inline void
+fwd_push_tx(struct fwd_stream *s, struct rte_mbuf **pkts, uint16_t num_rx)
+{
+	struct rte_mbuf *mirror[MAX_PKT_BURST];
+	uint16_t num_tx, n_mirror, n_prep;
+
+	if (s->output_port.tx_offloads & FWD_TX_PREP_OFFLOADS) {
+		n_prep = fwd_tx_prepare(s, &s->output_port, pkts, num_rx);
+		s->stats.push_drop += num_rx - n_prep;
+		num_rx = n_prep;
+	}
+
+	/* All pushed frames have the same label, unless SR-MPLS stacks are pushed */
+	if (s->mirror_dirs & FWD_MIRROR_PUSH) {
+		if (s->fec == NULL) {
+			if (s->mpls_label >= s->mirror_first && s->mpls_label <= s->mirror_last)
+				fwd_mirror_burst(s, pkts, num_rx);
+		} else {
+			n_mirror = fwd_mirror_select(s, pkts, num_rx, mirror);
+			if (n_mirror != 0)
+				fwd_mirror_burst(s, mirror, n_mirror);
+		}
+	}
+
+	num_tx = fwd_port_tx(s, &s->output_port, pkts, num_rx);
+	s->hb.last_tx[FWD_DIR_PUSH] = num_tx;
+	s->stats.push_tx += num_tx;
+	s->stats.push_drop += num_rx - num_tx;
+	if (unlikely(num_tx < num_rx))
+		s->stats.push_tx_full++;
+	while (num_tx < num_rx) {
+		rte_pktmbuf_free(pkts[num_tx++]);
+	}
+}
+
+
+/*
+ * TSO: large TCP segments received from a VM - reported as LRO by vhost, or with
+ * the TX flags in its legacy mode - get the TX flags and header lengths needed to
+ * segment them on the output port, and the pseudo header checksum in TCP.
+ */
+static inline void
+fwd_tso_mark_burst(struct rte_mbuf **pkts, uint16_t n_pkts)
+{
+	struct rte_ether_hdr *eth;
+	struct rte_ipv4_hdr *ip4;
+	struct rte_ipv6_hdr *ip6;
+	struct rte_tcp_hdr *tcp;
+	struct rte_mbuf *m;
+	uint64_t ol_flags;
+	uint16_t n, data_len, l3_len;
+
+	for (n = 0; n < n_pkts; n++) {
+		m = pkts[n];
+		if (likely(!(m->ol_flags & (RTE_MBUF_F_RX_LRO | RTE_MBUF_F_TX_TCP_SEG))) ||
+		    m->tso_segsz == 0)
+			continue;
+
+		data_len = rte_pktmbuf_data_len(m);
+		eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+		ip4 = NULL;
+		ip6 = NULL;
+		if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4) &&
+		    data_len >= RTE_ETHER_HDR_LEN + sizeof(*ip4)) {
+			ip4 = (struct rte_ipv4_hdr *)(eth + 1);
+			if (ip4->next_proto_id != IPPROTO_TCP)
+				continue;
+			l3_len = (uint16_t)rte_ipv4_hdr_len(ip4);
+			ol_flags = RTE_MBUF_F_TX_TCP_SEG | RTE_MBUF_F_TX_IPV4 |
+				RTE_MBUF_F_TX_IP_CKSUM;
+		} else if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6) &&
+		    data_len >= RTE_ETHER_HDR_LEN + sizeof(*ip6)) {
+			ip6 = (struct rte_ipv6_hdr *)(eth + 1);
+			if (ip6->proto != IPPROTO_TCP)
+				continue;
+			l3_len = sizeof(*ip6);
+			ol_flags = RTE_MBUF_F_TX_TCP_SEG | RTE_MBUF_F_TX_IPV6;
+		} else {
+			continue;
+		}
+		if (data_len < RTE_ETHER_HDR_LEN + l3_len + sizeof(*tcp))
+			continue;
+
+		tcp = (struct rte_tcp_hdr *)((uint8_t *)(eth + 1) + l3_len);
+		m->ol_flags = (m->ol_flags & ~RTE_MBUF_F_TX_OFFLOAD_MASK) | ol_flags;
+		m->l2_len = RTE_ETHER_HDR_LEN;
+		m->l3_len = l3_len;
+		m->l4_len = (tcp->data_off >> 4) * 4;
+		if (ip4 != NULL) {
+			ip4->hdr_checksum = 0;
+			tcp->cksum = rte_ipv4_phdr_cksum(ip4, m->ol_flags);
+		} else {
+			tcp->cksum = rte_ipv6_phdr_cksum(ip6, m->ol_flags);
+		}
+	}
+}
+
+
+/*
+ * Software segmentation of a labelled TSO frame: the labels are copied in front
+ * of each segment with the headers, the payload is attached (indirect mbufs).
+ * The checksums of the segments are offloaded to the port, or computed here.
+ */
+static __rte_noinline void
+fwd_gso(struct fwd_stream *s, struct rte_mbuf *m)
+{
+	struct rte_mbuf *segs[FWD_GSO_MAX];
+	struct rte_gso_ctx ctx = *s->gso;
+	struct rte_ipv4_hdr *ip;
+	struct rte_tcp_hdr *tcp;
+	uint16_t l2_len = m->l2_len, l3_len = m->l3_len, l4_len = m->l4_len;
+	uint64_t ol_flags;
+	int n, i;
+
+	/* rte_gso segments TCP over IPv4 only */
+	if (!(m->ol_flags & RTE_MBUF_F_TX_IPV4)) {
+		s->stats.tso_drop++;
+		rte_pktmbuf_free(m);
+		return;
+	}
+
+	ctx.gso_size = l2_len + l3_len + l4_len + m->tso_segsz;
+	if (rte_pktmbuf_pkt_len(m) <= ctx.gso_size) {
+		segs[0] = m;
+		n = 1;
+	} else {
+		/* The segments hold references to the frame, which is freed here */
+		n = rte_gso_segment(m, &ctx, segs, FWD_GSO_MAX);
+		if (n < 0) {
+			s->stats.tso_drop++;
+			rte_pktmbuf_free(m);
+			return;
+		}
+		if (n == 0) {
+			segs[0] = m;
+			n = 1;
+		} else
+			rte_pktmbuf_free(m);
+	}
+
+	for (i = 0; i < n; i++) {
+		ip = rte_pktmbuf_mtod_offset(segs[i], struct rte_ipv4_hdr *, l2_len);
+		tcp = rte_pktmbuf_mtod_offset(segs[i], struct rte_tcp_hdr *, l2_len + l3_len);
+		ol_flags = 0;
+		ip->hdr_checksum = 0;
+		if (s->output_port.tx_offloads & RTE_ETH_TX_OFFLOAD_IPV4_CKSUM)
+			ol_flags |= RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM;
+		else
+			ip->hdr_checksum = rte_ipv4_cksum(ip);
+		if (s->output_port.tx_offloads & RTE_ETH_TX_OFFLOAD_TCP_CKSUM) {
+			ol_flags |= RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_TCP_CKSUM;
+			tcp->cksum = rte_ipv4_phdr_cksum(ip, ol_flags);
+		} else {
+			tcp->cksum = 0;
+			tcp->cksum = rte_ipv4_udptcp_cksum_mbuf(segs[i], ip, l2_len + l3_len);
+		}
+		segs[i]->ol_flags = (segs[i]->ol_flags & ~RTE_MBUF_F_TX_OFFLOAD_MASK) | ol_flags;
+		segs[i]->l2_len = l2_len;
+		segs[i]->l3_len = l3_len;
+		segs[i]->l4_len = l4_len;
+	}
+	s->stats.gso_pkts++;
+	s->stats.gso_segs += n;
+
+	for (i = 0; i < n; i += MAX_PKT_BURST)
+		fwd_push_tx(s, &segs[i], (uint16_t)RTE_MIN(n - i, MAX_PKT_BURST));
+}
+
+
+/*
+ * TSO frames once labelled: the segments are reduced to fit in the MTU of the
+ * output port with the pushed header. Without TSO on the port they are segmented
+ * and sent here. Returns the number of frames left in pkts[].
+ */
+static inline uint16_t
+fwd_tso_burst(struct fwd_stream *s, struct rte_mbuf **pkts, uint16_t n_pkts)
+{
+	uint16_t n, n_keep = 0, hdr_len;
+	struct rte_mbuf *m;
+
+	for (n = 0; n < n_pkts; n++) {
+		m = pkts[n];
+		if (likely(!(m->ol_flags & RTE_MBUF_F_TX_TCP_SEG))) {
+			pkts[n_keep++] = m;
+			continue;
+		}
+
+		hdr_len = m->l2_len + m->l3_len + m->l4_len;
+		if (m->tso_segsz + hdr_len > s->tso_mtu + RTE_ETHER_HDR_LEN)
+			m->tso_segsz = s->tso_mtu + RTE_ETHER_HDR_LEN - hdr_len;
+
+		if (s->gso != NULL) {
+			fwd_gso(s, m);
+			continue;
+		}
+		s->stats.tso_tx++;
+		pkts[n_keep++] = m;
+	}
+
+	return n_keep;
+}
+
+
+/*
+ * Label push and transmission of a burst of frames on the output port.
+ */
+static inline void
+fwd_push_burst(struct fwd_stream *s, struct rte_mbuf **pkts, uint16_t num_rx,
+	mpls_header_t mpls_hdr)
 {
-	struct rte_ether_hdr *new;
-	mpls_header_t *mpls;
+	if (s->encap != NULL)
+		mpls_encap_burst(s->encap, pkts, num_rx);
+	else if (s->fec != NULL)
+		s->stats.fec_push += mpls_fec_burst(s->fec, pkts, num_rx, mpls_hdr);
+	else
+		g_kernels.push(pkts, num_rx, mpls_hdr);
 
-	/* Can't insert header if mbuf is shared */
-	if (!RTE_MBUF_DIRECT(pktmb) || rte_mbuf_refcnt_read(pktmb) > 1)
+	if (s->tso)
+		num_rx = fwd_tso_burst(s, pkts, num_rx);
+	if (num_rx != 0)
+		fwd_push_tx(s, pkts, num_rx);
+}
+
+
+/*
+ * MTU check: length of the header pushed on the frame.
+ */
+static inline uint16_t
+fwd_push_hdr_len(struct fwd_stream const *s, struct rte_mbuf *m)
+{
+	struct fec_entry const *e;
+
+	if (s->encap != NULL)
+		return s->encap->len;
+	if (s->fec != NULL) {
+		e = fec_lookup(s->fec, m);
+		if (e != NULL)
+			return e->len;
+	}
+	return MPLS_HDR_LEN;
+}
+
+
+/*
+ * Split an IPv4 frame into fragments which fit in the MTU with hdr_len bytes
+ * pushed. The payload isn't copied: each fragment is a new header followed by
+ * an indirect mbuf attached to the frame, which is released once they are sent.
+ * Returns the number of fragments (frame with its Ethernet header) or < 0.
+ */
+static int
+fwd_frag_ipv4(struct fwd_stream *s, struct rte_mbuf *m, uint16_t hdr_len,
+	struct rte_mbuf **frags)
+{
+	struct rte_ether_hdr eth, *p;
+	struct rte_ipv4_hdr *ip;
+	uint16_t ihl, mtu, cksum, total_length, fragment_offset;
+	int32_t n, i;
+	int offload;
+
+	eth = *rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, RTE_ETHER_HDR_LEN);
+	ihl = (uint16_t)rte_ipv4_hdr_len(ip);
+	cksum = ip->hdr_checksum;
+	total_length = ip->total_length;
+	fragment_offset = ip->fragment_offset;
+	if (s->out_mtu < hdr_len + ihl + RTE_IPV4_HDR_FO_ALIGN ||
+	    rte_pktmbuf_data_len(m) < RTE_ETHER_HDR_LEN + ihl) {
+		rte_pktmbuf_free(m);
 		return -EINVAL;
+	}
+
+	/* The payload of all fragments but the last is a multiple of 8 bytes */
+	mtu = ihl + RTE_ALIGN_FLOOR(s->out_mtu - hdr_len - ihl, RTE_IPV4_HDR_FO_ALIGN);
+
+	rte_pktmbuf_adj(m, RTE_ETHER_HDR_LEN);
+	n = rte_ipv4_fragment_packet(m, frags, FWD_FRAG_MAX, mtu, s->frag_direct_pool,
+		s->frag_indirect_pool);
+	rte_pktmbuf_free(m);
+	if (n < 0)
+		return n;
 
-	/* the first segment is too short */
-	if (rte_pktmbuf_data_len(pktmb) < RTE_ETHER_MIN_LEN) {
-		fprintf(stderr,
-		       "Insufficient buffer size: datalen=%hu, pktlen=%u, buflen=%hu, "
-		       "refcnt=%hu, segments=%hu\n",
-		       pktmb->data_len, pktmb->pkt_len, pktmb->buf_len, pktmb->refcnt,
-		       pktmb->nb_segs);
-		return -ENOSPC;
+	/* The header checksum is offloaded, or updated for the length and offset of
+	 * the fragment. The outer header of MPLS over UDP/GRE takes the offload.
+	 * The fragments but the first carry only the options with the copy flag:
+	 * their header is shorter then, and its checksum is computed. */
+	offload = (s->output_port.tx_offloads & RTE_ETH_TX_OFFLOAD_IPV4_CKSUM) &&
+		s->encap == NULL;
+	for (i = 0; i < n; i++) {
+		ip = rte_pktmbuf_mtod(frags[i], struct rte_ipv4_hdr *);
+		if (offload) {
+			ip->hdr_checksum = 0;
+			frags[i]->ol_flags = (frags[i]->ol_flags & ~RTE_MBUF_F_TX_OFFLOAD_MASK) |
+				RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM;
+			frags[i]->l2_len = RTE_ETHER_HDR_LEN;
+			frags[i]->l3_len = (uint16_t)rte_ipv4_hdr_len(ip);
+		} else if (rte_ipv4_hdr_len(ip) == ihl) {
+			ip->hdr_checksum = fwd_ip4_cksum_update(fwd_ip4_cksum_update(cksum,
+				total_length, ip->total_length), fragment_offset,
+				ip->fragment_offset);
+		} else {
+			ip->hdr_checksum = 0;
+			ip->hdr_checksum = rte_ipv4_cksum(ip);
+		}
+		p = (struct rte_ether_hdr *)rte_pktmbuf_prepend(frags[i], RTE_ETHER_HDR_LEN);
+		if (unlikely(p == NULL)) {
+			rte_pktmbuf_free_bulk(frags, n);
+			return -ENOSPC;
+		}
+		*p = eth;
 	}
 
-	new = (struct rte_ether_hdr *)rte_pktmbuf_prepend(pktmb, sizeof(mpls_header_t));
-	if (new == NULL)
-		return -ENOSPC;
+	return n;
+}
 
-	memmove(new, (uint8_t *)new + sizeof(mpls_header_t), RTE_ETHER_HDR_LEN);
-	new->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS);
-	mpls = (mpls_header_t *)(new + 1);
-	*mpls = rte_cpu_to_be_32(mpls_hdr);
 
-	return 0;
+/*
+ * A frame which doesn't fit in the MTU of the output port once labelled.
+ * Slow path, at most a few frames of a burst get here.
+ */
+static __rte_noinline void
+fwd_mtu_exceeded(struct fwd_stream *s, struct rte_mbuf *m, uint16_t hdr_len,
+	mpls_header_t mpls_hdr)
+{
+	struct rte_mbuf *frags[FWD_FRAG_MAX];
+	struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	struct rte_ipv4_hdr *ip;
+	int n;
+
+	if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4) &&
+	    rte_pktmbuf_data_len(m) >= RTE_ETHER_HDR_LEN + sizeof(*ip)) {
+		ip = (struct rte_ipv4_hdr *)(eth + 1);
+		if (s->frag_indirect_pool != NULL &&
+		    !(ip->fragment_offset & rte_cpu_to_be_16(RTE_IPV4_HDR_DF_FLAG))) {
+			n = fwd_frag_ipv4(s, m, hdr_len, frags);
+			if (n < 0) {
+				s->stats.frag_fail++;
+				return;
+			}
+			s->stats.frag_pkts++;
+			s->stats.frag_out += n;
+			fwd_push_burst(s, frags, (uint16_t)n, mpls_hdr);
+			return;
+		}
+	} else if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6)) {
+		s->stats.mtu_drop++;
+		rte_pktmbuf_free(m);
+		return;
+	}
+
+	/* The slow path reports the MTU left to the IP packet */
+	m->hash.usr = s->out_mtu - hdr_len;
+	if (s->slow_ring != NULL && rte_ring_sp_enqueue(s->slow_ring, m) == 0) {
+		s->stats.slow_tx++;
+		return;
+	}
+	s->stats.mtu_drop++;
+	rte_pktmbuf_free(m);
 }
 
 
 /*
+ * MTU check of a burst before the push. The frames which fit once labelled are
+ * left in pkts[], the others are fragmented and sent, or passed to the slow path.
+ * Returns the number of frames left.
+ */
+static inline uint16_t
+fwd_mtu_burst(struct fwd_stream *s, struct rte_mbuf **pkts, uint16_t n_pkts,
+	mpls_header_t mpls_hdr)
+{
+	uint32_t max_len = (uint32_t)s->out_mtu + RTE_ETHER_HDR_LEN;
+	uint16_t n, n_keep = 0, hdr_len;
+
+	for (n = 0; n < n_pkts; n++) {
+		if (likely(rte_pktmbuf_pkt_len(pkts[n]) + s->push_hdr_max <= max_len)) {
+			pkts[n_keep++] = pkts[n];
+			continue;
+		}
+		/* TSO frames are segmented after the push */
+		hdr_len = fwd_push_hdr_len(s, pkts[n]);
+		if (rte_pktmbuf_pkt_len(pkts[n]) + hdr_len <= max_len ||
+		    (pkts[n]->ol_flags & RTE_MBUF_F_TX_TCP_SEG))
+			pkts[n_keep++] = pkts[n];
+		else
+			fwd_mtu_exceeded(s, pkts[n], hdr_len, mpls_hdr);
+	}
+
+	return n_keep;
+}
+
+
+/*
+ * Label removal and transmission of a burst of MPLS frames on the input port.
  */
 static inline void
-mpls_add_hdr_burst(struct rte_mbuf **pkts, unsigned int n_pkts,
-		mpls_header_t header)
+fwd_pop_burst(struct fwd_stream *s, struct rte_mbuf **pkts, uint16_t num_rx)
 {
-	unsigned int n;
-	int r;
+	struct rte_mbuf *mirror[MAX_PKT_BURST];
+	uint16_t num_tx, n_mirror = 0;
+
+	if (s->mirror_dirs & FWD_MIRROR_POP)
+		n_mirror = fwd_mirror_select(s, pkts, num_rx, mirror);
+	g_kernels.pop(pkts, num_rx);
+	if (n_mirror != 0)
+		fwd_mirror_burst(s, mirror, n_mirror);
+	num_tx = fwd_port_tx(s, &s->input_port, pkts, num_rx);
+	s->hb.last_rx[FWD_DIR_POP] = num_rx;
+	s->hb.last_tx[FWD_DIR_POP] = num_tx;
+	s->stats.pop_rx += num_rx;
+	s->stats.pop_tx += num_tx;
+	s->stats.pop_drop += num_rx - num_tx;
+	if (unlikely(num_tx < num_rx))
+		s->stats.pop_tx_full++;
+	while (num_tx < num_rx) {
+		rte_pktmbuf_free(pkts[num_tx++]);
+	}
+}
+
+
+/*
+ * Reorder: label removal, then the frames go back to the distributor which
+ * numbered them and sends them in order.
+ */
+static inline void
+fwd_reorder_return(struct fwd_stream *s, struct rte_mbuf **pkts, uint16_t num_rx)
+{
+	struct rte_mbuf *batch[MAX_PKT_BURST];
+	uint16_t n, i, n_batch, dist_id, n_mirror = 0;
+	unsigned int n_enq;
+
+	if (s->mirror_dirs & FWD_MIRROR_POP)
+		n_mirror = fwd_mirror_select(s, pkts, num_rx, batch);
+	g_kernels.pop(pkts, num_rx);
+	if (n_mirror != 0)
+		fwd_mirror_burst(s, batch, n_mirror);
+	s->stats.pop_rx += num_rx;
+
+	/* Usually there is one distributor: batch frames of the same one */
+	while (num_rx != 0) {
+		dist_id = *fwd_dist_id(pkts[0]);
+		n_batch = 0;
+		for (n = 0, i = 0; n < num_rx; n++) {
+			if (*fwd_dist_id(pkts[n]) == dist_id)
+				batch[n_batch++] = pkts[n];
+			else
+				pkts[i++] = pkts[n];
+		}
+		num_rx = i;
+
+		n_enq = rte_ring_mp_enqueue_burst(s->reorder_rings[dist_id], (void **)batch,
+			n_batch, NULL);
+		s->stats.pop_tx += n_enq;
+		if (unlikely(n_enq < n_batch)) {
+			s->stats.pop_drop += n_batch - n_enq;
+			s->stats.reorder_ring_drop += n_batch - n_enq;
+			rte_pktmbuf_free_bulk(&batch[n_enq], n_batch - n_enq);
+		}
+	}
+}
+
 
+/*
+ * Software label steering: frames with a label steered to another core are
+ * passed to the ring of that core, the rest stays in pkts[].
+ * Returns the number of frames left for local processing.
+ */
+static inline uint16_t
+fwd_steer_burst(struct fwd_stream *s, struct rte_mbuf **pkts, uint16_t n_pkts)
+{
+	struct rte_mbuf *redir[MAX_PKT_BURST];
+	uint16_t target[MAX_PKT_BURST];
+	struct rte_mbuf *batch[MAX_PKT_BURST];
+	uint16_t n, n_local, n_redir, n_batch, tgt, i;
+	unsigned int n_enq;
+	int q[MAX_PKT_BURST];
+
+	g_kernels.classify(s->steer, pkts, n_pkts, q);
+	n_local = n_redir = 0;
 	for (n = 0; n < n_pkts; n++) {
-		r = mpls_header_insert(pkts[n], header);
-		if (r < 0) {
-			fprintf(stderr, "Unable to add header to mbuf %u: %s\n",
-				n, rte_strerror(-r));
+		if (q[n] < 0 || q[n] == s->stream_id) {
+			pkts[n_local++] = pkts[n];
+			continue;
+		}
+		redir[n_redir] = pkts[n];
+		target[n_redir++] = (uint16_t)q[n];
+	}
+
+	/* Usually a few heavy LSPs are steered: batch frames of the same target */
+	while (n_redir != 0) {
+		tgt = target[0];
+		n_batch = 0;
+		for (n = 0, i = 0; n < n_redir; n++) {
+			if (target[n] == tgt) {
+				batch[n_batch++] = redir[n];
+			} else {
+				redir[i] = redir[n];
+				target[i++] = target[n];
+			}
+		}
+		n_redir = i;
+
+		n_enq = rte_ring_mp_enqueue_burst(s->steer_rings[tgt], (void **)batch,
+			n_batch, NULL);
+		s->stats.steer_redirect += n_enq;
+		if (unlikely(n_enq < n_batch)) {
+			s->stats.steer_drop += n_batch - n_enq;
+			rte_pktmbuf_free_bulk(&batch[n_enq], n_batch - n_enq);
 		}
 	}
+
+	return n_local;
 }
 
 
@@ -181,7 +1072,7 @@ fwd_worker_loop(void *arg)
 {
 	struct rte_mbuf *pkts[MAX_PKT_BURST];
 	struct fwd_stream *s = arg;
-	uint16_t num_rx, num_tx;
+	uint16_t num_rx;
 	mpls_header_t mpls_hdr = 0;
 
 
@@ -214,37 +1105,497 @@ fwd_worker_loop(void *arg)
 			rte_lcore_id(),
 			s->input_port.id, s->input_port.rx_queue_id, s->input_port.tx_queue_id,
 			s->output_port.id, s->output_port.rx_queue_id, s->output_port.tx_queue_id);
+		if (s->pop_ring != NULL)
+			printf("  MPLS frames from ring '%s'\n", s->pop_ring->name);
+		if (s->mirror_ring != NULL)
+			printf("  mirrors frames to ring '%s'\n", s->mirror_ring->name);
+		if (s->slow_ring != NULL)
+			printf("  frames over the MTU to ring '%s'\n", s->slow_ring->name);
+		if (s->input_port.tx_ring != NULL)
+			printf("  port %hu (in) : shares TX queue through ring '%s'\n",
+				s->input_port.id, s->input_port.tx_ring->name);
+		if (s->output_port.tx_ring != NULL)
+			printf("  port %hu (out): shares TX queue through ring '%s'\n",
+				s->output_port.id, s->output_port.tx_ring->name);
 	}
 
 
+	__atomic_add_fetch(&drain_n_rx_active, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&drain_n_fwd_active, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&cores_ready, 1, __ATOMIC_RELEASE);
+	s->ctl.running = 1;
 	while (lets_quit == QUIT_FALSE) {
+		s->hb.count++;
+		if (unlikely(s->ctl.pause_req != 0)) {
+			fwd_ctl_wait(&s->ctl);
+			continue;
+		}
+
 		/* Adding label */
-		num_rx = rte_eth_rx_burst(s->input_port.id, s->input_port.rx_queue_id,
-				pkts, MAX_PKT_BURST);
+		num_rx = fwd_rx_burst(s->input_port.id, s->input_port.rx_queue_id,
+			s->input_port.drain, &s->input_port.rx_left, pkts);
 		if (num_rx != 0) {
-			mpls_add_hdr_burst(pkts, num_rx, mpls_hdr);
-			num_tx = rte_eth_tx_burst(s->output_port.id,
-			                          s->output_port.tx_queue_id, pkts, num_rx);
-			while (num_tx < num_rx) {
-				rte_pktmbuf_free(pkts[num_tx++]);
-			}
+			s->hb.last_rx[FWD_DIR_PUSH] = num_rx;
+			s->stats.push_rx += num_rx;
+			if (s->tso)
+				fwd_tso_mark_burst(pkts, num_rx);
+			if (s->out_mtu != 0)
+				num_rx = fwd_mtu_burst(s, pkts, num_rx, mpls_hdr);
+			if (num_rx != 0)
+				fwd_push_burst(s, pkts, num_rx, mpls_hdr);
+		} else if (s->input_port.rx_queue_id != QUEUEID_MAX) {
+			s->stats.push_rx_empty++;
 		}
 
 		if (lets_quit == QUIT_TRUE)
 			break;
 
 		/* Label removal */
-		num_rx = rte_eth_rx_burst(s->output_port.id, s->output_port.rx_queue_id,
-				pkts, MAX_PKT_BURST);
+		num_rx = fwd_rx_burst(s->output_port.id, s->output_port.rx_queue_id,
+			s->output_port.drain, &s->output_port.rx_left, pkts);
+		if (num_rx == 0 && s->output_port.rx_queue_id != QUEUEID_MAX)
+			s->stats.pop_rx_empty++;
+		else if (num_rx != 0 && s->encap != NULL)
+			mpls_decap_burst(s->encap, pkts, num_rx);
+		if (num_rx != 0 && s->steer != NULL)
+			num_rx = fwd_steer_burst(s, pkts, num_rx);
 		if (num_rx != 0) {
-			mpls_remove_hdr_burst(pkts, num_rx);
-			num_tx = rte_eth_tx_burst(s->input_port.id,
-			                          s->input_port.tx_queue_id, pkts, num_rx);
-			while (num_tx < num_rx) {
-				rte_pktmbuf_free(pkts[num_tx++]);
+			if (s->sym_rss)
+				fwd_sym_hash_burst(s, pkts, num_rx);
+			fwd_pop_burst(s, pkts, num_rx);
+		}
+
+		if (s->pop_ring != NULL) {
+			num_rx = rte_ring_sc_dequeue_burst(s->pop_ring, (void **)pkts,
+					MAX_PKT_BURST, NULL);
+			if (num_rx != 0 && s->reorder_rings != NULL)
+				fwd_reorder_return(s, pkts, num_rx);
+			else if (num_rx != 0)
+				fwd_pop_burst(s, pkts, num_rx);
+		}
+
+		/* Shared TX queues owned by this core */
+		if (s->output_port.tx_drain_ring != NULL)
+			fwd_port_tx_drain(s, &s->output_port);
+		if (s->input_port.tx_drain_ring != NULL)
+			fwd_port_tx_drain(s, &s->input_port);
+
+		if (unlikely(drain_req != 0) && fwd_drain_step(s) != 0)
+			break;
+	}
+	s->ctl.running = 0;
+
+	return 0;
+}
+
+
+/*
+ * Hand over the staged frames to the workers. Frames which don't fit in the ring
+ * are dropped - the distributor never waits for a worker.
+ */
+static inline void
+fwd_dist_flush(struct fwd_dist *d)
+{
+	struct fwd_dist_buf *b;
+	unsigned int w, n;
+
+	for (w = 0; w < d->n_rings; w++) {
+		b = &d->bufs[w];
+		if (b->n == 0)
+			continue;
+
+		n = rte_ring_enqueue_burst(d->rings[w], (void **)b->pkts, b->n, NULL);
+		d->stats.enqueued += n;
+		if (unlikely(n < b->n)) {
+			d->stats.drop += b->n - n;
+			rte_pktmbuf_free_bulk(&b->pkts[n], b->n - n);
+		}
+		b->n = 0;
+	}
+}
+
+
+/*
+ * Reorder: number the frame before it's passed to the worker. A frame which is
+ * numbered and then dropped would hold the following ones in the reorder buffer,
+ * so frames which don't fit in the ring of the worker are dropped here.
+ * Returns 0 when the frame is to be passed to the worker.
+ */
+static inline int
+fwd_reorder_tag(struct fwd_dist *d, uint16_t w, struct rte_mbuf *m)
+{
+	struct fwd_dist_buf *b = &d->bufs[w];
+
+	if (b->n == 0)
+		b->room = (uint16_t)RTE_MIN(rte_ring_free_count(d->rings[w]),
+			(unsigned int)MAX_PKT_BURST);
+	if (unlikely(b->n >= b->room)) {
+		d->stats.drop++;
+		rte_pktmbuf_free(m);
+		return -1;
+	}
+
+	*rte_reorder_seqn(m) = d->seqn++;
+	*fwd_dist_id(m) = d->dist_id;
+	return 0;
+}
+
+
+static inline void
+fwd_reorder_tx(struct fwd_dist *d, struct rte_mbuf **pkts, uint16_t n_pkts)
+{
+	uint16_t num_tx;
+
+	num_tx = rte_eth_tx_burst(d->tx_port_id, d->tx_queue_id, pkts, n_pkts);
+	d->stats.ro_tx += num_tx;
+	if (unlikely(num_tx < n_pkts)) {
+		d->stats.ro_drop += n_pkts - num_tx;
+		rte_pktmbuf_free_bulk(&pkts[num_tx], n_pkts - num_tx);
+	}
+}
+
+
+/*
+ * Send the frames which are in order. Returns the number of frames drained.
+ */
+static inline unsigned int
+fwd_reorder_tx_ready(struct fwd_dist *d)
+{
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	unsigned int n, total = 0;
+
+	do {
+		n = rte_reorder_drain(d->reorder, pkts, MAX_PKT_BURST);
+		if (n != 0)
+			fwd_reorder_tx(d, pkts, (uint16_t)n);
+		d->reorder_held -= n;
+		total += n;
+	} while (n == MAX_PKT_BURST);
+
+	return total;
+}
+
+
+/*
+ * No progress for the timeout: the missing frames were dropped by a worker (or
+ * are late), send what is waiting for them.
+ */
+static void
+fwd_reorder_flush(struct fwd_dist *d)
+{
+	d->stats.ro_timeout++;
+
+#if RTE_VERSION >= RTE_VERSION_NUM(23, 3, 0, 0)
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	unsigned int n;
+
+	do {
+		n = rte_reorder_drain_up_to_seqn(d->reorder, pkts, MAX_PKT_BURST, d->seqn);
+		if (n != 0)
+			fwd_reorder_tx(d, pkts, (uint16_t)n);
+		d->reorder_held -= n;
+	} while (n == MAX_PKT_BURST);
+#else
+	/* Older DPDK cannot skip a missing frame: the waiting frames are freed
+	 * together with the buffer, the new one starts at the next frame */
+	d->stats.ro_timeout_drop += d->reorder_held;
+	d->reorder_held = 0;
+	rte_reorder_free(d->reorder);
+	d->reorder = rte_reorder_create(d->reorder_name, rte_socket_id(), d->reorder_size);
+	if (d->reorder == NULL)
+		fprintf(stderr, "Core %u: failed to re-create reorder buffer '%s', "
+			"frames are sent unordered: %s\n", rte_lcore_id(), d->reorder_name,
+			rte_strerror(rte_errno));
+#endif
+}
+
+
+/*
+ * Take the frames processed by the workers and send them in order.
+ */
+static inline void
+fwd_reorder_drain(struct fwd_dist *d)
+{
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	unsigned int n, num_deq, num;
+	uint64_t now;
+
+	num_deq = rte_ring_sc_dequeue_burst(d->ret_ring, (void **)pkts, MAX_PKT_BURST, NULL);
+
+	if (unlikely(d->reorder == NULL)) {
+		if (num_deq != 0)
+			fwd_reorder_tx(d, pkts, (uint16_t)num_deq);
+		return;
+	}
+
+	for (n = 0; n < num_deq; n++) {
+		if (rte_reorder_insert(d->reorder, pkts[n]) == 0) {
+			d->reorder_held++;
+			continue;
+		}
+
+		if (rte_errno == ENOSPC) {
+			/* No room for the frames moved out of the window */
+			fwd_reorder_tx_ready(d);
+			if (rte_reorder_insert(d->reorder, pkts[n]) == 0) {
+				d->reorder_held++;
+				continue;
 			}
 		}
+
+		if (rte_errno == ERANGE) {
+			/* The window has moved on without this frame */
+			d->stats.ro_late++;
+			fwd_reorder_tx(d, &pkts[n], 1);
+		} else {
+			d->stats.ro_drop++;
+			rte_pktmbuf_free(pkts[n]);
+		}
+	}
+
+	num = fwd_reorder_tx_ready(d);
+
+	now = rte_rdtsc();
+	if (num != 0 || d->reorder_held == 0)
+		d->reorder_last = now;
+	else if (now - d->reorder_last > d->reorder_timeout) {
+		fwd_reorder_flush(d);
+		d->reorder_last = now;
+	}
+}
+
+
+/*
+ * Advance the drain state of a software RSS core. With reorder, the core waits
+ * for the workers to return the frames. Returns non-zero when the core is done.
+ */
+static int
+fwd_dist_drain_step(struct fwd_dist *d)
+{
+	switch (d->drain_state) {
+	case FWD_DRAIN_NONE:
+		d->rx_left = fwd_drain_rx_budget(d->port_id, d->rx_queue_id);
+		d->drain = 1;
+		d->drain_state = FWD_DRAIN_RX;
+		/* fall through */
+	case FWD_DRAIN_RX:
+		if (d->rx_left != 0)
+			break;
+		__atomic_sub_fetch(&drain_n_rx_active, 1, __ATOMIC_RELEASE);
+		d->drain_state = FWD_DRAIN_RINGS;
+		/* fall through */
+	case FWD_DRAIN_RINGS:
+		if (d->ret_ring != NULL &&
+		    (__atomic_load_n(&drain_n_fwd_active, __ATOMIC_ACQUIRE) != 0 ||
+		     !rte_ring_empty(d->ret_ring)))
+			break;
+		/* What is left waits for frames which will never come */
+		if (d->reorder != NULL && d->reorder_held != 0)
+			fwd_reorder_flush(d);
+		d->drain_state = FWD_DRAIN_DONE;
+		/* fall through */
+	default:
+		return 1;
+	}
+
+	if (fwd_drain_expired()) {
+		__atomic_add_fetch(&drain_n_timeout, 1, __ATOMIC_RELAXED);
+		return 1;
+	}
+	return 0;
+}
+
+
+/*
+ * The software RSS loop: receive MPLS frames and redistribute them to workers
+ */
+int
+fwd_dist_loop(void *arg)
+{
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	struct fwd_dist *d = arg;
+	struct rte_mbuf *m;
+	uint16_t num_rx, n, w;
+	int q[MAX_PKT_BURST];
+
+
+	/* Built here rather than at startup: the buffers of all cores are
+	 * allocated (and zeroed) in parallel, on the socket of the core */
+	if (d->ret_ring != NULL && d->reorder == NULL) {
+		d->reorder = rte_reorder_create(d->reorder_name, rte_socket_id(),
+			d->reorder_size);
+		if (d->reorder == NULL) {
+			fprintf(stderr, "Core %u: failed to create reorder buffer '%s': %s\n",
+				rte_lcore_id(), d->reorder_name, rte_strerror(rte_errno));
+			fwd_engine_stop();
+			return -1;
+		}
+	}
+
+	printf("Core %u (socket %u) starts software RSS of port %hu queue %hu\n",
+		rte_lcore_id(), rte_socket_id(), d->port_id, d->rx_queue_id);
+	if (d->ret_ring != NULL)
+		printf("Core %u: frames reordered (window %u) and sent on port %hu queue %hu\n",
+			rte_lcore_id(), d->reorder_size, d->tx_port_id, d->tx_queue_id);
+
+	d->reorder_last = rte_rdtsc();
+
+	__atomic_add_fetch(&drain_n_rx_active, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&cores_ready, 1, __ATOMIC_RELEASE);
+	d->ctl.running = 1;
+	while (lets_quit == QUIT_FALSE) {
+		d->hb.count++;
+		if (unlikely(d->ctl.pause_req != 0)) {
+			fwd_ctl_wait(&d->ctl);
+			d->reorder_last = rte_rdtsc();
+			continue;
+		}
+
+		if (d->ret_ring != NULL)
+			fwd_reorder_drain(d);
+
+		if (unlikely(drain_req != 0) && fwd_dist_drain_step(d) != 0)
+			break;
+
+		num_rx = fwd_rx_burst(d->port_id, d->rx_queue_id, d->drain, &d->rx_left, pkts);
+		if (num_rx == 0)
+			continue;
+		d->hb.last_rx[FWD_DIR_POP] = num_rx;
+		d->stats.rx += num_rx;
+		if (d->encap != NULL)
+			mpls_decap_burst(d->encap, pkts, num_rx);
+
+		if (d->hash_type != FLOW_HASH_ROUND_ROBIN)
+			g_kernels.hash(pkts, num_rx, d->hash_type);
+		if (d->steer != NULL)
+			g_kernels.classify(d->steer, pkts, num_rx, q);
+
+		for (n = 0; n < num_rx; n++) {
+			m = pkts[n];
+			if (d->steer != NULL && q[n] >= 0 && q[n] < d->n_rings)
+				w = (uint16_t)q[n];
+			else if (d->hash_type == FLOW_HASH_ROUND_ROBIN)
+				w = (uint16_t)(d->rr_next++ % d->n_rings);
+			else
+				w = flow_hash_to_queue(m->hash.rss, d->reta_size, d->n_queues);
+
+			if (d->ret_ring != NULL && fwd_reorder_tag(d, w, m) != 0)
+				continue;
+			d->bufs[w].pkts[d->bufs[w].n++] = m;
+		}
+
+		fwd_dist_flush(d);
 	}
+	d->ctl.running = 0;
 
 	return 0;
 }
+
+
+/*
+ * Print counters of the software RSS cores.
+ */
+void
+fwd_dist_stats_print(struct fwd_dist const *dist, unsigned int n_dist)
+{
+	unsigned int d;
+
+	if (dist == NULL || n_dist == 0)
+		return;
+
+	printf("Software RSS statistics:\n");
+	for (d = 0; d < n_dist; d++) {
+		printf("  port %hu queue %hu: rx=%"PRIu64" enqueued=%"PRIu64" drop=%"PRIu64"\n",
+			dist[d].port_id, dist[d].rx_queue_id, dist[d].stats.rx,
+			dist[d].stats.enqueued, dist[d].stats.drop);
+		if (dist[d].ret_ring != NULL)
+			printf("            reorder: tx=%"PRIu64" late=%"PRIu64" drop=%"PRIu64
+			       " timeout=%"PRIu64" timeout-drop=%"PRIu64" held=%"PRIu64"\n",
+			       dist[d].stats.ro_tx, dist[d].stats.ro_late, dist[d].stats.ro_drop,
+			       dist[d].stats.ro_timeout, dist[d].stats.ro_timeout_drop,
+			       dist[d].reorder_held);
+	}
+}
+
+
+/*
+ * Add the counters of a stream to 'sum'.
+ */
+void
+fwd_stream_stats_add(struct fwd_stream_stats *sum, struct fwd_stream_stats const *st)
+{
+	uint64_t *d = (uint64_t *)sum;
+	uint64_t const *v = (uint64_t const *)st;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(*st) / sizeof(uint64_t); i++)
+		d[i] += v[i];
+}
+
+
+/*
+ * Print counters of all streams and their sum.
+ */
+void
+fwd_stream_stats_print(struct fwd_stream const *strm, unsigned int n_stream)
+{
+	struct fwd_stream_stats sum;
+	unsigned int s;
+
+	if (strm == NULL)
+		return;
+
+	memset(&sum, 0, sizeof(sum));
+	printf("Stream statistics:\n");
+	for (s = 0; s < n_stream; s++) {
+		struct fwd_stream_stats const *st = &strm[s].stats;
+
+		printf("  stream %u: push rx=%"PRIu64" tx=%"PRIu64" drop=%"PRIu64
+		       ", pop rx=%"PRIu64" tx=%"PRIu64" drop=%"PRIu64"\n",
+		       s, st->push_rx, st->push_tx, st->push_drop,
+		       st->pop_rx, st->pop_tx, st->pop_drop);
+		if (strm[s].sym_rss)
+			printf("            symmetric hash misses=%"PRIu64"\n", st->rss_miss);
+		if (strm[s].reorder_rings != NULL)
+			printf("            reorder: ring full drop=%"PRIu64"\n",
+			       st->reorder_ring_drop);
+		if (strm[s].steer != NULL)
+			printf("            label steering: redirected=%"PRIu64" drop=%"PRIu64"\n",
+			       st->steer_redirect, st->steer_drop);
+		if (strm[s].input_port.tx_ring != NULL || strm[s].output_port.tx_ring != NULL)
+			printf("            shared TX queue: ring full drop=%"PRIu64"\n",
+			       st->tx_ring_drop);
+		if (strm[s].input_port.tx_drain_ring != NULL ||
+		    strm[s].output_port.tx_drain_ring != NULL)
+			printf("            shared TX queue owner: sent=%"PRIu64" drop=%"PRIu64"\n",
+			       st->tx_shared, st->tx_shared_drop);
+		if (strm[s].input_port.vring || strm[s].output_port.vring)
+			printf("            vring: empty polls push=%"PRIu64" pop=%"PRIu64
+			       ", full TX bursts push=%"PRIu64" pop=%"PRIu64"\n",
+			       st->push_rx_empty, st->pop_rx_empty, st->push_tx_full,
+			       st->pop_tx_full);
+		if (strm[s].mirror_ring != NULL)
+			printf("            mirror: enqueued=%"PRIu64" ring full drop=%"PRIu64"\n",
+			       st->mirror_tx, st->mirror_drop);
+		if (strm[s].fec != NULL)
+			printf("            SR-MPLS: segment lists pushed=%"PRIu64"\n",
+			       st->fec_push);
+		if (strm[s].out_mtu != 0)
+			printf("            over MTU: fragmented=%"PRIu64" (%"PRIu64" fragments, "
+			       "%"PRIu64" failed) slow path=%"PRIu64" drop=%"PRIu64"\n",
+			       st->frag_pkts, st->frag_out, st->frag_fail, st->slow_tx,
+			       st->mtu_drop);
+		if (strm[s].tso)
+			printf("            TSO: to the port=%"PRIu64" software GSO=%"PRIu64
+			       " (%"PRIu64" segments) drop=%"PRIu64"\n",
+			       st->tso_tx, st->gso_pkts, st->gso_segs, st->tso_drop);
+		if (st->tx_prep_drop != 0)
+			printf("            TX prepare drop=%"PRIu64"\n", st->tx_prep_drop);
+
+		fwd_stream_stats_add(&sum, st);
+	}
+	printf("  total   : push rx=%"PRIu64" tx=%"PRIu64" drop=%"PRIu64
+	       ", pop rx=%"PRIu64" tx=%"PRIu64" drop=%"PRIu64"\n",
+	       sum.push_rx, sum.push_tx, sum.push_drop,
+	       sum.pop_rx, sum.pop_tx, sum.pop_drop);
+}
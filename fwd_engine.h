@@ -10,10 +10,127 @@
 #ifndef __FWD_ENGINE_H__
 #define __FWD_ENGINE_H__
 
+#include <rte_common.h>
+#include <rte_memzone.h>
+
 #include "common.h"
+#include "label_steer.h"
+#include "encap.h"
+#include "fec.h"
 
 
 #define MAX_PKT_BURST	32
+#define FWD_FRAG_MAX	16	/* fragments of an IPv4 packet over the MTU */
+#define FWD_GSO_MAX	64	/* software segments of a TSO frame */
+
+/*
+ * Control of a forwarding core by the main core. While paused, the core doesn't
+ * touch the ports, so they can be restarted or replaced (port events).
+ */
+struct fwd_ctl {
+	volatile uint32_t running;
+	volatile uint32_t pause_req;
+	volatile uint32_t paused;      /* acknowledges pause_req */
+};
+
+/*
+ * Liveness of a forwarding core, checked by the watchdog. The count is bumped on
+ * every loop iteration (not while paused), the burst sizes are those of the last
+ * non-empty bursts: [FWD_DIR_PUSH] received on the input port, [FWD_DIR_POP]
+ * on the output port (for a software RSS core, its RX queue).
+ */
+enum fwd_dir {
+	FWD_DIR_PUSH = 0,
+	FWD_DIR_POP,
+	FWD_NUM_DIRS,
+};
+
+/* Analytics mirror: directions of the mirrored frames (fwd_stream.mirror_dirs) */
+#define FWD_MIRROR_PUSH  (1u << FWD_DIR_PUSH)
+#define FWD_MIRROR_POP   (1u << FWD_DIR_POP)
+
+struct fwd_heartbeat {
+	volatile uint64_t count;
+	uint16_t last_rx[FWD_NUM_DIRS];
+	uint16_t last_tx[FWD_NUM_DIRS];
+};
+
+/*
+ * Graceful drain (fwd_engine_drain()): each core receives the frames which were
+ * in its RX queues when the drain started, then the frames passed between cores
+ * through rings, then the frames queued for the shared TX queues.
+ */
+enum fwd_drain_state {
+	FWD_DRAIN_NONE = 0,
+	FWD_DRAIN_RX,        /* receiving what was in the RX queues */
+	FWD_DRAIN_RINGS,     /* other cores may still pass frames to this one */
+	FWD_DRAIN_TX,        /* sending frames of the shared TX queue rings */
+	FWD_DRAIN_DONE,
+};
+
+/*
+ * Per stream packet counters (uint64_t only). Updated by the owning worker only.
+ * "push" is the direction input -> output port (label added),
+ * "pop" is the direction output -> input port (label removed).
+ */
+struct fwd_stream_stats {
+	uint64_t push_rx;
+	uint64_t push_tx;
+	uint64_t push_drop;
+
+	uint64_t pop_rx;
+	uint64_t pop_tx;
+	uint64_t pop_drop;
+
+	/* MPLS frames whose reverse direction is received by another core */
+	uint64_t rss_miss;
+
+	/* MPLS frames passed to another core by the software label steering */
+	uint64_t steer_redirect;
+	uint64_t steer_drop;
+
+	/* Shared TX queues: frames sent on behalf of other cores, and frames
+	 * dropped because the aggregation ring was full */
+	uint64_t tx_shared;
+	uint64_t tx_shared_drop;
+	uint64_t tx_ring_drop;
+
+	/* Reorder: the ring of the distributor is full */
+	uint64_t reorder_ring_drop;
+
+	/* Empty RX polls and TX bursts not sent completely: on a vring port the
+	 * peer doesn't fill / doesn't empty its ring fast enough */
+	uint64_t push_rx_empty;
+	uint64_t pop_rx_empty;
+	uint64_t push_tx_full;
+	uint64_t pop_tx_full;
+
+	/* Analytics mirror: references enqueued, and dropped as the ring was full */
+	uint64_t mirror_tx;
+	uint64_t mirror_drop;
+
+	/* SR-MPLS: frames which got the segment list of their FEC */
+	uint64_t fec_push;
+
+	/* MTU check: IPv4 packets fragmented, the fragments sent in their place
+	 * (not in push_rx), fragmentation failures; packets passed to the slow
+	 * path, and dropped as it's full or absent (or they aren't IP) */
+	uint64_t frag_pkts;
+	uint64_t frag_out;
+	uint64_t frag_fail;
+	uint64_t slow_tx;
+	uint64_t mtu_drop;
+
+	/* TSO: large TCP segments sent for the output port to segment them, those
+	 * segmented in software (and the segments), and dropped */
+	uint64_t tso_tx;
+	uint64_t gso_pkts;
+	uint64_t gso_segs;
+	uint64_t tso_drop;
+
+	/* Frames rejected by rte_eth_tx_prepare() (also in push_drop) */
+	uint64_t tx_prep_drop;
+};
 
 /*
  * Contains variables that are used in packet forwarding. Allocated for each worker.
@@ -23,17 +140,167 @@ struct fwd_stream {
 		portid_t  id;
 		queueid_t rx_queue_id;
 		queueid_t tx_queue_id;
+
+		uint16_t  reta_size;      /* 0 when RSS isn't enabled on the port */
+		uint16_t  nb_rx_queues;
+		uint16_t  vring;          /* a ring shared with a VM, container or kernel */
+		uint64_t  tx_offloads;    /* enabled on the port */
+
+		/* The port has fewer TX queues than cores: the queue is owned by one
+		 * core, which drains the aggregation ring (tx_drain_ring), other cores
+		 * enqueue frames to the ring (tx_ring) instead of calling TX. */
+		struct rte_ring *tx_ring;
+		struct rte_ring *tx_drain_ring;
+
+		/* Graceful drain: frames left in the RX queue when it started */
+		uint32_t drain;
+		uint32_t rx_left;
 	} input_port,
 	  output_port;
 
 	uint32_t mpls_label;
 	uint32_t mpls_ttl;
 
+	/* MPLS over UDP/GRE: outer header pushed with the label, and removed from
+	 * the frames of the output port (NULL for MPLS over Ethernet) */
+	struct encap_tmpl const *encap;
+
+	/* SR-MPLS: segment lists per destination (NULL: the label for all) */
+	struct fec_table const *fec;
+
+	/* MTU check (out_mtu 0 = disabled): the IP packets which won't fit in the
+	 * MTU of the output port once labelled are fragmented (IPv4, with indirect
+	 * mbufs of frag_indirect_pool), or passed to the slow path ring which
+	 * answers with an ICMP Packet Too Big (IPv6, IPv4 with DF set, or when the
+	 * port can't send chained mbufs). push_hdr_max is the longest header pushed,
+	 * only frames over out_mtu - push_hdr_max are looked at closer. */
+	uint16_t out_mtu;
+	uint16_t push_hdr_max;
+	struct rte_mempool *frag_direct_pool;
+	struct rte_mempool *frag_indirect_pool;
+	struct rte_ring *slow_ring;
+
+	/* TSO (tso != 0): large TCP segments received from a VM keep their offload
+	 * through the push, with the pushed header in l2_len. The output port
+	 * segments them, or rte_gso does (gso != NULL, TCP over IPv4 only). The
+	 * segment size is reduced to fit in tso_mtu once labelled. */
+	unsigned int tso;
+	uint16_t tso_mtu;
+	struct rte_gso_ctx const *gso;
+
 	unsigned print;
+	unsigned sym_rss;
+
+	/* rx_queue_id == QUEUEID_MAX: the core doesn't receive from the port */
+
+	/* MPLS frames handed over by other cores: distributors or label steering.
+	 * With output_port.rx_queue_id == QUEUEID_MAX it's the only source. */
+	struct rte_ring *pop_ring;
+
+	/* Software label steering (NULL if all rules are in the NIC) */
+	uint16_t stream_id;
+	struct label_steer_table const *steer;
+	struct rte_ring **steer_rings;       /* pop_ring of each stream */
+
+	/* Reorder: frames received from a distributor are returned to its ring
+	 * (indexed by the distributor id) instead of being sent */
+	struct rte_ring **reorder_rings;
+
+	/* Analytics mirror (NULL if disabled): a reference of each frame sent in
+	 * mirror_dirs with the top label in <mirror_first, mirror_last> is enqueued
+	 * to the ring, consumed by a secondary process. Only this core enqueues. */
+	struct rte_ring *mirror_ring;
+	unsigned int mirror_dirs;            /* FWD_MIRROR_* */
+	uint32_t mirror_first;
+	uint32_t mirror_last;
+
+	struct fwd_ctl ctl;
+	unsigned int drain_state;            /* enum fwd_drain_state */
+
+	struct fwd_stream_stats stats __rte_cache_aligned;
+	struct fwd_heartbeat hb;
+} __rte_cache_aligned;
+
+
+struct fwd_dist_stats {
+	uint64_t rx;
+	uint64_t enqueued;
+	uint64_t drop;       /* the ring of the target worker is full */
+
+	/* Reorder stage */
+	uint64_t ro_tx;      /* frames sent in order */
+	uint64_t ro_late;    /* arrived after the window moved on, sent as they are */
+	uint64_t ro_drop;    /* reorder buffer or TX queue full */
+	uint64_t ro_timeout; /* the buffer was flushed after a missing frame */
+	uint64_t ro_timeout_drop;
 };
 
+/*
+ * Software RSS: a distributor core receives MPLS frames from one RX queue of the
+ * output port, hashes the inner IP header and passes each frame to the worker
+ * which receives the reverse direction of the flow on the input port.
+ */
+struct fwd_dist {
+	portid_t  port_id;
+	queueid_t rx_queue_id;
+
+	unsigned hash_type;            /* enum flow_hash_type */
+	uint16_t reta_size;            /* of the input port, see flow_hash_to_queue() */
+	uint16_t n_queues;             /* RX queues of the input port */
+	uint16_t n_rings;              /* one ring per worker (stream) */
+	struct rte_ring **rings;
+
+	struct label_steer_table const *steer;  /* software label steering */
+	uint32_t rr_next;              /* FLOW_HASH_ROUND_ROBIN */
+	struct encap_tmpl const *encap;         /* outer header removed at RX */
+
+	struct fwd_dist_buf {
+		uint16_t n;
+		uint16_t room;             /* free entries of the ring (reorder) */
+		struct rte_mbuf *pkts[MAX_PKT_BURST];
+	} *bufs;
+
+	/* Reorder: frames are numbered at RX, the workers return them to ret_ring
+	 * once processed and the distributor sends them in order on the input port.
+	 * The reorder buffer is NULL when the stage is disabled. */
+	uint16_t dist_id;
+	struct rte_reorder_buffer *reorder;
+	char reorder_name[RTE_MEMZONE_NAMESIZE];
+	unsigned int reorder_size;
+	uint32_t seqn;                 /* next sequence number */
+	uint64_t reorder_held;         /* frames in the reorder buffer */
+	uint64_t reorder_timeout;      /* TSC cycles */
+	uint64_t reorder_last;         /* TSC of the last progress */
+	struct rte_ring *ret_ring;
+	portid_t  tx_port_id;
+	queueid_t tx_queue_id;
+
+	struct fwd_ctl ctl;
+	unsigned int drain_state;      /* enum fwd_drain_state */
+	uint32_t drain;
+	uint32_t rx_left;
+
+	struct fwd_dist_stats stats __rte_cache_aligned;
+	struct fwd_heartbeat hb;
+} __rte_cache_aligned;
+
 
 int fwd_worker_loop(void *arg);
 void fwd_engine_stop();
+unsigned int fwd_engine_cores_ready(void);
+void fwd_engine_drain(unsigned int timeout_ms);
+int fwd_engine_draining(void);
+uint64_t fwd_engine_drain_deadline(void);
+void fwd_engine_drain_print(void);
+int fwd_engine_pause(struct fwd_stream *strm, unsigned int n_stream,
+	struct fwd_dist *dist, unsigned int n_dist, unsigned int timeout_ms);
+void fwd_engine_resume(struct fwd_stream *strm, unsigned int n_stream,
+	struct fwd_dist *dist, unsigned int n_dist);
+void fwd_stream_stats_print(struct fwd_stream const *strm, unsigned int n_stream);
+void fwd_stream_stats_add(struct fwd_stream_stats *sum, struct fwd_stream_stats const *st);
+
+int fwd_reorder_init(void);
+int fwd_dist_loop(void *arg);
+void fwd_dist_stats_print(struct fwd_dist const *dist, unsigned int n_dist);
 
 #endif /* __FWD_ENGINE_H__ */
@@ -0,0 +1,297 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <rte_common.h>
+#include <rte_lcore.h>
+
+#include "handoff.h"
+
+
+/*
+ * Hitless restart: the running instance listens on a unix socket. A new instance
+ * connects and sends a request; the running one drains, closes its ports,
+ * releases the devices, sends its state and exits. The new one then probes
+ * the devices and starts forwarding.
+ */
+
+struct handoff_req {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;                /* sizeof(struct handoff_state) */
+};
+
+static struct {
+	int listen_fd;
+	int peer_fd;
+	volatile int requested;
+	void (*on_request)(void);
+} g_handoff = {
+	.listen_fd = -1,
+	.peer_fd = -1,
+};
+
+
+/* ************************************************************************** */
+
+static int
+handoff_write(int fd, void const *buf, size_t len)
+{
+	char const *p = buf;
+	ssize_t n;
+
+	while (len != 0) {
+		n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+
+static int
+handoff_read(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len != 0) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+
+static int
+handoff_addr(char const *path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "Error: handoff socket path '%s' is too long\n", path);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+
+/*
+ * Control thread: waits for the successor. Invalid requests are ignored, the
+ * first valid one is accepted and the thread exits. A successor which expects
+ * another layout of the state is refused before the ports are touched.
+ */
+static void*
+handoff_thread(void *arg)
+{
+	struct handoff_req req;
+	int fd;
+
+	RTE_SET_USED(arg);
+
+	for (;;) {
+		fd = accept(g_handoff.listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Handoff: accept() failed: %s\n", strerror(errno));
+			return NULL;
+		}
+
+		if (handoff_read(fd, &req, sizeof(req)) != 0 || req.magic != HANDOFF_MAGIC) {
+			fprintf(stderr, "Handoff: invalid request ignored\n");
+		} else if (req.version != HANDOFF_VERSION ||
+			   req.size != sizeof(struct handoff_state)) {
+			fprintf(stderr, "Handoff: request of an incompatible instance ignored "
+				"(version %u, state size %u, expected %u and %zu)\n",
+				req.version, req.size, HANDOFF_VERSION,
+				sizeof(struct handoff_state));
+		} else
+			break;
+
+		close(fd);
+	}
+
+	printf("Handoff: requested by a new instance, releasing the ports ...\n");
+	g_handoff.peer_fd = fd;
+	g_handoff.requested = 1;
+	g_handoff.on_request();
+
+	return NULL;
+}
+
+
+/*
+ * Listen for a successor on the unix socket 'path'. on_request() is called by
+ * the control thread when a successor asks for the ports.
+ */
+int
+handoff_listen(char const *path, void (*on_request)(void))
+{
+	struct sockaddr_un addr;
+	pthread_t tid;
+	int r;
+
+
+	if (path == NULL || on_request == NULL) {
+		fprintf(stderr, "Error: %s() invoked with invalid argument\n", __func__);
+		return -1;
+	}
+
+	if (handoff_addr(path, &addr) != 0)
+		return -1;
+
+	g_handoff.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (g_handoff.listen_fd < 0) {
+		fprintf(stderr, "Handoff: socket() failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* The socket of the predecessor (if any) is left over */
+	unlink(path);
+	if (bind(g_handoff.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(g_handoff.listen_fd, 1) != 0) {
+		fprintf(stderr, "Handoff: cannot listen on '%s': %s\n", path, strerror(errno));
+		goto __error;
+	}
+	g_handoff.on_request = on_request;
+
+	r = rte_ctrl_thread_create(&tid, "mplsfwd-handoff", NULL, handoff_thread, NULL);
+	if (r != 0) {
+		fprintf(stderr, "Handoff: cannot create control thread: %s\n", strerror(r));
+		goto __error;
+	}
+	pthread_detach(tid);
+
+	return 0;
+
+__error:
+	close(g_handoff.listen_fd);
+	g_handoff.listen_fd = -1;
+	return -1;
+}
+
+
+int
+handoff_requested(void)
+{
+	return g_handoff.requested;
+}
+
+
+/*
+ * Send the state to the successor. Must be called once the devices are released.
+ */
+int
+handoff_complete(struct handoff_state *state)
+{
+	int r;
+
+	if (g_handoff.requested == 0)
+		return -1;
+
+	state->magic = HANDOFF_MAGIC;
+	state->version = HANDOFF_VERSION;
+	state->size = sizeof(*state);
+
+	r = handoff_write(g_handoff.peer_fd, state, sizeof(*state));
+	if (r != 0)
+		fprintf(stderr, "Handoff: cannot send the state: %s\n", strerror(errno));
+	else
+		printf("Handoff: state sent, the new instance takes over\n");
+
+	close(g_handoff.peer_fd);
+	g_handoff.peer_fd = -1;
+	close(g_handoff.listen_fd);
+	g_handoff.listen_fd = -1;
+
+	return r;
+}
+
+
+/*
+ * Ask the instance listening on 'path' to release the ports, and wait for its
+ * state. Returns 0 when the state is received (the devices may be probed).
+ */
+int
+handoff_takeover(char const *path, struct handoff_state *state, unsigned int timeout_ms)
+{
+	struct handoff_req req = {
+		.magic = HANDOFF_MAGIC,
+		.version = HANDOFF_VERSION,
+		.size = sizeof(*state),
+	};
+	struct sockaddr_un addr;
+	struct timeval tv;
+	int fd, r = -1;
+
+
+	if (path == NULL || state == NULL) {
+		fprintf(stderr, "Error: %s() invoked with invalid argument\n", __func__);
+		return -1;
+	}
+
+	if (handoff_addr(path, &addr) != 0)
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fprintf(stderr, "Handoff: socket() failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		fprintf(stderr, "Handoff: cannot connect to '%s': %s\n", path, strerror(errno));
+		goto __exit;
+	}
+
+	if (handoff_write(fd, &req, sizeof(req)) != 0) {
+		fprintf(stderr, "Handoff: cannot send the request: %s\n", strerror(errno));
+		goto __exit;
+	}
+
+	if (handoff_read(fd, state, sizeof(*state)) != 0) {
+		fprintf(stderr, "Handoff: no state received from the running instance\n");
+		goto __exit;
+	}
+
+	if (state->magic != HANDOFF_MAGIC || state->version != HANDOFF_VERSION ||
+	    state->size != sizeof(*state) || state->n_steer_rules > LABEL_STEER_MAX_RULES) {
+		fprintf(stderr, "Handoff: incompatible state (version %u)\n", state->version);
+		goto __exit;
+	}
+
+	r = 0;
+
+__exit:
+	close(fd);
+	return r;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_HANDOFF_H__
+#define __INCLUDED_HANDOFF_H__
+
+#include <stdint.h>
+#include <rte_ethdev.h>
+
+#include "fwd_engine.h"
+#include "label_steer.h"
+
+
+#define HANDOFF_MAGIC       0x4d504c53   /* "MPLS" */
+#define HANDOFF_VERSION     2
+#define HANDOFF_DEVARGS_LEN 256
+#define HANDOFF_NUM_PORTS   2
+
+/*
+ * State passed by the running instance to its successor, once the ports are
+ * closed and the devices released.
+ */
+struct handoff_state {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;                /* sizeof(struct handoff_state) */
+	uint32_t generation;          /* number of handoffs so far */
+
+	/* Devices to probe, in the order of roles (ingress, egress) */
+	struct handoff_port {
+		char name[RTE_ETH_NAME_MAX_LEN];
+		char devargs[HANDOFF_DEVARGS_LEN];
+	} ports[HANDOFF_NUM_PORTS];
+
+	uint32_t mpls_label;
+	uint32_t mpls_ttl;
+	uint32_t n_steer_rules;
+	struct label_steer_rule steer_rules[LABEL_STEER_MAX_RULES];
+
+	/* Counters of all instances so far */
+	struct fwd_stream_stats totals;
+};
+
+
+int handoff_listen(char const *path, void (*on_request)(void));
+int handoff_requested(void);
+int handoff_complete(struct handoff_state *state);
+
+int handoff_takeover(char const *path, struct handoff_state *state,
+	unsigned int timeout_ms);
+
+#endif /* __INCLUDED_HANDOFF_H__ */
@@ -0,0 +1,472 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <rte_common.h>
+#include <rte_errno.h>
+#include <rte_cpuflags.h>
+#include <rte_vect.h>
+#if defined(RTE_ARCH_X86)
+#include <immintrin.h>
+#elif defined(RTE_ARCH_ARM64)
+#include <arm_neon.h>
+#endif
+
+#include "kernels.h"
+#include "flow_hash.h"
+
+
+/*
+ * Runtime dispatch of the data-path kernels: the binary is built for the
+ * baseline of the architecture, the kernels are also built for the newer
+ * instruction sets and the variant matching the CPU is chosen at startup.
+ * The kernels work on a burst, so there is one indirect call per burst.
+ *
+ * push, pop and hash are the same C code built for each target. classify
+ * compares the label with several ranges of the steering table at once.
+ * 512-bit registers bring nothing to the header moves of push and pop (and
+ * may lower the clock of the core), so only classify has an AVX-512 variant.
+ */
+
+#if defined(RTE_ARCH_X86)
+#define KERNELS_TARGET_SSE42   __attribute__((target("sse4.2")))
+#define KERNELS_TARGET_AVX2    __attribute__((target("avx2")))
+#define KERNELS_TARGET_AVX512  __attribute__((target("avx512f")))
+#endif
+
+static char const * const isa_names[KERNELS_ISA_MAX] = {
+	[KERNELS_ISA_AUTO] = "auto",
+	[KERNELS_ISA_SCALAR] = "scalar",
+	[KERNELS_ISA_SSE42] = "sse4.2",
+	[KERNELS_ISA_AVX2] = "avx2",
+	[KERNELS_ISA_AVX512] = "avx512",
+	[KERNELS_ISA_NEON] = "neon",
+};
+
+
+/*
+ * Generic bodies, inlined in each variant so they are built for its target.
+ */
+
+static __rte_always_inline void
+kernels_push_burst(struct rte_mbuf **pkts, unsigned int n_pkts, mpls_header_t header)
+{
+	unsigned int n;
+	int r;
+
+	for (n = 0; n < n_pkts; n++) {
+		r = mpls_header_insert(pkts[n], header);
+		if (r < 0) {
+			fprintf(stderr, "Unable to add header to mbuf %u: %s\n",
+				n, rte_strerror(-r));
+		}
+	}
+}
+
+
+static __rte_always_inline void
+kernels_pop_burst(struct rte_mbuf **pkts, unsigned int n_pkts)
+{
+	unsigned int n;
+	int r;
+	uint16_t etype;
+
+	for (n = 0; n < n_pkts; n++) {
+		etype = mpls_deduce_ethertype(pkts[n]);
+		if (unlikely(etype == 0))
+			continue; /* Ignore unknown packet type */
+
+		r = mpls_header_strip(pkts[n], etype);
+		if (r < 0) {
+			fprintf(stderr, "Unable to remove mpls header in mbuf %u/%u\n",
+				n, n_pkts);
+		}
+	}
+}
+
+
+static __rte_always_inline void
+kernels_hash_burst(struct rte_mbuf **pkts, unsigned int n_pkts, unsigned int type)
+{
+	struct rte_mbuf *m;
+	unsigned int n;
+
+	for (n = 0; n < n_pkts; n++) {
+		m = pkts[n];
+		m->hash.rss = (type == FLOW_HASH_CRC) ? flow_hash_sym_crc(m) :
+			flow_hash_sym(m);
+		m->ol_flags |= RTE_MBUF_F_RX_RSS_HASH;
+	}
+}
+
+
+/*
+ * Top label of the frame, -1 when the frame isn't labelled.
+ */
+static __rte_always_inline int32_t
+kernels_top_label(struct rte_mbuf *m)
+{
+	struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+
+	if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS) ||
+	    unlikely(rte_pktmbuf_data_len(m) < RTE_ETHER_HDR_LEN + MPLS_HDR_LEN))
+		return -1;
+
+	return (int32_t)mpls_get_label(rte_be_to_cpu_32(*(mpls_header_t *)(eth + 1)));
+}
+
+
+#define KERNELS_DEFINE(sfx, target) \
+static target void \
+kernels_push_##sfx(struct rte_mbuf **pkts, unsigned int n_pkts, mpls_header_t header) \
+{ \
+	kernels_push_burst(pkts, n_pkts, header); \
+} \
+\
+static target void \
+kernels_pop_##sfx(struct rte_mbuf **pkts, unsigned int n_pkts) \
+{ \
+	kernels_pop_burst(pkts, n_pkts); \
+} \
+\
+static target void \
+kernels_hash_##sfx(struct rte_mbuf **pkts, unsigned int n_pkts, unsigned int type) \
+{ \
+	kernels_hash_burst(pkts, n_pkts, type); \
+}
+
+KERNELS_DEFINE(scalar, )
+#if defined(RTE_ARCH_X86)
+KERNELS_DEFINE(sse42, KERNELS_TARGET_SSE42)
+KERNELS_DEFINE(avx2, KERNELS_TARGET_AVX2)
+#endif
+
+
+/*
+ * classify: binary search of the sorted ranges.
+ */
+static void
+kernels_classify_scalar(struct label_steer_table const *t, struct rte_mbuf **pkts,
+	unsigned int n_pkts, int *queues)
+{
+	unsigned int n;
+
+	for (n = 0; n < n_pkts; n++)
+		queues[n] = label_steer_lookup(t, pkts[n]);
+}
+
+
+/*
+ * classify: the label is compared with the ranges of 4, 8 or 16 rules at once.
+ * The table holds at most LABEL_STEER_MAX_RULES rules, so a linear scan beats
+ * the binary search, and the entries past n_rules never match.
+ */
+#if defined(RTE_ARCH_X86)
+static KERNELS_TARGET_SSE42 void
+kernels_classify_sse42(struct label_steer_table const *t, struct rte_mbuf **pkts,
+	unsigned int n_pkts, int *queues)
+{
+	__m128i label, first, last, miss;
+	unsigned int n, i;
+	uint32_t hit;
+	int32_t l;
+
+	for (n = 0; n < n_pkts; n++) {
+		queues[n] = -1;
+		l = kernels_top_label(pkts[n]);
+		if (l < 0)
+			continue;
+
+		label = _mm_set1_epi32(l);
+		for (i = 0; i < t->n_rules; i += 4) {
+			first = _mm_loadu_si128((__m128i const *)&t->first[i]);
+			last = _mm_loadu_si128((__m128i const *)&t->last[i]);
+			miss = _mm_or_si128(_mm_cmpgt_epi32(first, label),
+				_mm_cmpgt_epi32(label, last));
+			hit = ~(uint32_t)_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xf;
+			if (hit != 0) {
+				queues[n] = t->rules[i + rte_bsf32(hit)].queue;
+				break;
+			}
+		}
+	}
+}
+
+
+static KERNELS_TARGET_AVX2 void
+kernels_classify_avx2(struct label_steer_table const *t, struct rte_mbuf **pkts,
+	unsigned int n_pkts, int *queues)
+{
+	__m256i label, first, last, miss;
+	unsigned int n, i;
+	uint32_t hit;
+	int32_t l;
+
+	for (n = 0; n < n_pkts; n++) {
+		queues[n] = -1;
+		l = kernels_top_label(pkts[n]);
+		if (l < 0)
+			continue;
+
+		label = _mm256_set1_epi32(l);
+		for (i = 0; i < t->n_rules; i += 8) {
+			first = _mm256_loadu_si256((__m256i const *)&t->first[i]);
+			last = _mm256_loadu_si256((__m256i const *)&t->last[i]);
+			miss = _mm256_or_si256(_mm256_cmpgt_epi32(first, label),
+				_mm256_cmpgt_epi32(label, last));
+			hit = ~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xff;
+			if (hit != 0) {
+				queues[n] = t->rules[i + rte_bsf32(hit)].queue;
+				break;
+			}
+		}
+	}
+}
+
+
+static KERNELS_TARGET_AVX512 void
+kernels_classify_avx512(struct label_steer_table const *t, struct rte_mbuf **pkts,
+	unsigned int n_pkts, int *queues)
+{
+	__m512i label, first, last;
+	unsigned int n, i;
+	__mmask16 hit;
+	int32_t l;
+
+	for (n = 0; n < n_pkts; n++) {
+		queues[n] = -1;
+		l = kernels_top_label(pkts[n]);
+		if (l < 0)
+			continue;
+
+		label = _mm512_set1_epi32(l);
+		for (i = 0; i < t->n_rules; i += 16) {
+			first = _mm512_loadu_si512(&t->first[i]);
+			last = _mm512_loadu_si512(&t->last[i]);
+			hit = _mm512_mask_cmple_epi32_mask(_mm512_cmple_epi32_mask(first, label),
+				label, last);
+			if (hit != 0) {
+				queues[n] = t->rules[i + rte_bsf32(hit)].queue;
+				break;
+			}
+		}
+	}
+}
+#endif /* RTE_ARCH_X86 */
+
+#if defined(RTE_ARCH_ARM64)
+static void
+kernels_classify_neon(struct label_steer_table const *t, struct rte_mbuf **pkts,
+	unsigned int n_pkts, int *queues)
+{
+	uint32x4_t label, first, last, hit;
+	unsigned int n, i;
+	uint64_t bits;
+	int32_t l;
+
+	for (n = 0; n < n_pkts; n++) {
+		queues[n] = -1;
+		l = kernels_top_label(pkts[n]);
+		if (l < 0)
+			continue;
+
+		label = vdupq_n_u32((uint32_t)l);
+		for (i = 0; i < t->n_rules; i += 4) {
+			first = vld1q_u32(&t->first[i]);
+			last = vld1q_u32(&t->last[i]);
+			hit = vandq_u32(vcleq_u32(first, label), vcleq_u32(label, last));
+			/* 16 bits per lane once narrowed */
+			bits = vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(hit)), 0);
+			if (bits != 0) {
+				queues[n] = t->rules[i + rte_bsf64(bits) / 16].queue;
+				break;
+			}
+		}
+	}
+}
+#endif /* RTE_ARCH_ARM64 */
+
+
+/*
+ * Variants of each kernel, in ISA order.
+ */
+static const struct {
+	unsigned int isa;
+	kernels_push_t fn;
+} push_variants[] = {
+	{ KERNELS_ISA_SCALAR, kernels_push_scalar },
+#if defined(RTE_ARCH_X86)
+	{ KERNELS_ISA_SSE42, kernels_push_sse42 },
+	{ KERNELS_ISA_AVX2, kernels_push_avx2 },
+#endif
+};
+
+static const struct {
+	unsigned int isa;
+	kernels_pop_t fn;
+} pop_variants[] = {
+	{ KERNELS_ISA_SCALAR, kernels_pop_scalar },
+#if defined(RTE_ARCH_X86)
+	{ KERNELS_ISA_SSE42, kernels_pop_sse42 },
+	{ KERNELS_ISA_AVX2, kernels_pop_avx2 },
+#endif
+};
+
+static const struct {
+	unsigned int isa;
+	kernels_classify_t fn;
+} classify_variants[] = {
+	{ KERNELS_ISA_SCALAR, kernels_classify_scalar },
+#if defined(RTE_ARCH_X86)
+	{ KERNELS_ISA_SSE42, kernels_classify_sse42 },
+	{ KERNELS_ISA_AVX2, kernels_classify_avx2 },
+	{ KERNELS_ISA_AVX512, kernels_classify_avx512 },
+#elif defined(RTE_ARCH_ARM64)
+	{ KERNELS_ISA_NEON, kernels_classify_neon },
+#endif
+};
+
+static const struct {
+	unsigned int isa;
+	kernels_hash_t fn;
+} hash_variants[] = {
+	{ KERNELS_ISA_SCALAR, kernels_hash_scalar },
+#if defined(RTE_ARCH_X86)
+	{ KERNELS_ISA_SSE42, kernels_hash_sse42 },
+	{ KERNELS_ISA_AVX2, kernels_hash_avx2 },
+#endif
+};
+
+/* The last variant built for an ISA up to 'max' */
+#define KERNELS_PICK(variants, max, kernel, kernel_isa) do { \
+	unsigned int __v; \
+	for (__v = 0; __v < RTE_DIM(variants); __v++) { \
+		if (variants[__v].isa <= (max)) { \
+			(kernel) = variants[__v].fn; \
+			(kernel_isa) = variants[__v].isa; \
+		} \
+	} \
+} while (0)
+
+
+struct kernels g_kernels = {
+	.push = kernels_push_scalar,
+	.pop = kernels_pop_scalar,
+	.classify = kernels_classify_scalar,
+	.hash = kernels_hash_scalar,
+	.push_isa = KERNELS_ISA_SCALAR,
+	.pop_isa = KERNELS_ISA_SCALAR,
+	.classify_isa = KERNELS_ISA_SCALAR,
+	.hash_isa = KERNELS_ISA_SCALAR,
+};
+
+
+int
+kernels_isa_parse(char const *arg)
+{
+	unsigned int isa;
+
+	for (isa = 0; isa < KERNELS_ISA_MAX; isa++) {
+		if (!strcmp(arg, isa_names[isa]))
+			return (int)isa;
+	}
+
+	return -1;
+}
+
+
+char const *
+kernels_isa_name(unsigned int isa)
+{
+	return isa < KERNELS_ISA_MAX ? isa_names[isa] : "unknown";
+}
+
+
+static int
+kernels_isa_supported(unsigned int isa)
+{
+	switch (isa) {
+	case KERNELS_ISA_SCALAR:
+		return 1;
+#if defined(RTE_ARCH_X86)
+	case KERNELS_ISA_SSE42:
+		return rte_cpu_get_flag_enabled(RTE_CPUFLAG_SSE4_2) > 0;
+	case KERNELS_ISA_AVX2:
+		return rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) > 0;
+	case KERNELS_ISA_AVX512:
+		return rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F) > 0;
+#elif defined(RTE_ARCH_ARM64)
+	case KERNELS_ISA_NEON:
+		return rte_cpu_get_flag_enabled(RTE_CPUFLAG_NEON) > 0;
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+static unsigned int
+kernels_isa_width(unsigned int isa)
+{
+	switch (isa) {
+	case KERNELS_ISA_SSE42:
+	case KERNELS_ISA_NEON:
+		return RTE_VECT_SIMD_128;
+	case KERNELS_ISA_AVX2:
+		return RTE_VECT_SIMD_256;
+	case KERNELS_ISA_AVX512:
+		return RTE_VECT_SIMD_512;
+	default:
+		return 0;
+	}
+}
+
+
+/*
+ * Choose the variants of the kernels: the best ones built for 'isa', or for
+ * the CPU with KERNELS_ISA_AUTO. The automatic choice also respects the EAL
+ * limit of the SIMD width (--force-max-simd-bitwidth), which keeps AVX-512 off
+ * by default like in the DPDK libraries.
+ */
+int
+kernels_select(unsigned int isa)
+{
+	unsigned int max_width, n;
+
+	if (isa == KERNELS_ISA_AUTO) {
+		max_width = rte_vect_get_max_simd_bitwidth();
+		isa = KERNELS_ISA_SCALAR;
+		for (n = KERNELS_ISA_SCALAR + 1; n < KERNELS_ISA_MAX; n++) {
+			if (kernels_isa_supported(n) && kernels_isa_width(n) <= max_width)
+				isa = n;
+		}
+	} else if (isa >= KERNELS_ISA_MAX || !kernels_isa_supported(isa)) {
+		fprintf(stderr, "Error: the %s kernels are not supported by this CPU\n",
+			kernels_isa_name(isa));
+		return -1;
+	}
+
+	KERNELS_PICK(push_variants, isa, g_kernels.push, g_kernels.push_isa);
+	KERNELS_PICK(pop_variants, isa, g_kernels.pop, g_kernels.pop_isa);
+	KERNELS_PICK(classify_variants, isa, g_kernels.classify, g_kernels.classify_isa);
+	KERNELS_PICK(hash_variants, isa, g_kernels.hash, g_kernels.hash_isa);
+
+	return 0;
+}
+
+
+void
+kernels_print(void)
+{
+	printf("Data-path kernels: push %s, pop %s, classify %s, hash %s\n",
+		kernels_isa_name(g_kernels.push_isa), kernels_isa_name(g_kernels.pop_isa),
+		kernels_isa_name(g_kernels.classify_isa), kernels_isa_name(g_kernels.hash_isa));
+}
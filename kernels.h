@@ -0,0 +1,182 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_KERNELS_H__
+#define __INCLUDED_KERNELS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+
+#include "mpls.h"
+#include "label_steer.h"
+
+
+/*
+ * Instruction sets the data-path kernels are built for, in increasing order
+ * on each architecture. The binary holds all the variants of its architecture,
+ * one is chosen at startup.
+ */
+enum kernels_isa {
+	KERNELS_ISA_AUTO = 0,     /* the best one of the CPU */
+	KERNELS_ISA_SCALAR,
+	KERNELS_ISA_SSE42,
+	KERNELS_ISA_AVX2,
+	KERNELS_ISA_AVX512,
+	KERNELS_ISA_NEON,
+	KERNELS_ISA_MAX,
+};
+
+typedef void (*kernels_push_t)(struct rte_mbuf **pkts, unsigned int n_pkts,
+	mpls_header_t header);
+typedef void (*kernels_pop_t)(struct rte_mbuf **pkts, unsigned int n_pkts);
+typedef void (*kernels_classify_t)(struct label_steer_table const *t,
+	struct rte_mbuf **pkts, unsigned int n_pkts, int *queues);
+typedef void (*kernels_hash_t)(struct rte_mbuf **pkts, unsigned int n_pkts,
+	unsigned int type);
+
+/*
+ * Burst kernels of the data path:
+ *   push:     insert the label after the Ethernet header
+ *   pop:      remove the top label
+ *   classify: queue of the top label in the software steering table, -1 if none
+ *   hash:     symmetric hash (enum flow_hash_type) of the inner IP header,
+ *             stored in hash.rss
+ * Set by kernels_select() before the cores are started, read-only afterwards.
+ */
+struct kernels {
+	kernels_push_t push;
+	kernels_pop_t pop;
+	kernels_classify_t classify;
+	kernels_hash_t hash;
+
+	/* enum kernels_isa of the variant of each kernel */
+	unsigned int push_isa;
+	unsigned int pop_isa;
+	unsigned int classify_isa;
+	unsigned int hash_isa;
+} __rte_cache_aligned;
+
+extern struct kernels g_kernels;
+
+
+int kernels_isa_parse(char const *arg);
+char const *kernels_isa_name(unsigned int isa);
+int kernels_select(unsigned int isa);
+void kernels_print(void);
+
+
+/*
+ * return
+ *   0: On success
+ *   -ENOSPC: invalid argument
+ *
+ * NOTE: VLAN support is not implemented
+ *       MPLS labels stack (BoS) is not implemented
+ */
+static inline int
+mpls_header_strip(struct rte_mbuf *pktmb, uint16_t ethertype)
+{
+	struct rte_ether_hdr *eth
+		 = rte_pktmbuf_mtod(pktmb, struct rte_ether_hdr *);
+
+	if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS))
+		return 0;
+
+	eth = (struct rte_ether_hdr *)rte_pktmbuf_adj(pktmb, sizeof(mpls_header_t));
+	if (unlikely(eth == NULL))
+		return -ENOSPC;
+
+	memmove(eth, (uint8_t *)eth - sizeof(mpls_header_t), RTE_ETHER_HDR_LEN);
+	eth->ether_type = rte_cpu_to_be_16(ethertype);
+
+	return 0;
+}
+
+
+#define IPVERSION_SHIFT 4
+#define IPVERSION_MASK  0xf0
+#define IP4_VERSION     0x40
+#define IP6_VERSION     0x60
+
+static inline uint16_t
+mpls_deduce_ethertype(struct rte_mbuf *pmb)
+{
+	struct rte_ether_hdr *e = rte_pktmbuf_mtod(pmb, struct rte_ether_hdr *);
+	uint8_t *p = (uint8_t *)(e + 1);
+
+	if (e->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS))
+		p += sizeof(mpls_header_t);
+
+	switch(*p & IPVERSION_MASK) {
+	case IP4_VERSION:
+		return RTE_ETHER_TYPE_IPV4;
+	case IP6_VERSION:
+		return RTE_ETHER_TYPE_IPV6;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+
+/*
+ * return
+ *   0: On success
+ *   -EINVAL: invalid argument - operation would be unsafe
+ *   -ENOSPC: not enough headroom in mbuf
+ *
+ * NOTE:
+ *      VLAN processing is not supported (RTE_ETHER_TYPE_VLAN)
+ *      MPLS labels stack (BoS) processing is not support
+ */
+static inline int
+mpls_header_insert(struct rte_mbuf *pktmb, mpls_header_t mpls_hdr)
+{
+	struct rte_ether_hdr *new;
+	mpls_header_t *mpls;
+
+	/* Can't insert header if mbuf is shared */
+	if (!RTE_MBUF_DIRECT(pktmb) || rte_mbuf_refcnt_read(pktmb) > 1)
+		return -EINVAL;
+
+	/* the first segment is too short (the first segment of an IPv4 fragment
+	 * holds the Ethernet and IP headers only) */
+	if (rte_pktmbuf_data_len(pktmb) < RTE_ETHER_HDR_LEN) {
+		fprintf(stderr,
+		       "Insufficient buffer size: datalen=%hu, pktlen=%u, buflen=%hu, "
+		       "refcnt=%hu, segments=%hu\n",
+		       pktmb->data_len, pktmb->pkt_len, pktmb->buf_len, pktmb->refcnt,
+		       pktmb->nb_segs);
+		return -ENOSPC;
+	}
+
+	new = (struct rte_ether_hdr *)rte_pktmbuf_prepend(pktmb, sizeof(mpls_header_t));
+	if (new == NULL)
+		return -ENOSPC;
+
+	memmove(new, (uint8_t *)new + sizeof(mpls_header_t), RTE_ETHER_HDR_LEN);
+	new->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS);
+	mpls = (mpls_header_t *)(new + 1);
+	*mpls = rte_cpu_to_be_32(mpls_hdr);
+
+	/* TX offloads (TSO) see the label as part of the L2 header */
+	if (pktmb->ol_flags & RTE_MBUF_F_TX_OFFLOAD_MASK)
+		pktmb->l2_len += sizeof(mpls_header_t);
+
+	return 0;
+}
+
+#endif /* __INCLUDED_KERNELS_H__ */
@@ -0,0 +1,363 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <rte_ethdev.h>
+#include <rte_flow.h>
+
+#include "label_steer.h"
+#include "mpls.h"
+
+
+
+/* A label range is split into prefix blocks (value/mask); 20-bit label gives
+ * at most 2 * 20 - 2 blocks. */
+#define LABEL_STEER_MAX_FLOWS  40
+
+#define STEER_REASON_LEN       80
+
+static struct steer_state {
+	portid_t port_id;
+	unsigned int n_rules;
+
+	struct steer_rule_state {
+		struct label_steer_rule rule;
+		unsigned int hw;            /* all blocks of the range are in the NIC */
+		unsigned int counted;       /* flows were created with the COUNT action */
+		unsigned int lost;          /* rejected when re-installed, not steered */
+		unsigned int n_flows;
+		struct rte_flow *flows[LABEL_STEER_MAX_FLOWS];
+		char reason[STEER_REASON_LEN];
+	} rules[LABEL_STEER_MAX_RULES];
+} g_steer = {
+	.port_id = PORTID_MAX,
+};
+
+
+/* ************************************************************************** */
+
+/*
+ * Add a rule to the array which is kept sorted by label. Overlapping ranges are
+ * rejected, since a frame could not be steered to two queues.
+ * Returns 0 on success, -EEXIST on overlap and -ENOSPC when the array is full.
+ */
+int
+label_steer_rule_add(struct label_steer_rule *rules, unsigned int *n_rules,
+	struct label_steer_rule const *rule)
+{
+	unsigned int x;
+
+	for (x = 0; x < *n_rules; x++) {
+		if (rule->last < rules[x].first)
+			break;
+		if (rule->first <= rules[x].last)
+			return -EEXIST;
+	}
+
+	if (*n_rules >= LABEL_STEER_MAX_RULES)
+		return -ENOSPC;
+
+	memmove(&rules[x + 1], &rules[x], (*n_rules - x) * sizeof(*rules));
+	rules[x] = *rule;
+	(*n_rules)++;
+
+	return 0;
+}
+
+
+static inline void
+mpls_label_to_item(uint32_t label, uint8_t label_tc_s[3])
+{
+	label_tc_s[0] = (uint8_t)(label >> 12);
+	label_tc_s[1] = (uint8_t)(label >> 4);
+	label_tc_s[2] = (uint8_t)(label << 4);
+}
+
+
+/*
+ * Validate and create one flow rule: MPLS label/mask -> queue. With count != 0
+ * the COUNT action is requested too, so per rule hits can be reported.
+ */
+static struct rte_flow*
+steer_flow_create(portid_t port_id, uint32_t label, uint32_t mask, uint16_t queue,
+	unsigned int count, struct rte_flow_error *err)
+{
+	struct rte_flow_attr attr = { .ingress = 1 };
+	struct rte_flow_item_mpls mpls_spec, mpls_mask;
+	struct rte_flow_action_queue act_queue = { .index = queue };
+	struct rte_flow_action_count act_count = { .id = 0 };
+	struct rte_flow_item pattern[] = {
+		{ .type = RTE_FLOW_ITEM_TYPE_ETH },
+		{ .type = RTE_FLOW_ITEM_TYPE_MPLS, .spec = &mpls_spec, .mask = &mpls_mask },
+		{ .type = RTE_FLOW_ITEM_TYPE_END },
+	};
+	struct rte_flow_action actions[] = {
+		{ .type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &act_queue },
+		{ .type = RTE_FLOW_ACTION_TYPE_COUNT, .conf = &act_count },
+		{ .type = RTE_FLOW_ACTION_TYPE_END },
+	};
+	int r;
+
+	if (count == 0)
+		actions[1].type = RTE_FLOW_ACTION_TYPE_VOID;
+
+	memset(&mpls_spec, 0, sizeof(mpls_spec));
+	memset(&mpls_mask, 0, sizeof(mpls_mask));
+	mpls_label_to_item(label, mpls_spec.label_tc_s);
+	mpls_label_to_item(mask, mpls_mask.label_tc_s);
+
+	memset(err, 0, sizeof(*err));
+	r = rte_flow_validate(port_id, &attr, pattern, actions, err);
+	if (r != 0)
+		return NULL;
+
+	return rte_flow_create(port_id, &attr, pattern, actions, err);
+}
+
+
+static void
+steer_rule_destroy_flows(struct steer_rule_state *st)
+{
+	struct rte_flow_error err;
+	unsigned int f;
+
+	for (f = 0; f < st->n_flows; f++) {
+		if (rte_flow_destroy(g_steer.port_id, st->flows[f], &err) != 0)
+			fprintf(stderr, "Warning: cannot destroy flow rule of labels %u-%u: %s\n",
+				st->rule.first, st->rule.last,
+				err.message ? err.message : "(no stated reason)");
+	}
+	st->n_flows = 0;
+	st->hw = 0;
+}
+
+
+/*
+ * Install a label range in the NIC, one flow rule per prefix block. The range is
+ * installed entirely or not at all.
+ */
+static int
+steer_rule_install(struct steer_rule_state *st)
+{
+	struct rte_flow_error err;
+	struct rte_flow *flow;
+	uint32_t first, size;
+
+
+	st->counted = 1;
+	first = st->rule.first;
+	while (first <= st->rule.last) {
+		/* the biggest aligned block starting at 'first' within the range */
+		size = first ? (first & -first) : (MPLS_HDR_LABEL_MASK + 1);
+		while (first + size - 1 > st->rule.last)
+			size >>= 1;
+
+		if (st->n_flows >= LABEL_STEER_MAX_FLOWS)
+			break;
+
+		flow = steer_flow_create(g_steer.port_id, first,
+			MPLS_HDR_LABEL_MASK & ~(size - 1), st->rule.queue, st->counted, &err);
+		if (flow == NULL && st->counted && st->n_flows == 0) {
+			/* The NIC may not support counters: try without them */
+			st->counted = 0;
+			flow = steer_flow_create(g_steer.port_id, first,
+				MPLS_HDR_LABEL_MASK & ~(size - 1), st->rule.queue, 0, &err);
+		}
+		if (flow == NULL) {
+			snprintf(st->reason, sizeof(st->reason), "%s",
+				err.message ? err.message : "flow rule rejected by the driver");
+			steer_rule_destroy_flows(st);
+			return -1;
+		}
+
+		st->flows[st->n_flows++] = flow;
+		first += size;
+	}
+
+	if (first <= st->rule.last) {
+		snprintf(st->reason, sizeof(st->reason), "too many flow rules");
+		steer_rule_destroy_flows(st);
+		return -1;
+	}
+
+	st->hw = 1;
+	return 0;
+}
+
+
+/*
+ * Install the label steering rules on the (MPLS) port. Rules are steered by the
+ * NIC when rte_flow accepts them, otherwise (or when sw_only_reason is given)
+ * they are added to sw_table and redistributed in software.
+ * Returns the number of rules installed in the NIC, -1 on error.
+ */
+int
+label_steer_install(portid_t port_id, struct label_steer_rule const *rules,
+	unsigned int n_rules, char const *sw_only_reason, struct label_steer_table *sw_table)
+{
+	struct steer_rule_state *st;
+	unsigned int i, n_hw;
+
+
+	if (rules == NULL || sw_table == NULL || n_rules > LABEL_STEER_MAX_RULES) {
+		fprintf(stderr, "Error: %s() invoked with invalid argument\n", __func__);
+		return -1;
+	}
+
+	memset(sw_table, 0, sizeof(*sw_table));
+	g_steer.port_id = port_id;
+	g_steer.n_rules = n_rules;
+
+	n_hw = 0;
+	for (i = 0; i < n_rules; i++) {
+		st = &g_steer.rules[i];
+		memset(st, 0, sizeof(*st));
+		st->rule = rules[i];
+
+		if (sw_only_reason != NULL)
+			snprintf(st->reason, sizeof(st->reason), "%s", sw_only_reason);
+		else if (steer_rule_install(st) == 0) {
+			n_hw++;
+			continue;
+		}
+
+		/* Rules are sorted, so the software table is sorted too */
+		sw_table->rules[sw_table->n_rules++] = rules[i];
+	}
+
+	for (i = 0; i < LABEL_STEER_MAX_RULES; i++) {
+		if (i < sw_table->n_rules) {
+			sw_table->first[i] = sw_table->rules[i].first;
+			sw_table->last[i] = sw_table->rules[i].last;
+		} else {
+			sw_table->first[i] = 1;
+			sw_table->last[i] = 0;
+		}
+	}
+
+	return (int)n_hw;
+}
+
+
+/*
+ * Remove all flow rules from the NIC (must be done before the port is closed).
+ */
+void
+label_steer_remove(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < g_steer.n_rules; i++)
+		steer_rule_destroy_flows(&g_steer.rules[i]);
+	g_steer.n_rules = 0;
+}
+
+
+/*
+ * Remove the flow rules from the NIC, but remember which rules were installed
+ * there, so they can be re-installed by label_steer_resume() after the port
+ * is reset or replaced.
+ */
+void
+label_steer_suspend(void)
+{
+	struct steer_rule_state *st;
+	unsigned int i;
+
+	for (i = 0; i < g_steer.n_rules; i++) {
+		st = &g_steer.rules[i];
+		if (st->hw == 0)
+			continue;
+		steer_rule_destroy_flows(st);
+		st->hw = 1;
+	}
+}
+
+
+/*
+ * Re-install the rules which were in the NIC before label_steer_suspend(), on the
+ * port which may have a new id. Rules rejected now are not steered at all (the
+ * software table is used by running cores and isn't changed).
+ * Returns the number of rules lost.
+ */
+int
+label_steer_resume(portid_t port_id)
+{
+	struct steer_rule_state *st;
+	unsigned int i;
+	int n_lost = 0;
+
+	g_steer.port_id = port_id;
+	for (i = 0; i < g_steer.n_rules; i++) {
+		st = &g_steer.rules[i];
+		if (st->hw == 0)
+			continue;
+		if (steer_rule_install(st) != 0) {
+			st->lost = 1;
+			fprintf(stderr, "Warning: labels %u-%u are not steered any more: %s\n",
+				st->rule.first, st->rule.last, st->reason);
+			n_lost++;
+		}
+	}
+
+	return n_lost;
+}
+
+
+/*
+ * Print the steering decision for every rule, with the NIC counters when
+ * available.
+ */
+void
+label_steer_print(void)
+{
+	struct rte_flow_action action = { .type = RTE_FLOW_ACTION_TYPE_COUNT };
+	struct rte_flow_query_count qc;
+	struct rte_flow_error err;
+	struct steer_rule_state *st;
+	unsigned int i, f;
+	uint64_t hits;
+
+
+	if (g_steer.n_rules == 0)
+		return;
+
+	printf("Label steering (port %hu):\n", g_steer.port_id);
+	for (i = 0; i < g_steer.n_rules; i++) {
+		st = &g_steer.rules[i];
+
+		printf("  labels %u-%u -> queue %hu: ", st->rule.first, st->rule.last,
+			st->rule.queue);
+		if (st->lost) {
+			printf("not steered (%s)\n", st->reason);
+			continue;
+		}
+		if (st->hw == 0) {
+			printf("software (%s)\n", st->reason);
+			continue;
+		}
+
+		printf("NIC, %u flow rule(s)", st->n_flows);
+		if (st->counted) {
+			hits = 0;
+			for (f = 0; f < st->n_flows; f++) {
+				memset(&qc, 0, sizeof(qc));
+				if (rte_flow_query(g_steer.port_id, st->flows[f], &action, &qc,
+				    &err) == 0 && qc.hits_set)
+					hits += qc.hits;
+			}
+			printf(", hits=%"PRIu64, hits);
+		}
+		printf("\n");
+	}
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_LABEL_STEER_H__
+#define __INCLUDED_LABEL_STEER_H__
+
+#include <stdint.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+
+#include "common.h"
+#include "mpls.h"
+
+
+#define LABEL_STEER_MAX_RULES 64
+
+/*
+ * Frames whose top label is in the range <first, last> are received by the core
+ * which owns RX queue 'queue' (the n-th core of the core list).
+ */
+struct label_steer_rule {
+	uint32_t first;
+	uint32_t last;
+	uint16_t queue;
+};
+
+/*
+ * Rules which could not be installed in the NIC. Sorted by label, the ranges
+ * don't overlap. Read-only once the workers are started.
+ */
+struct label_steer_table {
+	unsigned int n_rules;
+	struct label_steer_rule rules[LABEL_STEER_MAX_RULES];
+
+	/* The ranges again, as vectors for the SIMD lookup. The entries past
+	 * n_rules hold an empty range. */
+	uint32_t first[LABEL_STEER_MAX_RULES] __rte_cache_aligned;
+	uint32_t last[LABEL_STEER_MAX_RULES];
+};
+
+
+int label_steer_rule_add(struct label_steer_rule *rules, unsigned int *n_rules,
+	struct label_steer_rule const *rule);
+
+int label_steer_install(portid_t port_id, struct label_steer_rule const *rules,
+	unsigned int n_rules, char const *sw_only_reason, struct label_steer_table *sw_table);
+void label_steer_remove(void);
+void label_steer_suspend(void);
+int label_steer_resume(portid_t port_id);
+void label_steer_print(void);
+
+
+/*
+ * Returns the queue the frame is steered to in software, or -1 when the frame
+ * isn't labelled or its top label isn't covered by the table.
+ */
+static inline int
+label_steer_lookup(struct label_steer_table const *t, struct rte_mbuf *m)
+{
+	struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	unsigned int lo, hi, mid;
+	uint32_t label;
+
+	if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_MPLS) ||
+	    unlikely(rte_pktmbuf_data_len(m) < RTE_ETHER_HDR_LEN + MPLS_HDR_LEN))
+		return -1;
+
+	label = mpls_get_label(rte_be_to_cpu_32(*(mpls_header_t *)(eth + 1)));
+
+	lo = 0;
+	hi = t->n_rules;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (label < t->rules[mid].first)
+			hi = mid;
+		else if (label > t->rules[mid].last)
+			lo = mid + 1;
+		else
+			return t->rules[mid].queue;
+	}
+
+	return -1;
+}
+
+#endif /* __INCLUDED_LABEL_STEER_H__ */
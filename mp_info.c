@@ -0,0 +1,197 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_memzone.h>
+#include <rte_ethdev.h>
+
+#include "mp_info.h"
+
+
+/*
+ * Multi-process access: the primary publishes its configuration and the location
+ * of its counters in a named memzone. A secondary process (the same binary run
+ * with --proc-type=secondary) looks it up and prints the tables and counters,
+ * reading the memory of the primary without any request to its cores.
+ */
+
+static struct mp_info *g_mp_info;
+static volatile int g_mp_stop;
+
+
+/* ************************************************************************** */
+
+/*
+ * Primary: copy the information to the memzone and mark it running.
+ */
+int
+mp_info_publish(struct mp_info const *info)
+{
+	struct rte_memzone const *mz;
+
+	mz = rte_memzone_reserve(MP_INFO_MZ_NAME, sizeof(*g_mp_info), SOCKET_ID_ANY, 0);
+	if (mz == NULL) {
+		fprintf(stderr, "Error: cannot reserve memzone %s: %s\n", MP_INFO_MZ_NAME,
+			rte_strerror(rte_errno));
+		return -1;
+	}
+
+	g_mp_info = mz->addr;
+	memcpy(g_mp_info, info, sizeof(*g_mp_info));
+	g_mp_info->magic = MP_INFO_MAGIC;
+	g_mp_info->version = MP_INFO_VERSION;
+	g_mp_info->size = sizeof(*g_mp_info);
+	__atomic_store_n(&g_mp_info->state, MP_INFO_RUNNING, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+
+/*
+ * Primary: the cores are stopped, secondaries stop reading the counters.
+ */
+void
+mp_info_stop(void)
+{
+	if (g_mp_info != NULL)
+		__atomic_store_n(&g_mp_info->state, MP_INFO_STOPPED, __ATOMIC_RELEASE);
+}
+
+
+/* ************************************************************************** */
+
+static void
+mp_info_signal(int signum __rte_unused)
+{
+	g_mp_stop = 1;
+}
+
+
+static void
+mp_info_tables_print(struct mp_info const *info)
+{
+	unsigned int n;
+
+	printf("Primary pid %d, MPLS label=%u ttl=%u, port %hu (push) <-> port %hu (pop)",
+		(int)info->pid, info->mpls_label, info->mpls_ttl, info->port_in,
+		info->port_out);
+	if (info->generation != 0)
+		printf(", %u restart(s)", info->generation);
+	printf("\n");
+
+	for (n = 0; n < info->n_stream; n++) {
+		struct fwd_stream const *s = &info->strm[n];
+
+		printf("  stream %u: core %u, port %hu rxq %hu txq %hu, port %hu rxq %hu "
+		       "txq %hu\n", n, info->cores[n], s->input_port.id,
+		       s->input_port.rx_queue_id, s->input_port.tx_queue_id,
+		       s->output_port.id, s->output_port.rx_queue_id,
+		       s->output_port.tx_queue_id);
+	}
+	for (n = 0; n < info->n_dist; n++)
+		printf("  software RSS %u: core %u, port %hu rxq %hu\n", n,
+			info->dist_cores[n], info->dist[n].port_id, info->dist[n].rx_queue_id);
+
+	if (info->n_steer_rules != 0) {
+		printf("Label steering (%u in software):\n", info->steer_sw.n_rules);
+		for (n = 0; n < info->n_steer_rules; n++)
+			printf("  labels %u-%u -> queue %hu\n", info->steer_rules[n].first,
+				info->steer_rules[n].last, info->steer_rules[n].queue);
+	}
+
+	if (info->n_mirror_rings != 0)
+		printf("Mirror: %u ring(s) %s_<stream> of %u frames, mbuf pool '%s'\n",
+			info->n_mirror_rings, MP_INFO_MIRROR_RING_PREFIX,
+			info->mirror_ring_size, info->pool_name);
+	if (info->n_slow_rings != 0)
+		printf("Slow path: %u ring(s) %s_<stream> of %u frames\n",
+			info->n_slow_rings, MP_INFO_SLOW_RING_PREFIX, info->slow_ring_size);
+}
+
+
+static void
+mp_info_ports_print(struct mp_info const *info)
+{
+	portid_t ports[] = { info->port_in, info->port_out };
+	struct rte_eth_stats st;
+	unsigned int n;
+
+	for (n = 0; n < RTE_DIM(ports); n++) {
+		if (rte_eth_stats_get(ports[n], &st) != 0)
+			continue;
+		printf("Port %hu: rx=%"PRIu64" tx=%"PRIu64" missed=%"PRIu64" rx-err=%"PRIu64
+		       " tx-err=%"PRIu64" no-mbuf=%"PRIu64"\n", ports[n], st.ipackets,
+		       st.opackets, st.imissed, st.ierrors, st.oerrors, st.rx_nombuf);
+	}
+}
+
+
+/*
+ * Secondary: print the tables and the counters of the primary, every period_s
+ * seconds until interrupted (once if period_s is 0) or the primary stops.
+ */
+int
+mp_info_secondary_run(unsigned int period_s)
+{
+	struct rte_memzone const *mz;
+	struct mp_info const *info;
+	uint64_t sec;
+	unsigned int t;
+
+
+	mz = rte_memzone_lookup(MP_INFO_MZ_NAME);
+	if (mz == NULL) {
+		fprintf(stderr, "Error: no forwarder information (%s), is the primary "
+			"dpdk-mplsfwd running?\n", MP_INFO_MZ_NAME);
+		return -1;
+	}
+
+	info = mz->addr;
+	if (info->magic != MP_INFO_MAGIC || info->version != MP_INFO_VERSION ||
+	    info->size != sizeof(*info)) {
+		fprintf(stderr, "Error: the primary is a different build of dpdk-mplsfwd\n");
+		return -1;
+	}
+	if (__atomic_load_n(&info->state, __ATOMIC_ACQUIRE) != MP_INFO_RUNNING) {
+		fprintf(stderr, "Error: the primary isn't forwarding\n");
+		return -1;
+	}
+
+	signal(SIGINT, mp_info_signal);
+	signal(SIGTERM, mp_info_signal);
+
+	mp_info_tables_print(info);
+	for (;;) {
+		sec = (rte_get_tsc_cycles() - info->start_tsc) / rte_get_tsc_hz();
+		printf("\nUptime %"PRIu64" s\n", sec);
+		fwd_stream_stats_print(info->strm, info->n_stream);
+		fwd_dist_stats_print(info->dist, info->n_dist);
+		mp_info_ports_print(info);
+		fflush(stdout);
+
+		if (period_s == 0)
+			break;
+		for (t = 0; t < period_s * 10 && !g_mp_stop; t++)
+			rte_delay_us_sleep(US_PER_S / 10);
+		if (g_mp_stop)
+			break;
+		if (__atomic_load_n(&info->state, __ATOMIC_ACQUIRE) != MP_INFO_RUNNING) {
+			printf("The primary stopped\n");
+			break;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_MP_INFO_H__
+#define __INCLUDED_MP_INFO_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <rte_mempool.h>
+
+#include "common.h"
+#include "fwd_engine.h"
+#include "label_steer.h"
+#include "cmdlargs.h"
+
+
+#define MP_INFO_MZ_NAME   "mplsfwd_info"
+#define MP_INFO_MAGIC     0x4d504c53    /* "MPLS" */
+#define MP_INFO_VERSION   3
+
+/* Analytics mirror rings: <prefix>_<stream> */
+#define MP_INFO_MIRROR_RING_PREFIX "mplsfwd_mirror"
+#define MP_INFO_SLOW_RING_PREFIX   "mplsfwd_slow"
+
+enum mp_info_state {
+	MP_INFO_INIT,
+	MP_INFO_RUNNING,
+	MP_INFO_STOPPED,
+};
+
+/*
+ * Published by the primary process in a memzone. The streams and distributors
+ * are in hugepage memory, mapped at the same address by secondary processes, which
+ * read the counters directly. A secondary must be the same build (version and
+ * size are checked).
+ */
+struct mp_info {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;                  /* sizeof(struct mp_info) */
+	volatile uint32_t state;        /* enum mp_info_state */
+
+	pid_t pid;
+	uint32_t generation;            /* hitless restarts so far */
+	uint64_t start_tsc;
+
+	uint32_t mpls_label;
+	uint32_t mpls_ttl;
+	portid_t port_in;               /* MPLS header pushed on its frames */
+	portid_t port_out;
+
+	unsigned int n_stream;
+	unsigned int cores[CORES_MAX_NUM];
+	struct fwd_stream const *strm;
+
+	unsigned int n_dist;
+	unsigned int dist_cores[CORES_MAX_NUM];
+	struct fwd_dist const *dist;
+
+	/* Label steering: all rules, and those steered in software */
+	unsigned int n_steer_rules;
+	struct label_steer_rule steer_rules[LABEL_STEER_MAX_RULES];
+	struct label_steer_table steer_sw;
+
+	/* Analytics mirror: the consumer dequeues mbufs of the pool from the rings
+	 * (MP_INFO_MIRROR_RING_PREFIX) and frees them when done. The frames are
+	 * shared with the TX, read-only. */
+	char pool_name[RTE_MEMPOOL_NAMESIZE];
+	unsigned int n_mirror_rings;        /* 0 = mirror disabled */
+	unsigned int mirror_ring_size;
+
+	/* Slow path: frames which don't fit in the MTU of the output port once
+	 * labelled (IPv6, IPv4 with DF), as received on the input port, with the
+	 * MTU to report in an ICMP Packet Too Big in hash.usr. The consumer owns
+	 * the mbufs (MP_INFO_SLOW_RING_PREFIX rings, same pool). */
+	unsigned int n_slow_rings;          /* 0 = no slow path */
+	unsigned int slow_ring_size;
+};
+
+
+int mp_info_publish(struct mp_info const *info);
+void mp_info_stop(void);
+int mp_info_secondary_run(unsigned int period_s);
+
+#endif /* __INCLUDED_MP_INFO_H__ */
@@ -0,0 +1,712 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <rte_common.h>
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_bus.h>
+#include <rte_dev.h>
+#include <rte_devargs.h>
+#include <rte_kvargs.h>
+#ifdef RTE_LIB_VHOST
+#include <rte_vhost.h>
+#endif
+
+#include "port_drv.h"
+#include "mpls.h"
+
+
+/*
+ * Driver specific setup of the ports. Only the generic ethdev API is used by the
+ * forwarding cores; the drivers are tuned here, after the port is configured,
+ * using the libraries they are built on.
+ */
+
+#define PORT_DRV_DEVARGS_LEN  512
+
+#ifndef VIRTIO_NET_F_MRG_RXBUF
+#define VIRTIO_NET_F_MRG_RXBUF  15
+#endif
+#ifndef VIRTIO_F_RING_PACKED
+#define VIRTIO_F_RING_PACKED    34
+#endif
+#ifndef VIRTIO_F_IN_ORDER
+#define VIRTIO_F_IN_ORDER       35
+#endif
+
+static struct {
+	char const *driver;
+	char const *name;
+	int vring;      /* a software ring shared with a peer */
+} const g_drv[] = {
+	[PORT_DRV_OTHER] = { NULL,        "",           0 },
+	[PORT_DRV_VHOST] = { "net_vhost", "vhost-user", 1 },
+	[PORT_DRV_MEMIF] = { "net_memif", "memif",      1 },
+	[PORT_DRV_AF_XDP] = { "net_af_xdp", "AF_XDP",   1 },
+};
+
+
+/* ************************************************************************** */
+
+enum port_drv
+port_drv_type(struct rte_eth_dev_info const *dev_info)
+{
+	unsigned int d;
+
+	for (d = PORT_DRV_OTHER + 1; d < RTE_DIM(g_drv); d++) {
+		if (dev_info->driver_name != NULL &&
+		    !strcmp(dev_info->driver_name, g_drv[d].driver))
+			return (enum port_drv)d;
+	}
+
+	return PORT_DRV_OTHER;
+}
+
+
+char const *
+port_drv_name(enum port_drv drv)
+{
+	return g_drv[drv].name;
+}
+
+
+/*
+ * The port is a ring shared with a software peer (VM, container, kernel): an empty
+ * RX poll or a short TX burst says the peer is the bottleneck.
+ */
+int
+port_drv_is_vring(enum port_drv drv)
+{
+	return g_drv[drv].vring;
+}
+
+
+/*
+ * Value of a device argument, copied to val. Returns -1 when it's not given.
+ */
+static int
+port_drv_arg(char const *args, char const *key, char *val, size_t len)
+{
+	struct rte_kvargs *kvlist;
+	char const *v;
+	int r = -1;
+
+	if (args == NULL)
+		return -1;
+
+	kvlist = rte_kvargs_parse(args, NULL);
+	if (kvlist == NULL)
+		return -1;
+
+	v = rte_kvargs_get(kvlist, key);
+	if (v != NULL) {
+		snprintf(val, len, "%s", v);
+		r = 0;
+	}
+	rte_kvargs_free(kvlist);
+
+	return r;
+}
+
+
+/*
+ * Ports of a driver, the ids are collected first as the devices are probed again.
+ */
+static unsigned int
+port_drv_ports(enum port_drv drv, portid_t *ports)
+{
+	struct rte_eth_dev_info dev_info;
+	unsigned int n_ports = 0;
+	portid_t port_id;
+
+	RTE_ETH_FOREACH_DEV(port_id) {
+		if (rte_eth_dev_info_get(port_id, &dev_info) == 0 &&
+		    port_drv_type(&dev_info) == drv)
+			ports[n_ports++] = port_id;
+	}
+
+	return n_ports;
+}
+
+
+/*
+ * Append key=val to the device arguments unless args give the key. Returns 1 when
+ * appended, 0 when given, -1 when devargs is too short.
+ */
+static int
+port_drv_devargs_add(char *devargs, size_t size, char const *args, char const *key,
+	unsigned int val)
+{
+	size_t len = strlen(devargs);
+	char v[16];
+
+	if (port_drv_arg(args, key, v, sizeof(v)) == 0)
+		return 0;
+	if ((size_t)snprintf(devargs + len, size - len, ",%s=%u", key, val) >= size - len)
+		return -1;
+
+	return 1;
+}
+
+
+/*
+ * Probe the device of the port again with the new arguments.
+ */
+static int
+port_drv_reprobe(portid_t port_id, struct rte_device *dev, char const *devargs)
+{
+	rte_eth_dev_close(port_id);
+	if (rte_dev_remove(dev) != 0 || rte_dev_probe(devargs) != 0) {
+		fprintf(stderr, "Error: cannot probe '%s'\n", devargs);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Device arguments of a port: name and args. Returns -1 when they don't fit.
+ */
+static int
+port_drv_devargs(portid_t port_id, char *devargs, size_t size, struct rte_device **dev,
+	char const **args)
+{
+	struct rte_eth_dev_info dev_info;
+
+	if (rte_eth_dev_info_get(port_id, &dev_info) != 0)
+		return -1;
+	*dev = dev_info.device;
+	*args = rte_dev_devargs(*dev) != NULL ? rte_dev_devargs(*dev)->args : NULL;
+
+	if ((size_t)snprintf(devargs, size, "%s%s%s", rte_dev_name(*dev),
+	    *args != NULL && (*args)[0] != '\0' ? "," : "",
+	    *args != NULL ? *args : "") >= size) {
+		fprintf(stderr, "Error: device arguments of port %hu are too long\n", port_id);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* ************************************************************************** */
+
+/*
+ * vhost-user: each frame uses one descriptor (no mergeable buffers), the forwarder
+ * never needs more than one mbuf per frame. In-order and packed rings are kept,
+ * the frontend enables them (e.g. virtio_user in_order=1,packed_vq=1). The vhost
+ * socket is registered when the port is configured; the features offered to
+ * a frontend are set before it connects.
+ */
+static int
+port_vhost_configured(portid_t port_id, char const *args)
+{
+#ifdef RTE_LIB_VHOST
+	char path[PATH_MAX];
+	uint64_t features;
+	int r;
+
+	if (port_drv_arg(args, "iface", path, sizeof(path)) != 0) {
+		fprintf(stderr, "Warning: port %hu: no vhost-user socket (iface=)\n", port_id);
+		return 0;
+	}
+
+	r = rte_vhost_driver_disable_features(path, 1ULL << VIRTIO_NET_F_MRG_RXBUF);
+	if (r != 0)
+		fprintf(stderr, "Warning: port %hu: cannot disable mergeable buffers of "
+			"'%s'\n", port_id, path);
+
+	if (rte_vhost_driver_get_features(path, &features) == 0 &&
+	    (features & (1ULL << VIRTIO_F_IN_ORDER)) == 0)
+		fprintf(stderr, "Warning: port %hu: vhost library doesn't offer in-order "
+			"rings\n", port_id);
+#else
+	RTE_SET_USED(args);
+	fprintf(stderr, "Warning: port %hu: DPDK built without the vhost library, "
+		"the vhost-user features are not tuned\n", port_id);
+#endif
+	return 0;
+}
+
+
+static void
+port_vhost_print(portid_t port_id)
+{
+#ifdef RTE_LIB_VHOST
+	struct rte_eth_dev_info dev_info;
+	char path[PATH_MAX];
+	uint64_t features;
+
+	if (rte_eth_dev_info_get(port_id, &dev_info) != 0 ||
+	    rte_dev_devargs(dev_info.device) == NULL ||
+	    port_drv_arg(rte_dev_devargs(dev_info.device)->args, "iface", path,
+		    sizeof(path)) != 0 ||
+	    rte_vhost_driver_get_features(path, &features) != 0)
+		return;
+
+	printf("  vhost-user: socket %s, offers mergeable buffers=%s in-order=%s "
+	       "packed ring=%s\n", path,
+	       features & (1ULL << VIRTIO_NET_F_MRG_RXBUF) ? "yes" : "no",
+	       features & (1ULL << VIRTIO_F_IN_ORDER) ? "yes" : "no",
+	       features & (1ULL << VIRTIO_F_RING_PACKED) ? "yes" : "no");
+#else
+	RTE_SET_USED(port_id);
+#endif
+}
+
+
+/*
+ * vhost-user: offer TSO to the guests (tso=1) on the vhost ports which don't set
+ * it in their device arguments, so a VM sends large TCP segments. Like for memif,
+ * the devices are probed again before the ports are configured.
+ */
+int
+port_drv_vhost_tune(unsigned int tso)
+{
+	portid_t ports[RTE_MAX_ETHPORTS];
+	char devargs[PORT_DRV_DEVARGS_LEN];
+	unsigned int n_ports, n;
+	struct rte_device *dev;
+	char const *args;
+	int r;
+
+
+	if (tso == 0)
+		return 0;
+
+	n_ports = port_drv_ports(PORT_DRV_VHOST, ports);
+	for (n = 0; n < n_ports; n++) {
+		if (port_drv_devargs(ports[n], devargs, sizeof(devargs), &dev, &args) != 0)
+			return -1;
+
+		r = port_drv_devargs_add(devargs, sizeof(devargs), args, "tso", 1);
+		if (r < 0) {
+			fprintf(stderr, "Error: device arguments of port %hu are too long\n",
+				ports[n]);
+			return -1;
+		}
+		if (r > 0 && port_drv_reprobe(ports[n], dev, devargs) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/* ************************************************************************** */
+
+/*
+ * memif: apply the ring and buffer sizes to the memif ports which don't set them
+ * in their device arguments. The devices are probed again with the arguments
+ * added, so it must be done before the ports are configured. Names are kept,
+ * port ids may change.
+ */
+int
+port_drv_memif_tune(unsigned int log2_ring_size, unsigned int buf_size)
+{
+	portid_t ports[RTE_MAX_ETHPORTS];
+	char devargs[PORT_DRV_DEVARGS_LEN];
+	unsigned int n_ports, n;
+	struct rte_device *dev;
+	char const *args;
+	int r = 0, added = 0;
+
+
+	n_ports = port_drv_ports(PORT_DRV_MEMIF, ports);
+	for (n = 0; n < n_ports; n++) {
+		if (port_drv_devargs(ports[n], devargs, sizeof(devargs), &dev, &args) != 0)
+			return -1;
+
+		added = 0;
+		if (log2_ring_size != 0 && (r = port_drv_devargs_add(devargs, sizeof(devargs),
+		    args, "rsize", log2_ring_size)) > 0)
+			added++;
+		if (r >= 0 && buf_size != 0 && (r = port_drv_devargs_add(devargs,
+		    sizeof(devargs), args, "bsize", buf_size)) > 0)
+			added++;
+		if (r < 0) {
+			fprintf(stderr, "Error: device arguments of port %hu are too long\n",
+				ports[n]);
+			return -1;
+		}
+
+		/* both set in the device arguments */
+		if (added != 0 && port_drv_reprobe(ports[n], dev, devargs) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * memif: in zero-copy mode (a client only) the peer reads and writes the mbufs
+ * of the forwarder's pool directly: every ring holds mbufs, the buffer size is
+ * the mbuf data room. In copy mode frames longer than the buffer are chained.
+ */
+static int
+port_memif_configured(portid_t port_id, char const *args, struct port_drv_info *info)
+{
+	char val[16];
+	unsigned long log2_size = PORT_MEMIF_DEFAULT_LOG2_RING;
+
+	if (port_drv_arg(args, "rsize", val, sizeof(val)) == 0)
+		log2_size = strtoul(val, NULL, 10);
+	if (log2_size == 0 || log2_size > PORT_MEMIF_MAX_LOG2_RING_SIZE) {
+		fprintf(stderr, "Error: port %hu: invalid memif ring size 2^%lu\n",
+			port_id, log2_size);
+		return -1;
+	}
+	info->ring_size = 1u << log2_size;
+
+	info->zero_copy = port_drv_arg(args, "zero-copy", val, sizeof(val)) == 0 &&
+		!strcmp(val, "yes");
+	if (info->zero_copy) {
+		if (port_drv_arg(args, "bsize", val, sizeof(val)) == 0)
+			fprintf(stderr, "Warning: port %hu: memif bsize is ignored in "
+				"zero-copy mode, the mbuf size is used\n", port_id);
+	} else if (port_drv_arg(args, "bsize", val, sizeof(val)) == 0 &&
+		   strtoul(val, NULL, 10) < RTE_ETHER_MAX_LEN + MPLS_HDR_LEN) {
+		fprintf(stderr, "Warning: port %hu: memif buffers of %s bytes, full-size "
+			"frames are chained\n", port_id, val);
+	}
+
+	return 0;
+}
+
+
+static void
+port_memif_print(portid_t port_id)
+{
+	struct rte_eth_dev_info dev_info;
+	char role[16], rsize[16], bsize[16], zc[16];
+	char const *args;
+
+	if (rte_eth_dev_info_get(port_id, &dev_info) != 0 ||
+	    rte_dev_devargs(dev_info.device) == NULL)
+		return;
+	args = rte_dev_devargs(dev_info.device)->args;
+
+	if (port_drv_arg(args, "role", role, sizeof(role)) != 0)
+		snprintf(role, sizeof(role), "server");
+	if (port_drv_arg(args, "rsize", rsize, sizeof(rsize)) != 0)
+		snprintf(rsize, sizeof(rsize), "%u", PORT_MEMIF_DEFAULT_LOG2_RING);
+	if (port_drv_arg(args, "bsize", bsize, sizeof(bsize)) != 0)
+		snprintf(bsize, sizeof(bsize), "default");
+	if (port_drv_arg(args, "zero-copy", zc, sizeof(zc)) != 0)
+		snprintf(zc, sizeof(zc), "no");
+
+	printf("  memif: role %s, rings of 2^%s, buffers %s, zero-copy %s\n",
+		role, rsize, bsize, zc);
+}
+
+
+/* ************************************************************************** */
+
+/*
+ * AF_XDP: number of channels (queues) of a kernel interface, -1 if unknown.
+ */
+static int
+port_af_xdp_channels(char const *iface)
+{
+	struct ethtool_channels ch = { .cmd = ETHTOOL_GCHANNELS };
+	struct ifreq ifr;
+	int fd, r;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&ifr, 0, sizeof(ifr));
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", iface);
+	ifr.ifr_data = (void *)&ch;
+	r = ioctl(fd, SIOCETHTOOL, &ifr);
+	close(fd);
+	if (r != 0)
+		return -1;
+
+	return (int)(ch.combined_count != 0 ? ch.combined_count : ch.rx_count);
+}
+
+
+/*
+ * Value of a sysfs attribute of a kernel interface, -1 if it can't be read.
+ */
+static long
+port_sysfs_read(char const *iface, char const *attr)
+{
+	char path[PATH_MAX];
+	long val = -1;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/%s", iface, attr);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	if (fscanf(f, "%ld", &val) != 1)
+		val = -1;
+	fclose(f);
+
+	return val;
+}
+
+
+/*
+ * AF_XDP: the PMD polls a single channel of the interface (queue_count=1) unless
+ * told otherwise. For the ports which don't set queue_count, use every channel
+ * from start_queue (at most n_queues, 0 = no limit), with one UMEM shared by the
+ * queues, and set the busy polling budget (-1 = driver default). The devices
+ * are probed again with the arguments added.
+ */
+int
+port_drv_af_xdp_tune(unsigned int n_queues, int busy_budget)
+{
+	portid_t ports[RTE_MAX_ETHPORTS];
+	char devargs[PORT_DRV_DEVARGS_LEN];
+	char iface[IF_NAMESIZE], val[16];
+	unsigned int n_ports, n, start_queue;
+	struct rte_device *dev;
+	char const *args;
+	size_t len;
+	int r = 0, added, channels;
+
+
+	n_ports = port_drv_ports(PORT_DRV_AF_XDP, ports);
+	for (n = 0; n < n_ports; n++) {
+		if (port_drv_devargs(ports[n], devargs, sizeof(devargs), &dev, &args) != 0)
+			return -1;
+		if (port_drv_arg(args, "iface", iface, sizeof(iface)) != 0)
+			continue;
+
+		added = 0;
+		start_queue = port_drv_arg(args, "start_queue", val, sizeof(val)) == 0 ?
+			(unsigned int)strtoul(val, NULL, 10) : 0;
+		channels = port_af_xdp_channels(iface);
+		if (channels > (int)start_queue) {
+			unsigned int q = (unsigned int)channels - start_queue;
+
+			if (n_queues != 0 && q > n_queues)
+				q = n_queues;
+			if ((r = port_drv_devargs_add(devargs, sizeof(devargs), args,
+			    "queue_count", q)) > 0)
+				added++;
+		} else {
+			fprintf(stderr, "Warning: port %hu: cannot get the channels of %s\n",
+				ports[n], iface);
+		}
+		if (r >= 0 && busy_budget >= 0 && (r = port_drv_devargs_add(devargs,
+		    sizeof(devargs), args, "busy_budget", (unsigned int)busy_budget)) > 0)
+			added++;
+
+		/* Last, so it can be dropped when the kernel or libbpf lack it */
+		len = strlen(devargs);
+		if (r >= 0 && (r = port_drv_devargs_add(devargs, sizeof(devargs), args,
+		    "shared_umem", 1)) > 0)
+			added++;
+		if (r < 0) {
+			fprintf(stderr, "Error: device arguments of port %hu are too long\n",
+				ports[n]);
+			return -1;
+		}
+		if (added == 0)
+			continue;
+
+		rte_eth_dev_close(ports[n]);
+		if (rte_dev_remove(dev) != 0) {
+			fprintf(stderr, "Error: cannot remove '%s'\n", devargs);
+			return -1;
+		}
+		if (rte_dev_probe(devargs) == 0)
+			continue;
+		if (r == 0) {
+			fprintf(stderr, "Error: cannot probe '%s'\n", devargs);
+			return -1;
+		}
+		fprintf(stderr, "Warning: port %hu: no shared UMEM, each queue has its own\n",
+			ports[n]);
+		devargs[len] = '\0';
+		if (rte_dev_probe(devargs) != 0) {
+			fprintf(stderr, "Error: cannot probe '%s'\n", devargs);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * AF_XDP: the fill ring of each RX queue and the completion ring of each TX queue
+ * hold mbufs of the pool, which is the UMEM. The queues of the port must cover
+ * the channels of the interface, frames of the other channels go to the kernel
+ * stack. Busy polling (on by default) needs deferred interrupts on the interface.
+ */
+static int
+port_af_xdp_configured(portid_t port_id, char const *args, struct port_drv_info *info)
+{
+	struct rte_eth_dev_info dev_info;
+	char iface[IF_NAMESIZE], val[16];
+	unsigned int start_queue = 0;
+	int channels;
+
+	info->ring_size = PORT_AF_XDP_RING_SIZE;
+	info->zero_copy = 1;
+
+	if (port_drv_arg(args, "iface", iface, sizeof(iface)) != 0 ||
+	    rte_eth_dev_info_get(port_id, &dev_info) != 0)
+		return 0;
+
+	if (port_drv_arg(args, "start_queue", val, sizeof(val)) == 0)
+		start_queue = (unsigned int)strtoul(val, NULL, 10);
+	channels = port_af_xdp_channels(iface);
+	if (channels > 0 && start_queue + dev_info.nb_rx_queues < (unsigned int)channels)
+		fprintf(stderr, "Warning: port %hu: queues %u-%u of the %d channels of %s are "
+			"polled, frames of the others go to the kernel (ethtool -L %s "
+			"combined %hu)\n", port_id, start_queue,
+			start_queue + dev_info.nb_rx_queues - 1, channels, iface, iface,
+			dev_info.nb_rx_queues);
+
+	if ((port_drv_arg(args, "busy_budget", val, sizeof(val)) != 0 ||
+	     strtoul(val, NULL, 10) != 0) &&
+	    port_sysfs_read(iface, "napi_defer_hard_irqs") == 0)
+		fprintf(stderr, "Warning: port %hu: busy polling %s without deferred "
+			"interrupts, set /sys/class/net/%s/napi_defer_hard_irqs (e.g. 2) and "
+			"gro_flush_timeout (e.g. 200000)\n", port_id, iface, iface);
+
+	return 0;
+}
+
+
+static void
+port_af_xdp_print(portid_t port_id)
+{
+	struct rte_eth_dev_info dev_info;
+	char iface[IF_NAMESIZE], start[16], umem[16], budget[16];
+	char const *args;
+
+	if (rte_eth_dev_info_get(port_id, &dev_info) != 0 ||
+	    rte_dev_devargs(dev_info.device) == NULL)
+		return;
+	args = rte_dev_devargs(dev_info.device)->args;
+
+	if (port_drv_arg(args, "iface", iface, sizeof(iface)) != 0)
+		return;
+	if (port_drv_arg(args, "start_queue", start, sizeof(start)) != 0)
+		snprintf(start, sizeof(start), "0");
+	if (port_drv_arg(args, "shared_umem", umem, sizeof(umem)) != 0)
+		snprintf(umem, sizeof(umem), "0");
+	if (port_drv_arg(args, "busy_budget", budget, sizeof(budget)) != 0)
+		snprintf(budget, sizeof(budget), "default");
+
+	printf("  AF_XDP: interface %s (%d channels), queues from %s, shared UMEM %s, "
+	       "busy polling budget %s, napi_defer_hard_irqs %ld\n", iface,
+	       port_af_xdp_channels(iface), start, strcmp(umem, "0") ? "yes" : "no", budget,
+	       port_sysfs_read(iface, "napi_defer_hard_irqs"));
+}
+
+
+/*
+ * AF_XDP: frames the kernel dropped as the RX ring was full or the fill ring
+ * empty (the forwarder is late), fill ring refills that failed (pool empty),
+ * and per queue counts. Empty polls and full TX bursts of the cores are in the
+ * stream statistics.
+ */
+static void
+port_af_xdp_stats_print(portid_t port_id)
+{
+	struct rte_eth_dev_info dev_info;
+	struct rte_eth_stats st;
+	unsigned int q, n_queues;
+
+	if (rte_eth_dev_info_get(port_id, &dev_info) != 0 ||
+	    rte_eth_stats_get(port_id, &st) != 0)
+		return;
+
+	printf("AF_XDP port %hu: kernel drops=%"PRIu64", fill ring refill failed=%"PRIu64
+	       ", TX errors=%"PRIu64"\n", port_id, st.imissed, st.rx_nombuf, st.oerrors);
+
+	n_queues = RTE_MIN(RTE_MAX(dev_info.nb_rx_queues, dev_info.nb_tx_queues),
+		(unsigned int)RTE_ETHDEV_QUEUE_STAT_CNTRS);
+	for (q = 0; q < n_queues; q++)
+		printf("  queue %u: rx=%"PRIu64" tx=%"PRIu64" errors=%"PRIu64"\n", q,
+		       st.q_ipackets[q], st.q_opackets[q], st.q_errors[q]);
+}
+
+
+/* ************************************************************************** */
+
+/*
+ * Called once rte_eth_dev_configure() succeeded, before the queues are set up.
+ * args are the device arguments.
+ */
+int
+port_drv_configured(portid_t port_id, enum port_drv drv, char const *args,
+	struct port_drv_info *info)
+{
+	memset(info, 0, sizeof(*info));
+
+	switch (drv) {
+	case PORT_DRV_VHOST:
+		return port_vhost_configured(port_id, args);
+	case PORT_DRV_MEMIF:
+		return port_memif_configured(port_id, args, info);
+	case PORT_DRV_AF_XDP:
+		return port_af_xdp_configured(port_id, args, info);
+	default:
+		return 0;
+	}
+}
+
+
+void
+port_drv_print(portid_t port_id, enum port_drv drv)
+{
+	switch (drv) {
+	case PORT_DRV_VHOST:
+		port_vhost_print(port_id);
+		break;
+	case PORT_DRV_MEMIF:
+		port_memif_print(port_id);
+		break;
+	case PORT_DRV_AF_XDP:
+		port_af_xdp_print(port_id);
+		break;
+	default:
+		break;
+	}
+}
+
+
+/*
+ * Driver counters, printed at exit.
+ */
+void
+port_drv_stats_print(portid_t port_id, enum port_drv drv)
+{
+	switch (drv) {
+	case PORT_DRV_AF_XDP:
+		port_af_xdp_stats_print(port_id);
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_PORT_DRV_H__
+#define __INCLUDED_PORT_DRV_H__
+
+#include <rte_ethdev.h>
+
+#include "common.h"
+
+
+/* Drivers whose ports get specific setup and statistics */
+enum port_drv {
+	PORT_DRV_OTHER = 0,
+	PORT_DRV_VHOST,         /* net_vhost: vhost-user backend of a VM's virtio */
+	PORT_DRV_MEMIF,         /* net_memif: shared memory packet interface */
+	PORT_DRV_AF_XDP,        /* net_af_xdp: AF_XDP sockets of a kernel interface */
+};
+
+/* memif rings: log2 of the size, buffer size */
+#define PORT_MEMIF_MAX_LOG2_RING_SIZE  14
+#define PORT_MEMIF_DEFAULT_LOG2_RING   10
+#define PORT_MEMIF_MIN_BUF_SIZE        128
+#define PORT_MEMIF_MAX_BUF_SIZE        UINT16_MAX
+
+/* AF_XDP: descriptors of the fill and completion rings of a queue (the XSK
+ * default), each holding mbufs of the pool */
+#define PORT_AF_XDP_RING_SIZE          2048
+#define PORT_AF_XDP_MAX_BUSY_BUDGET    1024
+
+/* Driver parameters of a port, found when it's configured */
+struct port_drv_info {
+	unsigned int ring_size;     /* descriptors of each ring of the driver */
+	unsigned int zero_copy;     /* the rings hold mbufs of the forwarder's pool */
+};
+
+
+enum port_drv port_drv_type(struct rte_eth_dev_info const *dev_info);
+char const *port_drv_name(enum port_drv drv);
+int port_drv_is_vring(enum port_drv drv);
+
+int port_drv_vhost_tune(unsigned int tso);
+int port_drv_memif_tune(unsigned int log2_ring_size, unsigned int buf_size);
+int port_drv_af_xdp_tune(unsigned int n_queues, int busy_budget);
+
+int port_drv_configured(portid_t port_id, enum port_drv drv, char const *args,
+	struct port_drv_info *info);
+void port_drv_print(portid_t port_id, enum port_drv drv);
+void port_drv_stats_print(portid_t port_id, enum port_drv drv);
+
+#endif /* __INCLUDED_PORT_DRV_H__ */
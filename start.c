@@ -9,6 +9,7 @@
  */
 #include <unistd.h>
 #include <stdint.h>
+#include <limits.h>
 #include <signal.h>
 #include <inttypes.h>
 #include <net/if.h>
@@ -17,9 +18,28 @@
 #include <rte_dev.h>
 #include <rte_ethdev.h>
 #include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_memzone.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+#include <rte_cycles.h>
+#include <rte_reorder.h>
+#include <rte_alarm.h>
+#include <rte_devargs.h>
+#include <rte_pdump.h>
+#include <rte_gso.h>
 
 #include "fwd_engine.h"
+#include "flow_hash.h"
+#include "label_steer.h"
 #include "cmdlargs.h"
+#include "handoff.h"
+#include "watchdog.h"
+#include "ctl_service.h"
+#include "stats.h"
+#include "mp_info.h"
+#include "port_drv.h"
+#include "kernels.h"
 #include "common.h"
 
 
@@ -29,7 +49,14 @@ static cmdline_conf_t g_app_config = {
 	.mpls_ttl = MPLS_DEFAULT_TTL,
 	.mpls_in_port = PORTID_MAX,
 	.print = 0,
+	.sym_rss = 0,
 	.num_cores = 0,		/* Also the number of forwarding streams */
+	.num_dist_cores = 0,
+	.dist_hash = FLOW_HASH_TOEPLITZ,
+	.reorder_size = 0,
+	.reorder_timeout_us = REORDER_DEFAULT_TIMEOUT_US,
+	.drain_timeout_ms = DRAIN_DEFAULT_TIMEOUT_MS,
+	.af_xdp_busy_budget = -1,
 };
 
 
@@ -40,6 +67,10 @@ static cmdline_conf_t g_app_config = {
 #define MBUF_BUF_SIZE       (MBUF_DATA_LEN + MBUF_HEADROOM)
 #define MBUF_IN_MEMPOOL     8191 /* The optimum size is when n = (2^q - 1) */
 
+/* MTU check: mbufs without data attached to the payload of the IPv4 packets
+ * being fragmented */
+#define FRAG_POOL_NAME      "frag_indirect"
+
 #define MEMPOOL_CACHE_SIZE  128
 
 /* Number of RX/TX ring descriptors
@@ -49,6 +80,46 @@ static cmdline_conf_t g_app_config = {
 
 #define QUEUE_INITIAL_IDX   0
 
+/* Rings passing MPLS frames from the software RSS cores (or other workers
+ * when labels are steered in software) to the workers */
+#define DIST_RING_NAME_PREFIX  "sw_rss"
+#define STEER_RING_NAME_PREFIX "sw_steer"
+#define DIST_RING_SIZE      1024
+
+/* Reorder: rings returning the processed frames to the software RSS cores */
+#define REORDER_RING_NAME_PREFIX "reorder"
+#define REORDER_RING_SIZE   2048
+
+/* Rings aggregating frames of the cores sharing one TX queue */
+#define TX_SHARE_RING_NAME_PREFIX "tx_share"
+#define TX_SHARE_RING_SIZE  1024
+
+/* Hash functions used for RSS and the largest supported key/redirection table */
+#define RSS_HASH_FUNCTIONS  (RTE_ETH_RSS_IP | RTE_ETH_RSS_TCP | RTE_ETH_RSS_UDP)
+#define RSS_KEY_MAX_LEN     128
+#define RSS_RETA_MAX_SIZE   2048
+
+/* Port events: handling is deferred to an alarm (EAL interrupt thread), ports
+ * are stopped/closed outside of the event callback */
+#define PORT_EVENT_DELAY_US       1000
+#define PORT_ATTACH_RETRY_US      (US_PER_S / 2)
+#define PORT_PAUSE_TIMEOUT_MS     500
+#define PORT_EVENT_RETRY_US       (US_PER_S / 2)
+/* The watchdog reports cores paused for longer than this */
+#define PORT_PAUSE_MAX_MS         (2 * PORT_PAUSE_TIMEOUT_MS)
+#define PORT_DEVARGS_LEN          256
+
+/* Startup: how long the main core waits for the cores to be ready (--gabby) */
+#define STARTUP_READY_TIMEOUT_MS  5000
+
+/* Hitless restart: how long a new instance waits for the running one to release
+ * the ports (drain included) */
+#define HANDOFF_TIMEOUT_MS        30000
+
+/* Period of the main core checking if the forwarding cores are still running */
+#define MAIN_WAIT_US              (US_PER_S / 10)
+#define MAIN_SERVICE_WAIT_US      1000	/* runs the services (no service cores) */
+
 /* Current requirements assume data stream between two ports */
 #define NUM_SUPPORTED_PORTS 2
 
@@ -62,20 +133,59 @@ static struct port_params {
 	portid_t id;
 	enum port_role role;
 
+	uint16_t n_rx_queue;
+	uint16_t n_tx_queue;
 	uint16_t n_rx_queue_desc;     /* number of descriptors allocated per queue */
 	uint16_t n_tx_queue_desc;
 
+	uint16_t reta_size;           /* RSS redirection table, 0 if RSS is disabled */
+	enum port_drv drv;            /* drivers tuned by port_drv.c */
+	struct port_drv_info drv_info;
+	uint64_t tx_offloads;         /* enabled on the port */
+
 	struct rte_eth_rxconf rxq_conf;
 	struct rte_eth_txconf txq_conf;
 
+	/* Symmetric RSS key: the driver keeps a pointer to it, it may program
+	 * the key when the port is started */
+	uint8_t rss_key[RSS_KEY_MAX_LEN];
+
 	struct rte_ether_addr mac_addr;
+
+	/* Port events (link state, reset, removal). Set by the event callbacks and
+	 * handled by port_event_handle(), both run in the EAL interrupt thread. */
+	uint32_t events;              /* RTE_BIT32(RTE_ETH_EVENT_*) to handle */
+	uint64_t event_tsc;           /* first event not handled yet */
+	uint64_t link_down_tsc;       /* 0 while the link is up */
+	unsigned int detached;        /* removed, waiting for the device to return */
+	char name[RTE_ETH_NAME_MAX_LEN];
+	char devargs[PORT_DEVARGS_LEN];
+	struct rte_device *device;
+
+	struct port_event_stats {
+		uint64_t link_down;
+		uint64_t reset;
+		uint64_t remove;
+		uint64_t fail;            /* reset/removal not handled, retried */
+		uint64_t last_down_us;    /* the last link outage */
+		uint64_t last_recovery_us; /* event to forwarding resumed (reset/removal) */
+		uint64_t max_recovery_us;
+	} ev_stats;
 } g_ports[NUM_SUPPORTED_PORTS] __rte_cache_aligned = {
 	{ .id = PORTID_MAX, .role = PORT_UNUSED },
 	{ .id = PORTID_MAX, .role = PORT_UNUSED },
 };
 
 
+static struct rte_mempool *g_mb_pool;
+static struct rte_mempool *g_frag_pool;	/* indirect mbufs of the fragments */
+static struct rte_gso_ctx g_gso_ctx;		/* software TSO */
 static struct fwd_stream *g_lcore_stream;
+static struct fwd_dist *g_dist;
+static struct label_steer_table g_steer_table;
+static struct encap_tmpl g_encap;		/* MPLS over UDP/GRE */
+static struct fec_table g_fec;			/* SR-MPLS segment lists */
+static struct handoff_state g_handoff_state;	/* of the predecessor */
 
 
 
@@ -85,6 +195,12 @@ static void
 signal_handler(int signum)
 {
 	if (signum == SIGINT || signum == SIGTERM) {
+		if (g_app_config.drain_timeout_ms != 0 && !fwd_engine_draining()) {
+			fprintf(stderr, "\nSignal %d received, draining (%u ms at most)...\n",
+				signum, g_app_config.drain_timeout_ms);
+			fwd_engine_drain(g_app_config.drain_timeout_ms);
+			return;
+		}
 		fprintf(stderr, "\nSignal %d received, preparing to exit...\n", signum);
 		fwd_engine_stop();
 	}
@@ -124,15 +240,46 @@ init_mem_pool(unsigned n_lcores, unsigned socket_id)
 
 	n_queue_desc = 0;
 	for (i = 0; i < n_ports; i++) {
-		n_queue_desc += (unsigned)g_ports[i].n_rx_queue_desc;
-		n_queue_desc += (unsigned)g_ports[i].n_tx_queue_desc;
+		n_queue_desc += (unsigned)g_ports[i].n_rx_queue_desc * g_ports[i].n_rx_queue;
+		n_queue_desc += (unsigned)g_ports[i].n_tx_queue_desc * g_ports[i].n_tx_queue;
 	}
-	n_queue_desc *= n_lcores;
 
 	n_mbufs = (MAX_PKT_BURST + MEMPOOL_CACHE_SIZE) * n_lcores;
 	n_mbufs *= n_ports;
 	n_mbufs += n_queue_desc;
 
+	/* Frames waiting in the rings of shared TX queues */
+	for (i = 0; i < n_ports; i++) {
+		if (g_ports[i].n_tx_queue < g_app_config.num_cores)
+			n_mbufs += TX_SHARE_RING_SIZE * g_ports[i].n_tx_queue;
+	}
+
+	/* Zero-copy memif: the rings of the driver are filled with our mbufs */
+	for (i = 0; i < n_ports; i++) {
+		if (g_ports[i].drv_info.zero_copy)
+			n_mbufs += g_ports[i].drv_info.ring_size *
+				(g_ports[i].n_rx_queue + g_ports[i].n_tx_queue);
+	}
+
+	/* Frames waiting in the software RSS rings */
+	if (g_app_config.num_dist_cores != 0) {
+		n_mbufs += (DIST_RING_SIZE + MAX_PKT_BURST) * g_app_config.num_cores;
+		n_mbufs += (MAX_PKT_BURST + MEMPOOL_CACHE_SIZE) * g_app_config.num_dist_cores;
+	}
+	/* Frames held by the analytics consumer */
+	if (g_app_config.mirror_dirs != 0)
+		n_mbufs += g_app_config.mirror_ring_size * g_app_config.num_cores;
+	if (g_app_config.reorder_size != 0)
+		n_mbufs += (REORDER_RING_SIZE + 2 * g_app_config.reorder_size) *
+			g_app_config.num_dist_cores;
+	/* Headers of the IPv4 fragments, frames held by the slow path */
+	if (g_app_config.mtu_check != 0)
+		n_mbufs += (MAX_PKT_BURST * FWD_FRAG_MAX + g_app_config.slow_ring_size) *
+			g_app_config.num_cores;
+	/* Headers of the software TSO segments */
+	if (g_app_config.tso != 0)
+		n_mbufs += FWD_GSO_MAX * g_app_config.num_cores;
+
 	n_mbufs = RTE_MAX(n_mbufs, MBUF_IN_MEMPOOL);
 
 	if (g_app_config.print != 0)
@@ -144,6 +291,17 @@ init_mem_pool(unsigned n_lcores, unsigned socket_id)
 	if (mp == NULL) {
 		fprintf(stderr, "Failed to create mbufs pool '%s' on socket %d: %s\n",
 			name, socket_id, rte_strerror(rte_errno));
+		return NULL;
+	}
+
+	/* AF_XDP registers the memory of the pool as its UMEM, in a single piece */
+	for (i = 0; i < n_ports; i++) {
+		if (g_ports[i].drv == PORT_DRV_AF_XDP && mp->nb_mem_chunks > 1) {
+			fprintf(stderr, "Warning: mbuf pool '%s' is in %u memory chunks, the "
+				"AF_XDP port %hu can't use it as UMEM (try --single-file-segments)"
+				"\n", name, mp->nb_mem_chunks, g_ports[i].id);
+			break;
+		}
 	}
 
 	return mp;
@@ -156,7 +314,7 @@ init_mem_pool(unsigned n_lcores, unsigned socket_id)
  */
 static int
 port_params_init(struct port_params *port, portid_t p_id, enum port_role p_role,
-	unsigned int n_cores)
+	unsigned int n_rxq, unsigned int n_txq)
 {
 	struct rte_eth_conf  port_conf = {
 		.rxmode = {
@@ -171,6 +329,7 @@ port_params_init(struct port_params *port, portid_t p_id, enum port_role p_role,
 		},
 	};
 	struct rte_eth_dev_info dev_info;
+	unsigned int n, hdr_len;
 	int r;
 
 
@@ -195,6 +354,24 @@ port_params_init(struct port_params *port, portid_t p_id, enum port_role p_role,
 		return -1;
 	}
 
+	/* Devices like memif or virtio may have fewer queues than there are cores */
+	if (n_rxq > dev_info.max_rx_queues) {
+		fprintf(stderr, "Warning: port %hu has %hu RX queue(s), %u requested - "
+			"some cores won't receive from it\n", port->id,
+			dev_info.max_rx_queues, n_rxq);
+		n_rxq = dev_info.max_rx_queues;
+	}
+	if (n_txq > dev_info.max_tx_queues) {
+		fprintf(stderr, "Warning: port %hu has %hu TX queue(s), %u requested - "
+			"cores will share TX queues\n", port->id,
+			dev_info.max_tx_queues, n_txq);
+		n_txq = dev_info.max_tx_queues;
+	}
+	if (n_rxq == 0 || n_txq == 0) {
+		fprintf(stderr, "Error: port %hu has no RX or TX queues\n", port->id);
+		return -1;
+	}
+
 	r = rte_eth_macaddr_get(port->id, &port->mac_addr);
 	if (r != 0) {
 		fprintf(stderr, "Error getting MAC address (port %hu): %s\n",
@@ -202,19 +379,120 @@ port_params_init(struct port_params *port, portid_t p_id, enum port_role p_role,
 		return -1;
 	}
 
-	if (dev_info.tx_offload_capa & RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE)
+	/* Fast free needs a reference count of 1, mirrored frames have 2, and a
+	 * single pool, IPv4 fragments and software TSO segments are made of mbufs
+	 * of two */
+	if ((dev_info.tx_offload_capa & RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE) &&
+	    g_app_config.mirror_dirs == 0 && g_app_config.mtu_check == 0 &&
+	    g_app_config.tso == 0)
 		port_conf.txmode.offloads |= RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE;
 
-	if (dev_info.max_rx_queues == 1)
+	/* IPv4 fragments are a header mbuf chained to the payload, TSO frames
+	 * span several mbufs */
+	if (p_role == PORT_EGRESS && (g_app_config.mtu_check != 0 || g_app_config.tso != 0))
+		port_conf.txmode.offloads |= dev_info.tx_offload_capa &
+			RTE_ETH_TX_OFFLOAD_MULTI_SEGS;
+
+	/* TSO: the input port receives large TCP segments, the output port segments
+	 * them (with the TCP checksum of software segments) if it can */
+	if (p_role == PORT_INGRESS && g_app_config.tso != 0)
+		port_conf.rxmode.offloads |= dev_info.rx_offload_capa &
+			(RTE_ETH_RX_OFFLOAD_TCP_LRO | RTE_ETH_RX_OFFLOAD_SCATTER);
+	if (p_role == PORT_EGRESS && g_app_config.tso != 0)
+		port_conf.txmode.offloads |= dev_info.tx_offload_capa &
+			(RTE_ETH_TX_OFFLOAD_TCP_TSO | RTE_ETH_TX_OFFLOAD_TCP_CKSUM);
+
+	/* Checksums of the IPv4 headers written on the output port (fragments, TSO
+	 * segments), computed in software when the port can't */
+	if (p_role == PORT_EGRESS)
+		port_conf.txmode.offloads |= dev_info.tx_offload_capa &
+			RTE_ETH_TX_OFFLOAD_IPV4_CKSUM;
+
+	/* Checksums of the outer header of MPLS over UDP/GRE */
+	if (p_role == PORT_EGRESS)
+		port_conf.txmode.offloads |= encap_tx_offloads(&g_app_config.encap,
+			dev_info.tx_offload_capa);
+	port->tx_offloads = port_conf.txmode.offloads;
+
+	/* Link state and removal events, see port_event_callback() */
+	if (dev_info.dev_flags != NULL) {
+		port_conf.intr_conf.lsc = !!(*dev_info.dev_flags & RTE_ETH_DEV_INTR_LSC);
+		port_conf.intr_conf.rmv = !!(*dev_info.dev_flags & RTE_ETH_DEV_INTR_RMV);
+	}
+
+	/* Used to probe the device again after it's removed */
+	port->device = dev_info.device;
+	rte_eth_dev_get_name_by_port(port->id, port->name);
+	if (rte_dev_devargs(dev_info.device) != NULL &&
+	    rte_dev_devargs(dev_info.device)->args != NULL &&
+	    rte_dev_devargs(dev_info.device)->args[0] != '\0')
+		snprintf(port->devargs, sizeof(port->devargs), "%s,%s",
+			rte_dev_name(dev_info.device), rte_dev_devargs(dev_info.device)->args);
+	else
+		snprintf(port->devargs, sizeof(port->devargs), "%s",
+			rte_dev_name(dev_info.device));
+
+	/* Spread flows across the queues (one queue per core) */
+	port->reta_size = 0;
+	if (n_rxq > 1 && (dev_info.flow_type_rss_offloads & RSS_HASH_FUNCTIONS)) {
+		port_conf.rxmode.mq_mode = RTE_ETH_MQ_RX_RSS;
+		port_conf.rx_adv_conf.rss_conf.rss_hf =
+			dev_info.flow_type_rss_offloads & RSS_HASH_FUNCTIONS;
+		port->reta_size = dev_info.reta_size;
+
+		if (g_app_config.sym_rss != 0) {
+			unsigned key_len = dev_info.hash_key_size;
+
+			if (key_len == 0)
+				key_len = FLOW_HASH_SYM_KEY_LEN;
+			if (key_len > RSS_KEY_MAX_LEN) {
+				fprintf(stderr, "Error: RSS key of port %hu is too long (%u bytes)\n",
+					port->id, key_len);
+				return -1;
+			}
+			flow_hash_sym_key_fill(port->rss_key, key_len);
+			port_conf.rx_adv_conf.rss_conf.rss_key = port->rss_key;
+			port_conf.rx_adv_conf.rss_conf.rss_key_len = (uint8_t)key_len;
+		}
+	} else if (n_rxq > 1) {
+		fprintf(stderr, "Warning: port %hu doesn't support RSS, "
+			"packets may be received by one core only\n", port->id);
+	}
+
+	if (dev_info.max_rx_queues == 1) {
 		port_conf.rxmode.mq_mode = RTE_ETH_MQ_RX_NONE;
+		port->reta_size = 0;
+	}
 
-	r = rte_eth_dev_configure(port->id, (uint16_t)n_cores, (uint16_t)n_cores,
+	r = rte_eth_dev_configure(port->id, (uint16_t)n_rxq, (uint16_t)n_txq,
 		&port_conf);
 	if (r < 0) {
 		fprintf(stderr, "Failed to configure device (port %hu): %s\n",
 			port->id, rte_strerror(-r));
 		return -1;
 	}
+	port->n_rx_queue = (uint16_t)n_rxq;
+	port->n_tx_queue = (uint16_t)n_txq;
+
+	/* Room for the outer header (or the deepest segment list) of full-size frames */
+	hdr_len = 0;
+	if (g_app_config.encap.type != ENCAP_NONE)
+		hdr_len = ENCAP_HDR_MAX_LEN;
+	for (n = 0; n < g_app_config.num_fec_rules; n++)
+		hdr_len = RTE_MAX(hdr_len, g_app_config.fec_rules[n].n_labels * MPLS_HDR_LEN);
+	if (p_role == PORT_EGRESS && hdr_len != 0) {
+		r = rte_eth_dev_set_mtu(port->id, (uint16_t)(RTE_ETHER_MTU + hdr_len));
+		if (r != 0)
+			fprintf(stderr, "Warning: cannot set MTU %u on port %hu (%s), "
+				"full-size frames won't fit once labelled\n",
+				(unsigned int)(RTE_ETHER_MTU + hdr_len), port->id,
+				rte_strerror(-r));
+	}
+
+	port->drv = port_drv_type(&dev_info);
+	if (port_drv_configured(port->id, port->drv, rte_dev_devargs(dev_info.device) != NULL ?
+	    rte_dev_devargs(dev_info.device)->args : NULL, &port->drv_info) != 0)
+		return -1;
 
 	port->n_rx_queue_desc = NUM_RX_QUEUE_DESC;
 	port->n_tx_queue_desc = NUM_TX_QUEUE_DESC;
@@ -245,8 +523,7 @@ port_params_init(struct port_params *port, portid_t p_id, enum port_role p_role,
  * the forwarding stream object.
  */
 static int
-port_queue_allocate(struct port_params *port, struct rte_mempool *mb_pool,
-	unsigned int n_cores)
+port_queue_allocate(struct port_params *port, struct rte_mempool *mb_pool)
 {
 	int r, socket_id;
 	unsigned q;
@@ -266,12 +543,13 @@ port_queue_allocate(struct port_params *port, struct rte_mempool *mb_pool,
 
 	/*
 	 * Allocate RX and TX queues for the device: one RX queue and one TX queue per core.
+	 * With software RSS, the RX queues of the output port are read by distributor cores.
 	 */
 	if (g_app_config.print != 0)
-		printf("Port %hu: setup %u RX queue(s), %hu desc each (on socket %d)\n",
-			port->id, n_cores, port->n_rx_queue_desc, socket_id);
+		printf("Port %hu: setup %hu RX queue(s), %hu desc each (on socket %d)\n",
+			port->id, port->n_rx_queue, port->n_rx_queue_desc, socket_id);
 
-	for (q = QUEUE_INITIAL_IDX; q < n_cores; q++) {
+	for (q = QUEUE_INITIAL_IDX; q < port->n_rx_queue; q++) {
 		r = rte_eth_rx_queue_setup(port->id, q, port->n_rx_queue_desc, socket_id,
 				&port->rxq_conf, mb_pool);
 		if (r < 0) {
@@ -282,10 +560,10 @@ port_queue_allocate(struct port_params *port, struct rte_mempool *mb_pool,
 	}
 
 	if (g_app_config.print != 0)
-		printf("Port %hu: setup %u TX queue(s), %hu desc each (on socket %d)\n",
-			port->id, n_cores, port->n_tx_queue_desc, socket_id);
+		printf("Port %hu: setup %hu TX queue(s), %hu desc each (on socket %d)\n",
+			port->id, port->n_tx_queue, port->n_tx_queue_desc, socket_id);
 
-	for (q = QUEUE_INITIAL_IDX; q < n_cores; q++) {
+	for (q = QUEUE_INITIAL_IDX; q < port->n_tx_queue; q++) {
 		r = rte_eth_tx_queue_setup(port->id, q, port->n_tx_queue_desc, socket_id,
 				&port->txq_conf);
 		if (r < 0) {
@@ -299,6 +577,106 @@ port_queue_allocate(struct port_params *port, struct rte_mempool *mb_pool,
 }
 
 
+/*
+ * Program the RSS redirection table as reta[i] = i % n_queues. The forwarder
+ * relies on this layout to predict in software (see flow_hash_to_queue()) which
+ * queue, hence which core, receives a given flow. Must be called after the port
+ * is started.
+ */
+static int
+port_rss_reta_setup(struct port_params *port, unsigned int n_queues)
+{
+	struct rte_eth_rss_reta_entry64 reta_conf[RSS_RETA_MAX_SIZE / RTE_ETH_RETA_GROUP_SIZE];
+	unsigned int i, grp, idx;
+	int r;
+
+
+	if (port->reta_size == 0 || n_queues == 0)
+		return 0;
+
+	if (port->reta_size > RSS_RETA_MAX_SIZE) {
+		fprintf(stderr, "Warning: RSS redirection table of port %hu is too big (%hu)\n",
+			port->id, port->reta_size);
+		return -1;
+	}
+
+	memset(reta_conf, 0, sizeof(reta_conf));
+	for (i = 0; i < port->reta_size; i++) {
+		grp = i / RTE_ETH_RETA_GROUP_SIZE;
+		idx = i % RTE_ETH_RETA_GROUP_SIZE;
+		reta_conf[grp].mask |= UINT64_C(1) << idx;
+		reta_conf[grp].reta[idx] = (uint16_t)(i % n_queues);
+	}
+
+	r = rte_eth_dev_rss_reta_update(port->id, reta_conf, port->reta_size);
+	if (r != 0) {
+		fprintf(stderr, "Warning: cannot update RSS redirection table (port %hu): %s\n",
+			port->id, rte_strerror(-r));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Graceful drain: wait until the NIC has sent the frames queued on the TX queues
+ * of the port (the forwarding cores are stopped), or until the deadline.
+ * Returns the number of queues which are not empty.
+ */
+static unsigned int
+port_tx_done_wait(struct port_params *port, uint64_t deadline)
+{
+	unsigned int q, n_busy = 0;
+	int r;
+
+	for (q = QUEUE_INITIAL_IDX; q < port->n_tx_queue; q++) {
+		do {
+			/* Releases the mbufs of sent frames, if supported by the driver */
+			rte_eth_tx_done_cleanup(port->id, q, 0);
+
+			/* The last descriptor filled by the application */
+			r = rte_eth_tx_descriptor_status(port->id, q, port->n_tx_queue_desc - 1);
+			if (r != RTE_ETH_TX_DESC_FULL)
+				break;
+			rte_pause();
+		} while (rte_get_tsc_cycles() < deadline);
+
+		n_busy += (r == RTE_ETH_TX_DESC_FULL);
+	}
+
+	return n_busy;
+}
+
+
+/*
+ * Start the port, program the redirection table and enable promiscuous mode.
+ */
+static int
+port_start(struct port_params *port)
+{
+	int r;
+
+	r = rte_eth_dev_start(port->id);
+	if (r < 0) {
+		fprintf(stderr, "rte_eth_dev_start(port=%u) error=%d\n", port->id, r);
+		return -1;
+	}
+
+	/* Without a known table layout the NIC hash cannot be predicted */
+	if (port_rss_reta_setup(port, port->n_rx_queue) != 0)
+		port->reta_size = 0;
+
+	r = rte_eth_promiscuous_enable(port->id);
+	if (r != 0) {
+		fprintf(stderr, "Error: rte_eth_promiscuous_enable failed (port=%u) : %s\n",
+			port->id, rte_strerror(-r));
+	}
+
+	return 0;
+}
+
+
 /*
  * Allocates one stream per execution unit (core). Each stream contains two ports,
  * named: INGRESS and EGRESS.
@@ -312,7 +690,8 @@ fwd_stream_alloc(unsigned int n_cores)
 	struct fwd_stream *strm;
 	unsigned s;
 
-	strm = calloc(n_cores, sizeof(struct fwd_stream));
+	strm = rte_zmalloc("fwd_stream", n_cores * sizeof(struct fwd_stream),
+		RTE_CACHE_LINE_SIZE);
 	if (NULL == strm) {
 		fprintf(stderr, "Error %i: Failed to allocate memery for stream!\n", ENOMEM);
 		return NULL;
@@ -349,14 +728,30 @@ fwd_stream_conf(struct port_params *port_in, struct port_params *port_out,
 	for (s = 0; s < n_stream; s++) {
 		strm[s].mpls_label = g_app_config.mpls_label;
 		strm[s].mpls_ttl = g_app_config.mpls_ttl;
+		strm[s].encap = g_app_config.encap.type != ENCAP_NONE ? &g_encap : NULL;
+		strm[s].fec = g_app_config.num_fec_rules != 0 ? &g_fec : NULL;
+		strm[s].sym_rss = g_app_config.sym_rss;
+		strm[s].stream_id = (uint16_t)s;
 
 		strm[s].input_port.id = port_in->id;
-		strm[s].input_port.rx_queue_id = q_id;
-		strm[s].input_port.tx_queue_id = q_id;
+		strm[s].input_port.rx_queue_id = (q_id < port_in->n_rx_queue) ? q_id : QUEUEID_MAX;
+		strm[s].input_port.tx_queue_id = q_id % port_in->n_tx_queue;
+		strm[s].input_port.reta_size = port_in->reta_size;
+		strm[s].input_port.nb_rx_queues = port_in->n_rx_queue;
+		strm[s].input_port.vring = (uint16_t)port_drv_is_vring(port_in->drv);
+		strm[s].input_port.tx_offloads = port_in->tx_offloads;
 
 		strm[s].output_port.id = port_out->id;
-		strm[s].output_port.rx_queue_id = q_id;
-		strm[s].output_port.tx_queue_id = q_id;
+		strm[s].output_port.rx_queue_id = (q_id < port_out->n_rx_queue) ? q_id : QUEUEID_MAX;
+		strm[s].output_port.tx_queue_id = q_id % port_out->n_tx_queue;
+		strm[s].output_port.reta_size = port_out->reta_size;
+		strm[s].output_port.nb_rx_queues = port_out->n_rx_queue;
+		strm[s].output_port.vring = (uint16_t)port_drv_is_vring(port_out->drv);
+		strm[s].output_port.tx_offloads = port_out->tx_offloads;
+
+		/* RX queues of the output port are read by the software RSS cores */
+		if (g_app_config.num_dist_cores != 0)
+			strm[s].output_port.rx_queue_id = QUEUEID_MAX;
 
 		q_id++;
 	}
@@ -366,187 +761,1883 @@ fwd_stream_conf(struct port_params *port_in, struct port_params *port_out,
 
 
 
-static void port_print_info(struct port_params *port);
-
 /*
- * The main function, where everything comes to life
+ * When the port has fewer TX queues than there are streams, queue q is owned by
+ * stream q, the streams q + n_tx_queue, q + 2 * n_tx_queue, ... pass their frames
+ * to it through a lock-free multi-producer/single-consumer ring.
  */
-int
-main(int argc, char *argv[])
+static int
+port_tx_share_conf(struct port_params *port, struct fwd_stream *strm,
+	unsigned int n_stream)
 {
-	int main_ret, r;
-	unsigned n;
-	unsigned main_run, main_id;
-	unsigned num_ports;
-	portid_t port_id;
-	struct rte_mempool *mb_pool = NULL;
-
+	char name[RTE_RING_NAMESIZE];
+	struct streaming_port *sp;
+	struct rte_ring *ring;
+	unsigned int q, s;
+
+
+	if (port->n_tx_queue >= n_stream)
+		return 0;
+
+	for (q = QUEUE_INITIAL_IDX; q < port->n_tx_queue; q++) {
+		snprintf(name, sizeof(name), TX_SHARE_RING_NAME_PREFIX "_%hu_%u", port->id, q);
+		ring = rte_ring_create(name, TX_SHARE_RING_SIZE,
+			rte_eth_dev_socket_id(port->id), RING_F_SC_DEQ);
+		if (ring == NULL) {
+			fprintf(stderr, "Failed to create ring '%s': %s\n", name,
+				rte_strerror(rte_errno));
+			return -1;
+		}
 
-	/* Added to avoid EAL initialization when only the help message is printed.
-	 */
-	if (print_app_args(argv) != 0) {
-		exit(EXIT_SUCCESS);
+		for (s = q; s < n_stream; s += port->n_tx_queue) {
+			sp = (strm[s].input_port.id == port->id) ?
+				&strm[s].input_port : &strm[s].output_port;
+			if (s == q)
+				sp->tx_drain_ring = ring;
+			else
+				sp->tx_ring = ring;
+		}
 	}
 
-	main_ret = EXIT_FAILURE;
-
-	signal(SIGINT, signal_handler);
-	signal(SIGTERM, signal_handler);
+	if (g_app_config.print != 0)
+		printf("Port %hu: %hu TX queue(s) shared by %u cores\n", port->id,
+			port->n_tx_queue, n_stream);
 
-	/* Initializion the Environment Abstraction Layer (EAL) */
-	rte_errno = 0;
-	r = rte_eal_init(argc, argv);
-	if (r < 0)
-		rte_exit(EXIT_FAILURE, "Invalid EAL parameters\n");
-	argc -= r;
-	argv += r;
+	return 0;
+}
 
-	num_ports = rte_eth_dev_count_avail();
-	if (num_ports != NUM_SUPPORTED_PORTS)
-		rte_exit(EXIT_FAILURE, "Error: expected two ports (=%u) to run!\n", num_ports);
 
-	/*
-	 * EAL modifies argv array. It stripes all the EAL command-line args out,
-	 * from argv[1] to separator '--' inclusive.
-	 */
-	if (argc > 1)
-		do_args_parse(argc, argv, &g_app_config);
+/*
+ * Create one ring per stream, used to pass MPLS frames to the stream's worker
+ * from other cores. Only the owning worker dequeues from the ring.
+ */
+static struct rte_ring**
+fwd_pop_rings_create(char const *prefix, struct fwd_stream *strm, unsigned int n_stream,
+	int socket_id, unsigned int single_producer)
+{
+	char name[RTE_RING_NAMESIZE];
+	struct rte_ring **rings;
+	unsigned int s, flags;
 
-	if (g_app_config.print != 0)
-		printf("Initializing ...\n");
 
-	/*
-	 * Verify the validity of the cores and recalculate the total number of
-	 * valid cores. Must be done before setting up the ports.
-	 */
-	if (g_app_config.num_cores == 0) {
-		g_app_config.cores[0] = rte_get_main_lcore();
-		g_app_config.num_cores = 1;
-	} else {
-		unsigned valid = 0;
+	rings = rte_zmalloc("pop_rings", n_stream * sizeof(*rings), 0);
+	if (rings == NULL) {
+		fprintf(stderr, "Error %i: Failed to allocate memory for rings!\n", ENOMEM);
+		return NULL;
+	}
 
-		for (n = 0; n < g_app_config.num_cores &&
-			n < RTE_DIM(g_app_config.cores); n++) {
+	flags = RING_F_SC_DEQ;
+	if (single_producer)
+		flags |= RING_F_SP_ENQ;
 
-			if (rte_lcore_is_enabled(g_app_config.cores[n]) == 0) {
-				fprintf(stderr, "Warning: core %u not enabled (and SKIPPED)!\n",
-					g_app_config.cores[n]);
-				continue;
+	for (s = 0; s < n_stream; s++) {
+		snprintf(name, sizeof(name), "%s_%u", prefix, s);
+		rings[s] = rte_ring_create(name, DIST_RING_SIZE, socket_id, flags);
+		if (rings[s] == NULL) {
+			fprintf(stderr, "Failed to create ring '%s': %s\n", name,
+				rte_strerror(rte_errno));
+			while (s-- > 0) {
+				rte_ring_free(rings[s]);
+				strm[s].pop_ring = NULL;
 			}
-			g_app_config.cores[valid] = g_app_config.cores[n];
-			valid++;
-		}
-		g_app_config.num_cores = valid;
-
-		if (g_app_config.num_cores == 0) {
-			fprintf(stderr, "Error: none of the requested cores are available!\n");
-			goto __exit_error;
-		}
-	}
-	if (g_app_config.print != 0) {
-		printf("Number of available execution units: %u\n"
-		       "Number of processing cores: %u\n",
-		       rte_lcore_count(), g_app_config.num_cores);
-		for (n = 0; n < g_app_config.num_cores; n++) {
-			printf("  core %u: phy-socket=%u\n", g_app_config.cores[n],
-				rte_lcore_to_socket_id(g_app_config.cores[n]));
+			rte_free(rings);
+			return NULL;
 		}
+		strm[s].pop_ring = rings[s];
 	}
 
-	g_lcore_stream = fwd_stream_alloc(g_app_config.num_cores);
-	if (g_lcore_stream == NULL)
-		goto __exit_error;
+	return rings;
+}
 
 
-	/* Set input/output ports.
-	 * If the input port is not explicitly specified on the command line,
-	 * the first port returned by DPDK is used for inbound traffic.
-	 */
-	if (g_app_config.mpls_in_port != PORTID_MAX) {
-		if (port_params_init(&g_ports[PORT_INGRESS], g_app_config.mpls_in_port,
-		    PORT_INGRESS, g_app_config.num_cores) != 0)
-			goto __exit_error;
-	}
+/*
+ * Analytics mirror: one ring per stream, the worker is the only producer and
+ * a secondary process the consumer (see mp_info.h).
+ */
+static int
+fwd_mirror_conf(struct fwd_stream *strm, unsigned int n_stream)
+{
+	char name[RTE_RING_NAMESIZE];
+	unsigned int s;
 
-	RTE_ETH_FOREACH_DEV(port_id) {
-		if (g_ports[PORT_INGRESS].id == port_id) {
-			continue;
+	for (s = 0; s < n_stream; s++) {
+		snprintf(name, sizeof(name), MP_INFO_MIRROR_RING_PREFIX "_%u", s);
+		strm[s].mirror_ring = rte_ring_create(name, g_app_config.mirror_ring_size,
+			rte_lcore_to_socket_id(g_app_config.cores[s]),
+			RING_F_SP_ENQ | RING_F_SC_DEQ);
+		if (strm[s].mirror_ring == NULL) {
+			fprintf(stderr, "Failed to create ring '%s': %s\n", name,
+				rte_strerror(rte_errno));
+			return -1;
 		}
+		strm[s].mirror_dirs = g_app_config.mirror_dirs;
+		strm[s].mirror_first = g_app_config.mirror_first;
+		strm[s].mirror_last = g_app_config.mirror_last;
+	}
 
-		if (g_ports[PORT_INGRESS].id == PORTID_MAX) {
-			if (port_params_init(&g_ports[PORT_INGRESS], port_id,
-			    PORT_INGRESS, g_app_config.num_cores) != 0)
-				goto __exit_error;
-			continue;
-		}
+	return 0;
+}
 
-		if (g_ports[PORT_EGRESS].id == PORTID_MAX) {
-			if (port_params_init(&g_ports[PORT_EGRESS], port_id,
-			    PORT_EGRESS, g_app_config.num_cores) != 0)
-				goto __exit_error;
-		}
-	}
 
-	/* init_mem_pool() must be called after port_params_init()
-	 */
-	mb_pool = init_mem_pool(g_app_config.num_cores, rte_socket_id());
-	if (mb_pool == NULL) {
-		goto __exit_error;
+/*
+ * Indirect mbufs attached to the payload of the IPv4 fragments and of the TSO
+ * segments, while they wait in the TX queues (or rings) of the output port.
+ * Created once, for the first feature needing it.
+ */
+static int
+frag_pool_create(struct port_params *port_out, unsigned int n_stream)
+{
+	unsigned int n_mbufs;
+
+	if (g_frag_pool != NULL)
+		return 0;
+
+	n_mbufs = port_out->n_tx_queue_desc * port_out->n_tx_queue +
+		(MAX_PKT_BURST * FWD_FRAG_MAX + FWD_GSO_MAX + MEMPOOL_CACHE_SIZE) * n_stream;
+	if (port_out->n_tx_queue < n_stream)
+		n_mbufs += TX_SHARE_RING_SIZE * port_out->n_tx_queue;
+	if (g_app_config.mirror_dirs != 0)
+		n_mbufs += g_app_config.mirror_ring_size * n_stream;
+
+	g_frag_pool = rte_pktmbuf_pool_create(FRAG_POOL_NAME, n_mbufs,
+		MEMPOOL_CACHE_SIZE, 0, 0, rte_eth_dev_socket_id(port_out->id));
+	if (g_frag_pool == NULL) {
+		fprintf(stderr, "Failed to create mbufs pool '%s': %s\n",
+			FRAG_POOL_NAME, rte_strerror(rte_errno));
+		return -1;
 	}
 
-	for (n = 0; n < RTE_DIM(g_ports); n++) {
-		if (port_queue_allocate(&g_ports[n], mb_pool, g_app_config.num_cores) < 0)
-			goto __exit_error;
-	}
+	return 0;
+}
 
-	if (fwd_stream_conf(&g_ports[PORT_INGRESS], &g_ports[PORT_EGRESS],
-		g_lcore_stream, g_app_config.num_cores) != 0)
-		goto __exit_error;
 
+/*
+ * MTU check of the pushed frames. The limit is the MTU of the output port (once
+ * raised for the encapsulation or the segment lists). The fragments of IPv4
+ * packets are sent as chained mbufs, without that offload the packets go to
+ * the slow path like the IPv6 ones. One slow path ring per stream, the worker
+ * is the only producer and a secondary process the consumer (see mp_info.h).
+ */
+static int
+fwd_mtu_conf(struct port_params *port_out, struct fwd_stream *strm, unsigned int n_stream)
+{
+	char name[RTE_RING_NAMESIZE];
+	unsigned int s, n;
+	uint16_t mtu, hdr_max;
+	int r;
 
-	for (n = 0; n < RTE_DIM(g_ports); n++) {
-		r = rte_eth_dev_start(g_ports[n].id);
-		if (r < 0) {
-			fprintf(stderr, "rte_eth_dev_start(port=%u) error=%d\n", g_ports[n].id, r);
-			goto __exit_error;
-		}
+	r = rte_eth_dev_get_mtu(port_out->id, &mtu);
+	if (r != 0) {
+		fprintf(stderr, "Error: cannot get the MTU of port %hu: %s\n", port_out->id,
+			rte_strerror(-r));
+		return -1;
+	}
 
-		r = rte_eth_promiscuous_enable(g_ports[n].id);
-		if (r != 0) {
-			fprintf(stderr, "Error: rte_eth_promiscuous_enable failed (port=%u) : %s\n",
-				g_ports[n].id, rte_strerror(-r));
-		}
+	hdr_max = MPLS_HDR_LEN;
+	if (g_app_config.encap.type != ENCAP_NONE)
+		hdr_max = g_encap.len;
+	for (n = 0; n < g_app_config.num_fec_rules; n++)
+		hdr_max = RTE_MAX(hdr_max, (uint16_t)(g_app_config.fec_rules[n].n_labels *
+			MPLS_HDR_LEN));
 
-		if (g_app_config.print != 0)
-			port_print_info(&g_ports[n]);
+	if (port_out->tx_offloads & RTE_ETH_TX_OFFLOAD_MULTI_SEGS) {
+		if (frag_pool_create(port_out, n_stream) != 0)
+			return -1;
+	} else {
+		fprintf(stderr, "Warning: port %hu can't send chained mbufs, IPv4 packets "
+			"over the MTU won't be fragmented\n", port_out->id);
 	}
 
+	for (s = 0; s < n_stream; s++) {
+		strm[s].out_mtu = mtu;
+		strm[s].push_hdr_max = hdr_max;
+		strm[s].frag_direct_pool = g_mb_pool;
+		strm[s].frag_indirect_pool = g_frag_pool;
 
-	/* Run the worker on each user-specified core, otherwise when the list of cores
-	 * is not given, run it on the main core.
-	 * ... hit it!
-	 */
-	main_run = 0;
-	for (n = 0; n < g_app_config.num_cores; n++) {
-		g_lcore_stream[n].print = g_app_config.print;
-
-		if (g_app_config.cores[n] == rte_get_main_lcore()) {
-			main_run = 1;
-			main_id = n;
+		if (g_app_config.slow_ring_size == 0)
 			continue;
+		snprintf(name, sizeof(name), MP_INFO_SLOW_RING_PREFIX "_%u", s);
+		strm[s].slow_ring = rte_ring_create(name, g_app_config.slow_ring_size,
+			rte_lcore_to_socket_id(g_app_config.cores[s]),
+			RING_F_SP_ENQ | RING_F_SC_DEQ);
+		if (strm[s].slow_ring == NULL) {
+			fprintf(stderr, "Failed to create ring '%s': %s\n", name,
+				rte_strerror(rte_errno));
+			return -1;
 		}
+	}
 
-		if (g_app_config.print != 0)
-			printf("Delegating processing to core %u\n", g_app_config.cores[n]);
+	if (g_app_config.print != 0)
+		printf("MTU check: port %hu MTU %hu, longest pushed header %hu bytes\n",
+			port_out->id, mtu, hdr_max);
 
-		r = rte_eal_remote_launch(fwd_worker_loop, &g_lcore_stream[n],
-			g_app_config.cores[n]);
-		if (r < 0) {
-			fprintf(stderr, "Failed to start processing function on core %u!\n"
-			                "    %s\n", g_app_config.cores[n], rte_strerror(-r));
-			goto __exit_error;
+	return 0;
+}
+
+
+/*
+ * TSO: large TCP segments of the input port are segmented by the output port,
+ * or by rte_gso when the port has no TSO - the GSO context is shared by the
+ * workers, the segment size is set for each frame.
+ */
+static int
+fwd_tso_conf(struct port_params *port_out, struct fwd_stream *strm, unsigned int n_stream)
+{
+	unsigned int s;
+	uint16_t mtu;
+	int r, sw;
+
+	r = rte_eth_dev_get_mtu(port_out->id, &mtu);
+	if (r != 0) {
+		fprintf(stderr, "Error: cannot get the MTU of port %hu: %s\n", port_out->id,
+			rte_strerror(-r));
+		return -1;
+	}
+
+	sw = !(port_out->tx_offloads & RTE_ETH_TX_OFFLOAD_TCP_TSO);
+	if (sw && !(port_out->tx_offloads & RTE_ETH_TX_OFFLOAD_MULTI_SEGS)) {
+		fprintf(stderr, "Warning: port %hu has neither TSO nor chained mbufs, large "
+			"TCP segments will be dropped\n", port_out->id);
+	} else if (sw) {
+		if (frag_pool_create(port_out, n_stream) != 0)
+			return -1;
+		g_gso_ctx.direct_pool = g_mb_pool;
+		g_gso_ctx.indirect_pool = g_frag_pool;
+		g_gso_ctx.gso_types = RTE_ETH_TX_OFFLOAD_TCP_TSO;
+		g_gso_ctx.gso_size = (uint16_t)(mtu + RTE_ETHER_HDR_LEN);
+	}
+
+	for (s = 0; s < n_stream; s++) {
+		strm[s].tso = 1;
+		strm[s].tso_mtu = mtu;
+		strm[s].gso = sw ? &g_gso_ctx : NULL;
+	}
+
+	if (g_app_config.print != 0)
+		printf("TSO: segmented by %s, port %hu MTU %hu\n",
+			sw ? "software (GSO)" : "the output port", port_out->id, mtu);
+
+	return 0;
+}
+
+
+/*
+ * Reorder stage: each distributor gets a ring the workers return the processed
+ * frames to, a reorder buffer and its own TX queue of the input port (the queues
+ * following those of the workers).
+ */
+static int
+fwd_reorder_conf(struct port_params *port_in, struct fwd_stream *strm,
+	unsigned int n_stream, struct fwd_dist *dist, unsigned int n_dist)
+{
+	char name[RTE_RING_NAMESIZE];
+	struct rte_ring **rings;
+	unsigned int s, d;
+
+
+	if (port_in->n_tx_queue < n_stream + n_dist) {
+		fprintf(stderr, "Error: reorder needs %u TX queues on port %hu, "
+			"it has %hu only\n", n_stream + n_dist, port_in->id, port_in->n_tx_queue);
+		return -1;
+	}
+
+	if (fwd_reorder_init() != 0)
+		return -1;
+
+	rings = rte_zmalloc("reorder_rings", n_dist * sizeof(*rings), 0);
+	if (rings == NULL) {
+		fprintf(stderr, "Error %i: Failed to allocate memory for rings!\n", ENOMEM);
+		return -1;
+	}
+
+	for (d = 0; d < n_dist; d++) {
+		snprintf(name, sizeof(name), REORDER_RING_NAME_PREFIX "_%u", d);
+		dist[d].ret_ring = rte_ring_create(name, REORDER_RING_SIZE,
+			rte_lcore_to_socket_id(g_app_config.dist_cores[d]), RING_F_SC_DEQ);
+		if (dist[d].ret_ring == NULL) {
+			fprintf(stderr, "Failed to create ring '%s': %s\n", name,
+				rte_strerror(rte_errno));
+			rte_free(rings);
+			return -1;
+		}
+		rings[d] = dist[d].ret_ring;
+
+		snprintf(dist[d].reorder_name, sizeof(dist[d].reorder_name),
+			REORDER_RING_NAME_PREFIX "_buf_%u", d);
+		/* The buffer itself is created by the core, see fwd_dist_loop() */
+		dist[d].reorder_size = g_app_config.reorder_size;
+		dist[d].reorder_timeout = rte_get_tsc_hz() / US_PER_S *
+			g_app_config.reorder_timeout_us;
+		dist[d].tx_port_id = port_in->id;
+		dist[d].tx_queue_id = (queueid_t)(n_stream + d);
+	}
+
+	for (s = 0; s < n_stream; s++)
+		strm[s].reorder_rings = rings;
+
+	return 0;
+}
+
+
+/*
+ * Software RSS: create one ring per worker and configure the distributor cores,
+ * each of them reads one RX queue of the output port.
+ */
+static struct fwd_dist*
+fwd_dist_conf(struct port_params *port_in, struct port_params *port_out,
+	struct fwd_stream *strm, unsigned int n_stream, unsigned int n_dist)
+{
+	struct rte_ring **rings = NULL;
+	struct fwd_dist *dist;
+	unsigned int s, d;
+
+
+	if (port_in == NULL || port_out == NULL || strm == NULL || n_stream == 0 ||
+	    n_dist == 0) {
+		fprintf(stderr, "Error: %s() invoked with invalid argument\n", __func__);
+		return NULL;
+	}
+
+	dist = rte_zmalloc("fwd_dist", n_dist * sizeof(*dist), RTE_CACHE_LINE_SIZE);
+	if (dist == NULL) {
+		fprintf(stderr, "Error %i: Failed to allocate memory for software RSS!\n",
+			ENOMEM);
+		goto __error;
+	}
+
+	/* Producers are the distributor cores */
+	rings = fwd_pop_rings_create(DIST_RING_NAME_PREFIX, strm, n_stream,
+		rte_eth_dev_socket_id(port_out->id), n_dist == 1);
+	if (rings == NULL)
+		goto __error;
+
+	for (d = 0; d < n_dist; d++) {
+		dist[d].dist_id = (uint16_t)d;
+		dist[d].port_id = port_out->id;
+		dist[d].rx_queue_id = (queueid_t)(QUEUE_INITIAL_IDX + d);
+		dist[d].hash_type = g_app_config.dist_hash;
+		dist[d].encap = g_app_config.encap.type != ENCAP_NONE ? &g_encap : NULL;
+		dist[d].reta_size = port_in->reta_size;
+		dist[d].n_queues = port_in->n_rx_queue;
+		dist[d].n_rings = (uint16_t)n_stream;
+		dist[d].rings = rings;
+		dist[d].bufs = rte_zmalloc("sw_rss_bufs", n_stream * sizeof(*dist[d].bufs),
+			RTE_CACHE_LINE_SIZE);
+		if (dist[d].bufs == NULL) {
+			fprintf(stderr, "Error %i: Failed to allocate memory for software RSS!\n",
+				ENOMEM);
+			goto __error;
+		}
+	}
+
+	if (g_app_config.reorder_size != 0 &&
+	    fwd_reorder_conf(port_in, strm, n_stream, dist, n_dist) != 0)
+		goto __error;
+
+	if (g_app_config.dist_hash == FLOW_HASH_TOEPLITZ && g_app_config.sym_rss == 0 &&
+	    n_stream > 1)
+		fprintf(stderr, "Warning: without --sym-rss, the directions of a flow "
+			"may be processed by different cores\n");
+	if (g_app_config.dist_hash == FLOW_HASH_ROUND_ROBIN && g_app_config.reorder_size == 0 &&
+	    n_stream > 1)
+		fprintf(stderr, "Warning: round-robin distribution without --reorder, "
+			"frames of a flow may be sent out of order\n");
+
+	return dist;
+
+__error:
+	if (rings != NULL) {
+		rte_free(strm[0].reorder_rings);
+		for (s = 0; s < n_stream; s++) {
+			rte_ring_free(rings[s]);
+			strm[s].pop_ring = NULL;
+			strm[s].reorder_rings = NULL;
+		}
+	}
+	if (dist != NULL) {
+		for (d = 0; d < n_dist; d++) {
+			rte_free(dist[d].bufs);
+			rte_reorder_free(dist[d].reorder);
+			rte_ring_free(dist[d].ret_ring);
+		}
+	}
+	rte_free(rings);
+	rte_free(dist);
+	return NULL;
+}
+
+
+/*
+ * Steer MPLS labels (ranges) to the cores given by the user. The rules are
+ * installed in the NIC of the output port with rte_flow; those rejected by the
+ * driver are steered in software: by the distributor cores with software RSS,
+ * otherwise by the workers, which pass the frames to the ring of the target core.
+ */
+static int
+label_steer_setup(struct port_params *port_out, struct fwd_stream *strm,
+	unsigned int n_stream, struct fwd_dist *dist, unsigned int n_dist)
+{
+	struct rte_ring **rings;
+	char const *reason = NULL;
+	unsigned int s, d;
+	int n_hw;
+
+
+	if (g_app_config.num_steer_rules == 0)
+		return 0;
+
+	if (n_dist != 0)
+		reason = "received by software RSS cores";
+	else if (g_app_config.steer_sw_only != 0)
+		reason = "software steering requested";
+
+	n_hw = label_steer_install(port_out->id, g_app_config.steer_rules,
+		g_app_config.num_steer_rules, reason, &g_steer_table);
+	if (n_hw < 0)
+		return -1;
+
+	label_steer_print();
+	if (g_steer_table.n_rules == 0)
+		return 0;
+
+	if (n_dist != 0) {
+		for (d = 0; d < n_dist; d++)
+			dist[d].steer = &g_steer_table;
+		return 0;
+	}
+
+	/* Any worker may pass a frame to any other one */
+	rings = fwd_pop_rings_create(STEER_RING_NAME_PREFIX, strm, n_stream,
+		rte_eth_dev_socket_id(port_out->id), 0);
+	if (rings == NULL)
+		return -1;
+
+	for (s = 0; s < n_stream; s++) {
+		strm[s].steer = &g_steer_table;
+		strm[s].steer_rings = rings;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Number of TX queues of the port: one per core, the software RSS cores send
+ * the reordered frames on their own queues of the input port.
+ */
+static unsigned int
+port_tx_queue_num(enum port_role role)
+{
+	if (role == PORT_INGRESS && g_app_config.reorder_size != 0)
+		return g_app_config.num_cores + g_app_config.num_dist_cores;
+
+	return g_app_config.num_cores;
+}
+
+
+/*
+ * Number of RX queues of the port: one per core, unless the MPLS frames are
+ * received by the software RSS cores.
+ */
+static unsigned int
+port_rx_queue_num(enum port_role role)
+{
+	if (role == PORT_EGRESS && g_app_config.num_dist_cores != 0)
+		return g_app_config.num_dist_cores;
+
+	return g_app_config.num_cores;
+}
+
+
+/* ************************************************************************** */
+/* Automatic core selection (--auto-cores)                                    */
+
+static int
+sysfs_read_int(char const *path, int *val)
+{
+	FILE *f;
+	int r;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	r = fscanf(f, "%d", val);
+	fclose(f);
+
+	return r == 1 ? 0 : -1;
+}
+
+
+/*
+ * Identifier of the physical core the lcore runs on (SMT siblings share it), or
+ * -1 when the topology is unknown.
+ */
+static int
+lcore_phys_core(unsigned int lcore)
+{
+	char path[PATH_MAX];
+	int cpu, pkg, core;
+
+	cpu = rte_lcore_to_cpu_id((int)lcore);
+	if (cpu < 0)
+		return -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+	if (sysfs_read_int(path, &core) != 0)
+		return -1;
+	snprintf(path, sizeof(path),
+		"/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+	if (sysfs_read_int(path, &pkg) != 0)
+		pkg = 0;
+
+	return (pkg << 16) | (core & 0xffff);
+}
+
+
+/*
+ * The socket the cores are chosen on: the one of the input port, of the output
+ * port when the first is a virtual device, or of the main core.
+ */
+static int
+auto_cores_socket(void)
+{
+	int socket = SOCKET_ID_ANY, s;
+	portid_t port_id;
+
+	if (g_app_config.mpls_in_port != PORTID_MAX)
+		socket = rte_eth_dev_socket_id(g_app_config.mpls_in_port);
+
+	RTE_ETH_FOREACH_DEV(port_id) {
+		s = rte_eth_dev_socket_id(port_id);
+		if (s < 0)
+			continue;
+		if (socket < 0)
+			socket = s;
+		else if (s != socket)
+			fprintf(stderr, "Warning: the ports are on sockets %d and %d, cores "
+				"are chosen on socket %d\n", socket, s, socket);
+	}
+
+	if (socket < 0)
+		socket = (int)rte_lcore_to_socket_id(rte_get_main_lcore());
+
+	return socket;
+}
+
+
+/*
+ * Fill the core list with enabled worker cores of the ports' socket. A physical
+ * core is used once: SMT siblings of the main core, of the software RSS cores
+ * and of the cores already chosen are skipped. Fewer cores are used (with a
+ * warning) rather than cores of a remote socket. The n-th chosen core owns the
+ * n-th queues, as with --core-list.
+ */
+static void
+auto_cores_select(void)
+{
+	int phys_used[RTE_MAX_LCORE];
+	unsigned int n_phys = 0, lcore, n, i;
+	int socket, phys;
+
+
+	socket = auto_cores_socket();
+
+	phys_used[n_phys++] = lcore_phys_core(rte_get_main_lcore());
+	for (n = 0; n < g_app_config.num_dist_cores; n++)
+		phys_used[n_phys++] = lcore_phys_core(g_app_config.dist_cores[n]);
+
+	g_app_config.num_cores = 0;
+	RTE_LCORE_FOREACH_WORKER(lcore) {
+		if (g_app_config.num_cores == g_app_config.auto_cores)
+			break;
+		if ((int)rte_lcore_to_socket_id(lcore) != socket)
+			continue;
+
+		for (n = 0; n < g_app_config.num_dist_cores; n++) {
+			if (g_app_config.dist_cores[n] == lcore)
+				break;
+		}
+		if (n != g_app_config.num_dist_cores)
+			continue;
+
+		phys = lcore_phys_core(lcore);
+		for (i = 0; phys >= 0 && i < n_phys; i++) {
+			if (phys_used[i] == phys)
+				break;
+		}
+		if (phys >= 0 && i != n_phys)
+			continue;
+
+		phys_used[n_phys++] = phys;
+		g_app_config.cores[g_app_config.num_cores++] = lcore;
+	}
+
+	if (g_app_config.num_cores < g_app_config.auto_cores)
+		fprintf(stderr, "Warning: %u core(s) requested, %u physical core(s) "
+			"available on socket %d\n", g_app_config.auto_cores,
+			g_app_config.num_cores, socket);
+
+	printf("Cores chosen on socket %d:", socket);
+	for (n = 0; n < g_app_config.num_cores; n++)
+		printf(" %u", g_app_config.cores[n]);
+	printf("%s\n", g_app_config.num_cores == 0 ? " none, the main core is used" : "");
+}
+
+
+/* ************************************************************************** */
+/* Startup: ports set up in parallel, timing breakdown                        */
+
+/* Steps of the startup, timed when --gabby is given */
+enum startup_step {
+	STARTUP_BEGIN = 0,
+	STARTUP_EAL,           /* EAL: hugepages, device probe */
+	STARTUP_ARGS,          /* arguments, takeover of the ports, core checks */
+	STARTUP_PORT_CONF,     /* device configuration */
+	STARTUP_MEMPOOL,
+	STARTUP_PORT_START,    /* queue setup, device start */
+	STARTUP_ENGINE,        /* streams, rings, label steering */
+	STARTUP_PREFAULT,      /* --prefault */
+	STARTUP_CORES,         /* cores launched, their tables built */
+	STARTUP_NUM_STEPS,
+};
+
+static const char * const startup_step_name[STARTUP_NUM_STEPS] = {
+	[STARTUP_EAL] = "EAL init",
+	[STARTUP_ARGS] = "arguments",
+	[STARTUP_PORT_CONF] = "port configuration",
+	[STARTUP_MEMPOOL] = "mbuf pool",
+	[STARTUP_PORT_START] = "port start",
+	[STARTUP_ENGINE] = "forwarding setup",
+	[STARTUP_PREFAULT] = "prefault",
+	[STARTUP_CORES] = "cores ready",
+};
+
+static uint64_t g_startup_tsc[STARTUP_NUM_STEPS];
+
+/* A port set up by the main core or by a (not yet used) worker core */
+static struct port_job {
+	struct port_params *port;
+	portid_t port_id;
+	enum port_role role;
+	unsigned int lcore;
+	uint64_t conf_tsc;
+	uint64_t start_tsc;
+	int ret;
+} g_port_jobs[NUM_SUPPORTED_PORTS];
+
+
+static inline void
+startup_mark(enum startup_step step)
+{
+	g_startup_tsc[step] = rte_get_tsc_cycles();
+}
+
+
+static int
+port_job_conf(void *arg)
+{
+	struct port_job *job = arg;
+	uint64_t tsc = rte_get_tsc_cycles();
+
+	job->ret = port_params_init(job->port, job->port_id, job->role,
+		port_rx_queue_num(job->role), port_tx_queue_num(job->role));
+	job->conf_tsc = rte_get_tsc_cycles() - tsc;
+	return job->ret;
+}
+
+
+static int
+port_job_start(void *arg)
+{
+	struct port_job *job = arg;
+	uint64_t tsc = rte_get_tsc_cycles();
+
+	job->ret = port_queue_allocate(job->port, g_mb_pool);
+	if (job->ret == 0)
+		job->ret = port_start(job->port);
+	job->start_tsc = rte_get_tsc_cycles() - tsc;
+	return job->ret;
+}
+
+
+/*
+ * Assign the ports to the main core and the first worker cores (they don't run
+ * anything yet). Ports of one device (e.g. two ports of a NIC) share the adapter
+ * and are set up one by one, as well as when there are no worker cores.
+ * Returns the number of ports set up in parallel with the first one.
+ */
+static unsigned int
+port_jobs_assign(portid_t const *port_ids, unsigned int n_ports)
+{
+	struct rte_eth_dev_info info_a, info_b;
+	unsigned int n, lcore, n_par = 0;
+
+
+	lcore = rte_get_main_lcore();
+	for (n = 0; n < n_ports; n++) {
+		g_port_jobs[n].port = &g_ports[n];
+		g_port_jobs[n].port_id = port_ids[n];
+		g_port_jobs[n].role = (enum port_role)n;
+		g_port_jobs[n].lcore = rte_get_main_lcore();
+		if (n == 0)
+			continue;
+
+		if (rte_eth_dev_info_get(port_ids[0], &info_a) != 0 ||
+		    rte_eth_dev_info_get(port_ids[n], &info_b) != 0 ||
+		    info_a.device == info_b.device)
+			continue;
+
+		lcore = rte_get_next_lcore(lcore, 1, 0);
+		if (lcore >= RTE_MAX_LCORE)
+			break;
+		g_port_jobs[n].lcore = lcore;
+		n_par++;
+	}
+
+	return n_par;
+}
+
+
+/*
+ * Run the job for all ports: on the assigned worker cores in parallel, the rest
+ * on the main core.
+ */
+static int
+port_jobs_run(lcore_function_t *job_fn)
+{
+	unsigned int n;
+	int r, ret = 0;
+
+
+	for (n = 0; n < RTE_DIM(g_port_jobs); n++) {
+		g_port_jobs[n].ret = -1;
+		if (g_port_jobs[n].lcore == rte_get_main_lcore())
+			continue;
+		r = rte_eal_remote_launch(job_fn, &g_port_jobs[n], g_port_jobs[n].lcore);
+		if (r < 0) {
+			/* Busy or lost: done by the main core */
+			g_port_jobs[n].lcore = rte_get_main_lcore();
+		}
+	}
+
+	for (n = 0; n < RTE_DIM(g_port_jobs); n++) {
+		if (g_port_jobs[n].lcore == rte_get_main_lcore())
+			job_fn(&g_port_jobs[n]);
+	}
+
+	for (n = 0; n < RTE_DIM(g_port_jobs); n++) {
+		if (g_port_jobs[n].lcore != rte_get_main_lcore())
+			rte_eal_wait_lcore(g_port_jobs[n].lcore);
+		if (g_port_jobs[n].ret != 0)
+			ret = -1;
+	}
+
+	return ret;
+}
+
+
+/*
+ * Wait (bounded) until the launched cores have built their tables and forward
+ * packets, so the startup time includes them.
+ */
+static void
+startup_cores_wait(unsigned int n_cores)
+{
+	uint64_t deadline;
+
+	deadline = rte_get_tsc_cycles() + rte_get_tsc_hz() / MS_PER_S * STARTUP_READY_TIMEOUT_MS;
+	while (fwd_engine_cores_ready() < n_cores && rte_get_tsc_cycles() < deadline)
+		rte_delay_us_sleep(100);
+}
+
+
+static void
+startup_print(void)
+{
+	uint64_t hz = rte_get_tsc_hz();
+	uint64_t ms;
+	unsigned int s, n;
+
+	printf("Startup time:\n");
+	for (s = STARTUP_EAL; s < STARTUP_NUM_STEPS; s++) {
+		ms = (g_startup_tsc[s] - g_startup_tsc[s - 1]) * MS_PER_S / hz;
+		printf("  %-20s %6"PRIu64" ms\n", startup_step_name[s], ms);
+		if (s != STARTUP_PORT_CONF && s != STARTUP_PORT_START)
+			continue;
+
+		for (n = 0; n < RTE_DIM(g_port_jobs); n++) {
+			ms = (s == STARTUP_PORT_CONF ? g_port_jobs[n].conf_tsc :
+				g_port_jobs[n].start_tsc) * MS_PER_S / hz;
+			printf("    port %hu (core %u) %6"PRIu64" ms\n", g_port_jobs[n].port_id,
+				g_port_jobs[n].lcore, ms);
+		}
+	}
+	ms = (g_startup_tsc[STARTUP_NUM_STEPS - 1] - g_startup_tsc[STARTUP_BEGIN]) *
+		MS_PER_S / hz;
+	printf("  %-20s %6"PRIu64" ms\n", "total", ms);
+}
+
+
+/* ************************************************************************** */
+/* Hugepage memory: prefault and usage report                                 */
+
+enum mem_component {
+	MEM_MEMPOOL = 0,
+	MEM_RING,
+	MEM_MEMZONE,        /* other memzones: NIC queues, ... */
+	MEM_TABLE,
+	MEM_COUNTER,
+	MEM_OTHER,          /* the rest of the heap used by DPDK */
+	MEM_NUM_COMPONENTS,
+};
+
+static const char * const mem_component_name[MEM_NUM_COMPONENTS] = {
+	[MEM_MEMPOOL] = "mbuf pools",
+	[MEM_RING] = "rings",
+	[MEM_MEMZONE] = "NIC queues, other zones",
+	[MEM_TABLE] = "tables",
+	[MEM_COUNTER] = "streams, counters",
+	[MEM_OTHER] = "other (DPDK)",
+};
+
+static size_t g_mem_usage[RTE_MAX_NUMA_NODES][MEM_NUM_COMPONENTS];
+
+
+/*
+ * Read one byte of every page of the memzone, so the first frames don't take
+ * page faults. Mbuf pools and rings are memzones; the tables are zeroed when
+ * allocated. Reading is enough to map the page and is safe while the NIC writes.
+ */
+static void
+mem_prefault_memzone(const struct rte_memzone *mz, void *arg)
+{
+	volatile uint8_t const *p = mz->addr;
+	uint64_t *n_pages = arg;
+	size_t off, step;
+
+	step = mz->hugepage_sz != 0 ? mz->hugepage_sz : RTE_PGSIZE_4K;
+	for (off = 0; off < mz->len; off += step)
+		(void)p[off];
+	*n_pages += (mz->len + step - 1) / step;
+}
+
+
+static void
+mem_prefault(void)
+{
+	uint64_t n_pages = 0;
+
+	rte_memzone_walk(mem_prefault_memzone, &n_pages);
+	if (g_app_config.print != 0)
+		printf("Prefaulted %"PRIu64" page(s)\n", n_pages);
+}
+
+
+static void
+mem_account_memzone(const struct rte_memzone *mz, void *arg __rte_unused)
+{
+	enum mem_component c = MEM_MEMZONE;
+
+	if (mz->socket_id < 0 || mz->socket_id >= RTE_MAX_NUMA_NODES)
+		return;
+
+	if (strncmp(mz->name, RTE_MEMPOOL_MZ_PREFIX, strlen(RTE_MEMPOOL_MZ_PREFIX)) == 0)
+		c = MEM_MEMPOOL;
+	else if (strncmp(mz->name, RTE_RING_MZ_PREFIX, strlen(RTE_RING_MZ_PREFIX)) == 0)
+		c = MEM_RING;
+	g_mem_usage[mz->socket_id][c] += mz->len;
+}
+
+
+/* Memory allocated with rte_malloc() by the forwarder */
+static void
+mem_account_malloc(void const *ptr, enum mem_component c)
+{
+	struct rte_memseg_list *msl;
+	size_t size;
+
+	if (ptr == NULL || rte_malloc_validate(ptr, &size) != 0)
+		return;
+
+	msl = rte_mem_virt2memseg_list(ptr);
+	if (msl == NULL || msl->socket_id < 0 || msl->socket_id >= RTE_MAX_NUMA_NODES)
+		return;
+	g_mem_usage[msl->socket_id][c] += size;
+}
+
+
+/*
+ * Print the hugepage memory reserved and used on each socket, split by component.
+ * The reorder buffers are built by the cores: call it when they are running.
+ */
+static void
+mem_report_print(void)
+{
+	struct rte_malloc_socket_stats st;
+	unsigned int i, n, c;
+	size_t known;
+	int socket;
+
+
+	memset(g_mem_usage, 0, sizeof(g_mem_usage));
+	rte_memzone_walk(mem_account_memzone, NULL);
+
+	mem_account_malloc(g_lcore_stream, MEM_COUNTER);
+	mem_account_malloc(g_dist, MEM_COUNTER);
+	if (g_lcore_stream != NULL) {
+		mem_account_malloc(g_lcore_stream[0].steer_rings, MEM_TABLE);
+		mem_account_malloc(g_lcore_stream[0].reorder_rings, MEM_TABLE);
+	}
+	for (n = 0; g_dist != NULL && n < g_app_config.num_dist_cores; n++) {
+		mem_account_malloc(g_dist[n].bufs, MEM_TABLE);
+		mem_account_malloc(g_dist[n].reorder, MEM_TABLE);
+	}
+	if (g_dist != NULL)
+		mem_account_malloc(g_dist[0].rings, MEM_TABLE);
+
+	printf("Hugepage memory:\n");
+	for (i = 0; i < rte_socket_count(); i++) {
+		socket = rte_socket_id_by_idx(i);
+		if (socket < 0 || socket >= RTE_MAX_NUMA_NODES ||
+		    rte_malloc_get_socket_stats(socket, &st) != 0 || st.heap_totalsz_bytes == 0)
+			continue;
+
+		known = 0;
+		for (c = 0; c < MEM_OTHER; c++)
+			known += g_mem_usage[socket][c];
+		g_mem_usage[socket][MEM_OTHER] = st.heap_allocsz_bytes > known ?
+			st.heap_allocsz_bytes - known : 0;
+
+		printf("  socket %d: reserved %zu kB, used %zu kB, free %zu kB\n", socket,
+			st.heap_totalsz_bytes / 1024, st.heap_allocsz_bytes / 1024,
+			st.heap_freesz_bytes / 1024);
+		for (c = 0; c < MEM_NUM_COMPONENTS; c++) {
+			if (g_mem_usage[socket][c] != 0)
+				printf("    %-24s %10zu kB\n", mem_component_name[c],
+					g_mem_usage[socket][c] / 1024);
+		}
+	}
+}
+
+
+/* ************************************************************************** */
+/* Port events: link state change, device reset and removal                   */
+
+static void port_event_handle(void *arg);
+static void port_attach_retry(void *arg);
+
+
+static struct port_params*
+port_by_id(portid_t port_id)
+{
+	unsigned int n;
+
+	for (n = 0; n < RTE_DIM(g_ports); n++) {
+		if (g_ports[n].id == port_id && g_ports[n].detached == 0)
+			return &g_ports[n];
+	}
+	return NULL;
+}
+
+
+static inline uint64_t
+tsc_to_us(uint64_t tsc)
+{
+	return tsc * US_PER_S / rte_get_tsc_hz();
+}
+
+
+/*
+ * Runs in the EAL interrupt thread. The port must not be stopped or closed
+ * here, the event is handled by an alarm.
+ */
+static int
+port_event_callback(portid_t port_id, enum rte_eth_event_type type, void *param,
+	void *ret_param)
+{
+	struct port_params *port = port_by_id(port_id);
+
+	RTE_SET_USED(param);
+	RTE_SET_USED(ret_param);
+
+	if (port == NULL)
+		return 0;
+
+	if (port->events == 0)
+		port->event_tsc = rte_rdtsc();
+	port->events |= RTE_BIT32(type);
+
+	if (rte_eal_alarm_set(PORT_EVENT_DELAY_US, port_event_handle, port) != 0)
+		fprintf(stderr, "Port %hu: cannot schedule handling of event %d\n",
+			port_id, type);
+
+	return 0;
+}
+
+
+static const enum rte_eth_event_type port_event_types[] = {
+	RTE_ETH_EVENT_INTR_LSC,
+	RTE_ETH_EVENT_INTR_RESET,
+	RTE_ETH_EVENT_INTR_RMV,
+};
+
+static int
+port_events_register(struct port_params *port)
+{
+	unsigned int e;
+	int r;
+
+	for (e = 0; e < RTE_DIM(port_event_types); e++) {
+		r = rte_eth_dev_callback_register(port->id, port_event_types[e],
+			port_event_callback, NULL);
+		if (r != 0) {
+			fprintf(stderr, "Port %hu: cannot register callback of event %d: %s\n",
+				port->id, port_event_types[e], rte_strerror(-r));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+static void
+port_events_unregister(struct port_params *port)
+{
+	unsigned int e;
+
+	for (e = 0; e < RTE_DIM(port_event_types); e++)
+		rte_eth_dev_callback_unregister(port->id, port_event_types[e],
+			port_event_callback, NULL);
+}
+
+
+/*
+ * Pause all forwarding cores, so that the port can be stopped. A core which
+ * doesn't stop in time is likely stuck in the driver of a removed device.
+ */
+static int
+port_event_pause(struct port_params *port)
+{
+	if (fwd_engine_pause(g_lcore_stream, g_app_config.num_cores, g_dist,
+	    g_app_config.num_dist_cores, PORT_PAUSE_TIMEOUT_MS) != 0) {
+		fprintf(stderr, "Port %hu: forwarding cores didn't pause in %u ms\n",
+			port->id, PORT_PAUSE_TIMEOUT_MS);
+		return -1;
+	}
+
+	if (port->role == PORT_EGRESS)
+		label_steer_suspend();
+	return 0;
+}
+
+
+static void
+port_event_resume(struct port_params *port)
+{
+	uint64_t us;
+
+	if (port->role == PORT_EGRESS)
+		label_steer_resume(port->id);
+
+	fwd_engine_resume(g_lcore_stream, g_app_config.num_cores, g_dist,
+		g_app_config.num_dist_cores);
+
+	us = tsc_to_us(rte_rdtsc() - port->event_tsc);
+	port->ev_stats.last_recovery_us = us;
+	port->ev_stats.max_recovery_us = RTE_MAX(port->ev_stats.max_recovery_us, us);
+	printf("Port %hu: forwarding resumed after %"PRIu64" us\n", port->id, us);
+}
+
+
+/*
+ * Configure the (reset or newly probed) device as before and start it. The queue
+ * layout must not change, since the streams are bound to the queues. On failure
+ * the port is left stopped, with its id, role and queue layout, so the setup
+ * can be tried again.
+ */
+static int
+port_setup(struct port_params *port, portid_t port_id)
+{
+	uint16_t n_rxq = port->n_rx_queue, n_txq = port->n_tx_queue;
+	enum port_role role = port->role;
+
+	port->id = PORTID_MAX;
+	port->role = PORT_UNUSED;
+	if (port_params_init(port, port_id, role, port_rx_queue_num(role),
+	    port_tx_queue_num(role)) != 0)
+		goto __error;
+
+	if (port->n_rx_queue != n_rxq || port->n_tx_queue != n_txq) {
+		fprintf(stderr, "Port %hu: the device has %hu/%hu RX/TX queues now "
+			"instead of %hu/%hu, restart required\n", port->id,
+			port->n_rx_queue, port->n_tx_queue, n_rxq, n_txq);
+		goto __error;
+	}
+
+	if (port_queue_allocate(port, g_mb_pool) != 0 || port_start(port) != 0)
+		goto __error;
+
+	return 0;
+
+__error:
+	rte_eth_dev_stop(port_id);
+	port->id = port_id;
+	port->role = role;
+	port->n_rx_queue = n_rxq;
+	port->n_tx_queue = n_txq;
+	return -1;
+}
+
+
+/*
+ * The event could not be handled: it's handled again later. The cores are
+ * not paused meanwhile, a port which is stopped or gone doesn't receive and
+ * drops what is sent to it.
+ */
+static void
+port_event_retry(struct port_params *port, enum rte_eth_event_type type)
+{
+	port->ev_stats.fail++;
+	port->events |= RTE_BIT32(type);
+	if (rte_eal_alarm_set(PORT_EVENT_RETRY_US, port_event_handle, port) != 0)
+		fprintf(stderr, "Port %hu: cannot schedule handling of event %d, "
+			"forwarding continues without the port\n", port->id, type);
+}
+
+
+/*
+ * The port id of a device probed again may be different: update the streams and
+ * the software RSS cores (all of them are paused).
+ */
+static void
+port_id_update(portid_t old_id, portid_t new_id)
+{
+	unsigned int n;
+
+	for (n = 0; n < g_app_config.num_cores; n++) {
+		if (g_lcore_stream[n].input_port.id == old_id)
+			g_lcore_stream[n].input_port.id = new_id;
+		if (g_lcore_stream[n].output_port.id == old_id)
+			g_lcore_stream[n].output_port.id = new_id;
+	}
+	for (n = 0; n < g_app_config.num_dist_cores; n++) {
+		if (g_dist[n].port_id == old_id)
+			g_dist[n].port_id = new_id;
+		if (g_dist[n].tx_port_id == old_id)
+			g_dist[n].tx_port_id = new_id;
+	}
+}
+
+
+static void
+port_event_link(struct port_params *port)
+{
+	struct rte_eth_link link;
+	char link_str[RTE_ETH_LINK_MAX_STR_LEN];
+	uint64_t us;
+
+	if (rte_eth_link_get_nowait(port->id, &link) != 0)
+		return;
+
+	if (link.link_status == RTE_ETH_LINK_DOWN) {
+		if (port->link_down_tsc == 0) {
+			port->link_down_tsc = port->event_tsc;
+			port->ev_stats.link_down++;
+			printf("Port %hu: link down\n", port->id);
+		}
+		return;
+	}
+
+	if (port->link_down_tsc != 0) {
+		us = tsc_to_us(rte_rdtsc() - port->link_down_tsc);
+		port->ev_stats.last_down_us = us;
+		port->link_down_tsc = 0;
+		rte_eth_link_to_str(link_str, sizeof(link_str), &link);
+		printf("Port %hu: %s after %"PRIu64" us\n", port->id, link_str, us);
+	}
+}
+
+
+/*
+ * The device requires a reset (e.g. a VF after its PF was reset): pause the
+ * forwarding, reset, reconfigure and restart the port.
+ */
+static void
+port_event_reset(struct port_params *port)
+{
+	portid_t port_id = port->id;
+	int r;
+
+	port->ev_stats.reset++;
+	printf("Port %hu: device reset\n", port_id);
+
+	if (port_event_pause(port) != 0) {
+		port_event_retry(port, RTE_ETH_EVENT_INTR_RESET);
+		return;
+	}
+
+	rte_eth_dev_stop(port_id);
+	r = rte_eth_dev_reset(port_id);
+	if (r != 0)
+		fprintf(stderr, "Port %hu: reset failed: %s\n", port_id, rte_strerror(-r));
+	if (r != 0 || port_setup(port, port_id) != 0) {
+		fprintf(stderr, "Port %hu: cannot be restarted, retrying\n", port_id);
+		fwd_engine_resume(g_lcore_stream, g_app_config.num_cores, g_dist,
+			g_app_config.num_dist_cores);
+		port_event_retry(port, RTE_ETH_EVENT_INTR_RESET);
+		return;
+	}
+
+	port_event_resume(port);
+}
+
+
+/*
+ * The device is gone: release it and try to probe it again periodically
+ * (a NIC is plugged back, a vdev is re-created).
+ */
+static void
+port_event_remove(struct port_params *port)
+{
+	struct rte_eth_dev_info dev_info;
+	portid_t port_id = port->id;
+
+	port->ev_stats.remove++;
+	printf("Port %hu: device '%s' removed\n", port_id, port->name);
+
+	if (port_event_pause(port) != 0) {
+		port_event_retry(port, RTE_ETH_EVENT_INTR_RMV);
+		return;
+	}
+
+	port_events_unregister(port);
+	rte_eth_dev_stop(port_id);
+	if (rte_eth_dev_info_get(port_id, &dev_info) != 0)
+		dev_info.device = NULL;
+	rte_eth_dev_close(port_id);
+	if (dev_info.device != NULL && rte_dev_remove(dev_info.device) != 0)
+		fprintf(stderr, "Port %hu: cannot detach device '%s'\n", port_id, port->name);
+
+	port->detached = 1;
+	watchdog_port_detached(1);
+	rte_eal_alarm_set(PORT_ATTACH_RETRY_US, port_attach_retry, port);
+}
+
+
+/*
+ * The cores stay paused while the device is away, until it's set up again; the
+ * watchdog doesn't bound this pause. A device probed but which can't be set up
+ * is tried again as well.
+ */
+static void
+port_attach_retry(void *arg)
+{
+	struct port_params *port = arg;
+	portid_t old_id = port->id, port_id;
+	int r;
+
+	r = rte_dev_probe(port->devargs);
+	if ((r != 0 && r != -EEXIST) ||
+	    rte_eth_dev_get_port_by_name(port->name, &port_id) != 0) {
+		rte_eal_alarm_set(PORT_ATTACH_RETRY_US, port_attach_retry, port);
+		return;
+	}
+
+	printf("Port %hu: device '%s' attached again as port %hu\n", old_id,
+		port->name, port_id);
+
+	if (port_setup(port, port_id) != 0 || port_events_register(port) != 0) {
+		fprintf(stderr, "Port %hu: cannot be restarted, retrying\n", port_id);
+		port_events_unregister(port);
+		rte_eth_dev_stop(port_id);
+		/* the streams still use the old id */
+		port->id = old_id;
+		port->ev_stats.fail++;
+		rte_eal_alarm_set(PORT_ATTACH_RETRY_US, port_attach_retry, port);
+		return;
+	}
+
+	port->detached = 0;
+	port_id_update(old_id, port_id);
+	port_event_resume(port);
+	watchdog_port_detached(0);
+}
+
+
+static void
+port_event_handle(void *arg)
+{
+	struct port_params *port = arg;
+	uint32_t events;
+
+	events = port->events;
+	port->events = 0;
+	if (events == 0 || port->detached)
+		return;
+
+	if (events & RTE_BIT32(RTE_ETH_EVENT_INTR_RMV)) {
+		port_event_remove(port);
+		return;
+	}
+	if (events & RTE_BIT32(RTE_ETH_EVENT_INTR_RESET))
+		port_event_reset(port);
+	if (events & RTE_BIT32(RTE_ETH_EVENT_INTR_LSC))
+		port_event_link(port);
+}
+
+
+static void
+port_event_stats_print(void)
+{
+	struct port_event_stats const *st;
+	unsigned int n;
+
+	printf("Port events:\n");
+	for (n = 0; n < RTE_DIM(g_ports); n++) {
+		st = &g_ports[n].ev_stats;
+		printf("  port %hu%s: link down=%"PRIu64" (last %"PRIu64" us), reset=%"PRIu64
+		       ", removed=%"PRIu64", failed=%"PRIu64", recovery last=%"PRIu64
+		       " us max=%"PRIu64" us\n",
+		       g_ports[n].id, g_ports[n].detached ? " (detached)" : "",
+		       st->link_down, st->last_down_us, st->reset, st->remove, st->fail,
+		       st->last_recovery_us, st->max_recovery_us);
+	}
+}
+
+
+/* ************************************************************************** */
+/* Hitless restart                                                            */
+
+/*
+ * A new instance asks for the ports: drain and exit, the ports are released in
+ * handoff_release(). Called by the handoff control thread.
+ */
+static void
+handoff_on_request(void)
+{
+	if (g_app_config.drain_timeout_ms != 0 && !fwd_engine_draining())
+		fwd_engine_drain(g_app_config.drain_timeout_ms);
+	else
+		fwd_engine_stop();
+}
+
+
+/*
+ * Take over the ports of the running instance: once it has released them, probe
+ * the devices and use its configuration unless given on the command line.
+ */
+static int
+handoff_takeover_ports(void)
+{
+	struct handoff_state *st = &g_handoff_state;
+	portid_t port_id;
+	unsigned int n;
+	uint64_t tsc, ms;
+	int r;
+
+
+	printf("Taking over the ports of the instance on '%s' ...\n",
+		g_app_config.takeover_path);
+
+	tsc = rte_get_tsc_cycles();
+	if (handoff_takeover(g_app_config.takeover_path, st, HANDOFF_TIMEOUT_MS) != 0)
+		return -1;
+
+	for (n = 0; n < HANDOFF_NUM_PORTS; n++) {
+		if (rte_eth_dev_get_port_by_name(st->ports[n].name, &port_id) == 0)
+			continue;
+		r = rte_dev_probe(st->ports[n].devargs);
+		if (r != 0) {
+			fprintf(stderr, "Error: cannot probe device '%s': %s\n",
+				st->ports[n].devargs, rte_strerror(-r));
+			return -1;
+		}
+	}
+
+	if (!(g_app_config.given & CONF_GIVEN_MPLS_LABEL))
+		g_app_config.mpls_label = st->mpls_label;
+	if (!(g_app_config.given & CONF_GIVEN_MPLS_TTL))
+		g_app_config.mpls_ttl = st->mpls_ttl;
+	if (g_app_config.num_steer_rules == 0) {
+		memcpy(g_app_config.steer_rules, st->steer_rules,
+			st->n_steer_rules * sizeof(st->steer_rules[0]));
+		g_app_config.num_steer_rules = st->n_steer_rules;
+	}
+	if (g_app_config.mpls_in_dev[0] == '\0')
+		snprintf(g_app_config.mpls_in_dev, sizeof(g_app_config.mpls_in_dev), "%s",
+			st->ports[PORT_INGRESS].name);
+
+	ms = (rte_get_tsc_cycles() - tsc) * MS_PER_S / rte_get_tsc_hz();
+	printf("Ports released after %"PRIu64" ms (restart #%u)\n", ms, st->generation + 1);
+
+	return 0;
+}
+
+
+/*
+ * The ports are closed: release the devices and pass the state to the new
+ * instance.
+ */
+static void
+handoff_release(void)
+{
+	struct handoff_state st;
+	unsigned int n;
+
+
+	memset(&st, 0, sizeof(st));
+	st.generation = g_handoff_state.generation + 1;
+
+	for (n = 0; n < RTE_DIM(g_ports); n++) {
+		snprintf(st.ports[n].name, sizeof(st.ports[n].name), "%s", g_ports[n].name);
+		snprintf(st.ports[n].devargs, sizeof(st.ports[n].devargs), "%s",
+			g_ports[n].devargs);
+
+		if (g_ports[n].device != NULL && g_ports[n].detached == 0 &&
+		    rte_dev_remove(g_ports[n].device) != 0)
+			fprintf(stderr, "Handoff: cannot detach device '%s'\n", g_ports[n].name);
+	}
+
+	st.mpls_label = g_app_config.mpls_label;
+	st.mpls_ttl = g_app_config.mpls_ttl;
+	st.n_steer_rules = g_app_config.num_steer_rules;
+	memcpy(st.steer_rules, g_app_config.steer_rules,
+		g_app_config.num_steer_rules * sizeof(st.steer_rules[0]));
+
+	st.totals = g_handoff_state.totals;
+	for (n = 0; g_lcore_stream != NULL && n < g_app_config.num_cores; n++)
+		fwd_stream_stats_add(&st.totals, &g_lcore_stream[n].stats);
+
+	handoff_complete(&st);
+}
+
+
+/* ************************************************************************** */
+
+/*
+ * Publish the configuration and the location of the counters for secondary
+ * processes, once the streams and label steering are set up.
+ */
+static int
+mp_publish(void)
+{
+	static struct mp_info info;
+
+	info.pid = getpid();
+	info.generation = g_handoff_state.generation;
+	info.start_tsc = g_startup_tsc[STARTUP_BEGIN];
+	info.mpls_label = g_app_config.mpls_label;
+	info.mpls_ttl = g_app_config.mpls_ttl;
+	info.port_in = g_ports[PORT_INGRESS].id;
+	info.port_out = g_ports[PORT_EGRESS].id;
+
+	info.n_stream = g_app_config.num_cores;
+	memcpy(info.cores, g_app_config.cores, sizeof(info.cores));
+	info.strm = g_lcore_stream;
+	info.n_dist = g_app_config.num_dist_cores;
+	memcpy(info.dist_cores, g_app_config.dist_cores, sizeof(info.dist_cores));
+	info.dist = g_dist;
+
+	info.n_steer_rules = g_app_config.num_steer_rules;
+	memcpy(info.steer_rules, g_app_config.steer_rules, sizeof(info.steer_rules));
+	info.steer_sw = g_steer_table;
+
+	snprintf(info.pool_name, sizeof(info.pool_name), "%s", g_mb_pool->name);
+	if (g_app_config.mirror_dirs != 0) {
+		info.n_mirror_rings = g_app_config.num_cores;
+		info.mirror_ring_size = g_app_config.mirror_ring_size;
+	}
+	if (g_app_config.slow_ring_size != 0) {
+		info.n_slow_rings = g_app_config.num_cores;
+		info.slow_ring_size = g_app_config.slow_ring_size;
+	}
+
+	return mp_info_publish(&info);
+}
+
+
+static void port_print_info(struct port_params *port);
+
+/*
+ * The main function, where everything comes to life
+ */
+int
+main(int argc, char *argv[])
+{
+	int main_ret, r;
+	unsigned n;
+	unsigned main_run, main_id;
+	unsigned num_ports, n_launched;
+	portid_t port_id, port_ids[NUM_SUPPORTED_PORTS];
+	struct rte_mempool *mb_pool = NULL;
+
+
+	/* Added to avoid EAL initialization when only the help message is printed.
+	 */
+	if (print_app_args(argv) != 0) {
+		exit(EXIT_SUCCESS);
+	}
+
+	main_ret = EXIT_FAILURE;
+	startup_mark(STARTUP_BEGIN);
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	/* Initializion the Environment Abstraction Layer (EAL) */
+	rte_errno = 0;
+	r = rte_eal_init(argc, argv);
+	if (r < 0)
+		rte_exit(EXIT_FAILURE, "Invalid EAL parameters\n");
+	argc -= r;
+	argv += r;
+	startup_mark(STARTUP_EAL);
+
+	/*
+	 * EAL modifies argv array. It stripes all the EAL command-line args out,
+	 * from argv[1] to separator '--' inclusive.
+	 */
+	if (argc > 1)
+		do_args_parse(argc, argv, &g_app_config);
+
+	/* A secondary process only reads the tables and counters of the primary */
+	if (rte_eal_process_type() == RTE_PROC_SECONDARY) {
+		r = mp_info_secondary_run(g_app_config.stats_period_s);
+		rte_eal_cleanup();
+		return r == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	/* The variants of the data-path kernels matching the CPU */
+	if (kernels_select(g_app_config.cpu_isa) != 0)
+		rte_exit(EXIT_FAILURE, "Error: cannot select the data-path kernels!\n");
+	kernels_print();
+
+	/* Secondary processes (dpdk-pdump) may capture the traffic of the ports */
+	r = rte_pdump_init();
+	if (r != 0)
+		fprintf(stderr, "Warning: packet capture not available: %s\n",
+			rte_strerror(rte_errno));
+
+	/* The devices of the running instance are probed once it releases them */
+	if (g_app_config.takeover_path[0] != '\0' && handoff_takeover_ports() != 0)
+		rte_exit(EXIT_FAILURE, "Error: cannot take over the ports!\n");
+
+	/* memif rings and buffers are set when the device is probed */
+	if ((g_app_config.memif_rsize != 0 || g_app_config.memif_bsize != 0) &&
+	    port_drv_memif_tune(g_app_config.memif_rsize, g_app_config.memif_bsize) != 0)
+		rte_exit(EXIT_FAILURE, "Error: cannot set the memif ring and buffer sizes!\n");
+
+	/* The vhost ports offer TSO when the device is probed */
+	if (g_app_config.tso != 0 && port_drv_vhost_tune(g_app_config.tso) != 0)
+		rte_exit(EXIT_FAILURE, "Error: cannot offer TSO on the vhost ports!\n");
+
+	/* AF_XDP sockets are created for the queues found when the device is probed */
+	if (port_drv_af_xdp_tune(g_app_config.num_cores != 0 ? g_app_config.num_cores :
+	    g_app_config.auto_cores, g_app_config.af_xdp_busy_budget) != 0)
+		rte_exit(EXIT_FAILURE, "Error: cannot set up the AF_XDP ports!\n");
+
+	num_ports = rte_eth_dev_count_avail();
+	if (num_ports != NUM_SUPPORTED_PORTS)
+		rte_exit(EXIT_FAILURE, "Error: expected two ports (=%u) to run!\n", num_ports);
+
+	if (g_app_config.mpls_in_dev[0] != '\0') {
+		r = rte_eth_dev_get_port_by_name(g_app_config.mpls_in_dev,
+			&g_app_config.mpls_in_port);
+		if (r < 0)
+			rte_exit(EXIT_FAILURE, "Error: couldn't find port-id by given name '%s': %s\n",
+				g_app_config.mpls_in_dev, rte_strerror(-r));
+	}
+
+	if (g_app_config.print != 0)
+		printf("Initializing ...\n");
+
+	/* Service cores are taken out of the worker lcores, so --auto-cores skips them */
+	for (n = 0; n < g_app_config.num_service_cores; n++) {
+		unsigned c, busy = 0, core = g_app_config.service_cores[n];
+
+		for (c = 0; c < g_app_config.num_cores; c++)
+			busy |= g_app_config.cores[c] == core;
+		for (c = 0; c < g_app_config.num_dist_cores; c++)
+			busy |= g_app_config.dist_cores[c] == core;
+		if (busy) {
+			fprintf(stderr, "Error: core %u cannot process packets and run "
+				"services at the same time!\n", core);
+			goto __exit_error;
+		}
+	}
+	if (ctl_service_lcores_set(g_app_config.service_cores,
+		g_app_config.num_service_cores) != 0)
+		goto __exit_error;
+
+	if (g_app_config.auto_cores != 0)
+		auto_cores_select();
+
+	/*
+	 * Verify the validity of the cores and recalculate the total number of
+	 * valid cores. Must be done before setting up the ports.
+	 */
+	if (g_app_config.num_cores == 0) {
+		g_app_config.cores[0] = rte_get_main_lcore();
+		g_app_config.num_cores = 1;
+	} else {
+		unsigned valid = 0;
+
+		for (n = 0; n < g_app_config.num_cores &&
+			n < RTE_DIM(g_app_config.cores); n++) {
+
+			if (rte_lcore_is_enabled(g_app_config.cores[n]) == 0) {
+				fprintf(stderr, "Warning: core %u not enabled (and SKIPPED)!\n",
+					g_app_config.cores[n]);
+				continue;
+			}
+			g_app_config.cores[valid] = g_app_config.cores[n];
+			valid++;
+		}
+		g_app_config.num_cores = valid;
+
+		if (g_app_config.num_cores == 0) {
+			fprintf(stderr, "Error: none of the requested cores are available!\n");
+			goto __exit_error;
+		}
+	}
+
+	for (n = 0; n < g_app_config.num_steer_rules; n++) {
+		if (g_app_config.steer_rules[n].queue >= g_app_config.num_cores) {
+			fprintf(stderr, "Error: labels %u-%u steered to queue %hu, but there "
+				"are %u processing cores only!\n",
+				g_app_config.steer_rules[n].first, g_app_config.steer_rules[n].last,
+				g_app_config.steer_rules[n].queue, g_app_config.num_cores);
+			goto __exit_error;
+		}
+	}
+
+	/* Software RSS cores must be dedicated ones */
+	for (n = 0; n < g_app_config.num_dist_cores; n++) {
+		unsigned c, core = g_app_config.dist_cores[n];
+
+		if (rte_lcore_is_enabled(core) == 0 || core == rte_get_main_lcore()) {
+			fprintf(stderr, "Error: software RSS core %u is not enabled or "
+				"is the main core!\n", core);
+			goto __exit_error;
+		}
+		for (c = 0; c < g_app_config.num_cores; c++) {
+			if (g_app_config.cores[c] == core) {
+				fprintf(stderr, "Error: core %u cannot process packets and "
+					"run software RSS at the same time!\n", core);
+				goto __exit_error;
+			}
+		}
+	}
+
+	if (g_app_config.reorder_size != 0 && g_app_config.num_dist_cores == 0) {
+		fprintf(stderr, "Error: --reorder requires software RSS cores (--sw-rss)!\n");
+		goto __exit_error;
+	}
+
+	if (g_app_config.print != 0) {
+		printf("Number of available execution units: %u\n"
+		       "Number of processing cores: %u\n",
+		       rte_lcore_count(), g_app_config.num_cores);
+		for (n = 0; n < g_app_config.num_cores; n++) {
+			printf("  core %u: phy-socket=%u\n", g_app_config.cores[n],
+				rte_lcore_to_socket_id(g_app_config.cores[n]));
+		}
+		for (n = 0; n < g_app_config.num_dist_cores; n++) {
+			printf("  core %u: phy-socket=%u (software RSS)\n",
+				g_app_config.dist_cores[n],
+				rte_lcore_to_socket_id(g_app_config.dist_cores[n]));
+		}
+	}
+
+	g_lcore_stream = fwd_stream_alloc(g_app_config.num_cores);
+	if (g_lcore_stream == NULL)
+		goto __exit_error;
+	startup_mark(STARTUP_ARGS);
+
+
+	/* Set input/output ports.
+	 * If the input port is not explicitly specified on the command line,
+	 * the first port returned by DPDK is used for inbound traffic.
+	 */
+	port_ids[PORT_INGRESS] = g_app_config.mpls_in_port;
+	port_ids[PORT_EGRESS] = PORTID_MAX;
+	RTE_ETH_FOREACH_DEV(port_id) {
+		if (port_ids[PORT_INGRESS] == port_id)
+			continue;
+
+		if (port_ids[PORT_INGRESS] == PORTID_MAX)
+			port_ids[PORT_INGRESS] = port_id;
+		else if (port_ids[PORT_EGRESS] == PORTID_MAX)
+			port_ids[PORT_EGRESS] = port_id;
+	}
+
+	/* The ports are configured and started in parallel when possible */
+	n = port_jobs_assign(port_ids, RTE_DIM(port_ids));
+	if (g_app_config.print != 0 && n != 0)
+		printf("Setting up %u ports in parallel\n", n + 1);
+
+	if (port_jobs_run(port_job_conf) != 0)
+		goto __exit_error;
+	startup_mark(STARTUP_PORT_CONF);
+
+	/* Each software RSS core reads its own RX queue */
+	if (g_app_config.num_dist_cores > g_ports[PORT_EGRESS].n_rx_queue) {
+		fprintf(stderr, "Warning: port %hu has %hu RX queue(s), only %hu software "
+			"RSS core(s) used\n", g_ports[PORT_EGRESS].id,
+			g_ports[PORT_EGRESS].n_rx_queue, g_ports[PORT_EGRESS].n_rx_queue);
+		g_app_config.num_dist_cores = g_ports[PORT_EGRESS].n_rx_queue;
+	}
+
+	/* init_mem_pool() must be called after port_params_init()
+	 */
+	g_mb_pool = mb_pool = init_mem_pool(g_app_config.num_cores + g_app_config.num_dist_cores,
+		rte_socket_id());
+	if (mb_pool == NULL) {
+		goto __exit_error;
+	}
+	startup_mark(STARTUP_MEMPOOL);
+
+	if (port_jobs_run(port_job_start) != 0)
+		goto __exit_error;
+	startup_mark(STARTUP_PORT_START);
+
+	for (n = 0; g_app_config.print != 0 && n < RTE_DIM(g_ports); n++)
+		port_print_info(&g_ports[n]);
+
+	if (g_app_config.encap.type != ENCAP_NONE) {
+		if (encap_tmpl_init(&g_encap, &g_app_config.encap, g_app_config.mpls_label,
+		    g_app_config.mpls_ttl, g_ports[PORT_EGRESS].tx_offloads) != 0)
+			goto __exit_error;
+		if (g_app_config.print != 0)
+			encap_print(&g_app_config.encap);
+	}
+
+	if (fec_table_create(&g_fec, g_app_config.fec_rules, g_app_config.num_fec_rules,
+	    g_app_config.mpls_ttl, MBUF_HEADROOM, rte_socket_id()) != 0)
+		goto __exit_error;
+	if (g_app_config.print != 0)
+		fec_print(g_app_config.fec_rules, g_app_config.num_fec_rules);
+
+	if (fwd_stream_conf(&g_ports[PORT_INGRESS], &g_ports[PORT_EGRESS],
+		g_lcore_stream, g_app_config.num_cores) != 0)
+		goto __exit_error;
+
+	if (g_app_config.mirror_dirs != 0 &&
+	    fwd_mirror_conf(g_lcore_stream, g_app_config.num_cores) != 0)
+		goto __exit_error;
+
+	if (g_app_config.mtu_check != 0 &&
+	    fwd_mtu_conf(&g_ports[PORT_EGRESS], g_lcore_stream, g_app_config.num_cores) != 0)
+		goto __exit_error;
+
+	if (g_app_config.tso != 0 &&
+	    fwd_tso_conf(&g_ports[PORT_EGRESS], g_lcore_stream, g_app_config.num_cores) != 0)
+		goto __exit_error;
+
+	for (n = 0; n < RTE_DIM(g_ports); n++) {
+		if (port_tx_share_conf(&g_ports[n], g_lcore_stream, g_app_config.num_cores) != 0)
+			goto __exit_error;
+	}
+
+	if (g_app_config.sym_rss != 0 && g_ports[PORT_INGRESS].reta_size == 0 &&
+	    g_app_config.num_cores > 1)
+		fprintf(stderr, "Warning: symmetric RSS is not available on port %hu\n",
+			g_ports[PORT_INGRESS].id);
+
+	if (g_app_config.num_dist_cores != 0) {
+		g_dist = fwd_dist_conf(&g_ports[PORT_INGRESS], &g_ports[PORT_EGRESS],
+			g_lcore_stream, g_app_config.num_cores, g_app_config.num_dist_cores);
+		if (g_dist == NULL)
+			goto __exit_error;
+	}
+
+	if (label_steer_setup(&g_ports[PORT_EGRESS], g_lcore_stream, g_app_config.num_cores,
+		g_dist, g_app_config.num_dist_cores) != 0)
+		goto __exit_error;
+
+	for (n = 0; n < RTE_DIM(g_ports); n++) {
+		if (port_events_register(&g_ports[n]) != 0)
+			goto __exit_error;
+	}
+
+	if (g_app_config.handoff_path[0] != '\0' &&
+	    handoff_listen(g_app_config.handoff_path, handoff_on_request) != 0)
+		goto __exit_error;
+	if (mp_publish() != 0)
+		goto __exit_error;
+	startup_mark(STARTUP_ENGINE);
+
+	/* Ports are started, but nothing reads the frames yet */
+	if (g_app_config.prefault != 0)
+		mem_prefault();
+	startup_mark(STARTUP_PREFAULT);
+
+	n_launched = g_app_config.num_dist_cores;
+	for (n = 0; n < g_app_config.num_dist_cores; n++) {
+		if (g_app_config.print != 0)
+			printf("Delegating software RSS to core %u\n", g_app_config.dist_cores[n]);
+
+		r = rte_eal_remote_launch(fwd_dist_loop, &g_dist[n],
+			g_app_config.dist_cores[n]);
+		if (r < 0) {
+			fprintf(stderr, "Failed to start software RSS on core %u!\n"
+			                "    %s\n", g_app_config.dist_cores[n], rte_strerror(-r));
+			goto __exit_error;
+		}
+	}
+
+
+	/* Run the worker on each user-specified core, otherwise when the list of cores
+	 * is not given, run it on the main core.
+	 * ... hit it!
+	 */
+	main_run = 0;
+	for (n = 0; n < g_app_config.num_cores; n++) {
+		g_lcore_stream[n].print = g_app_config.print;
+
+		if (g_app_config.cores[n] == rte_get_main_lcore()) {
+			main_run = 1;
+			main_id = n;
+			continue;
+		}
+
+		if (g_app_config.print != 0)
+			printf("Delegating processing to core %u\n", g_app_config.cores[n]);
+
+		r = rte_eal_remote_launch(fwd_worker_loop, &g_lcore_stream[n],
+			g_app_config.cores[n]);
+		if (r < 0) {
+			fprintf(stderr, "Failed to start processing function on core %u!\n"
+			                "    %s\n", g_app_config.cores[n], rte_strerror(-r));
+			goto __exit_error;
 		}
+		n_launched++;
+	}
+
+	if (g_app_config.watchdog_ms != 0 &&
+	    watchdog_start(g_lcore_stream, g_app_config.cores, g_app_config.num_cores,
+	    g_dist, g_app_config.dist_cores, g_app_config.num_dist_cores,
+	    g_app_config.watchdog_ms, PORT_PAUSE_MAX_MS, g_app_config.watchdog_abort) != 0)
+		goto __exit_error;
+
+	if (stats_start(g_lcore_stream, g_app_config.num_cores, g_dist,
+	    g_app_config.num_dist_cores, g_app_config.stats_period_s != 0 ?
+	    g_app_config.stats_period_s : STATS_DEFAULT_PERIOD_S,
+	    g_app_config.stats_period_s != 0) != 0)
+		goto __exit_error;
+
+	/* The main core runs the services while waiting, unless it forwards too */
+	if (ctl_service_start(main_run == 0) != 0)
+		goto __exit_error;
+
+	if (g_app_config.print != 0 || g_app_config.mem_report != 0) {
+		startup_cores_wait(n_launched);
+		startup_mark(STARTUP_CORES);
 	}
+	if (g_app_config.print != 0)
+		startup_print();
+	if (g_app_config.mem_report != 0)
+		mem_report_print();
 
 	/* Execute the packet processing worker on the main core or wait for others
 	 * when they are done.
@@ -560,15 +2651,24 @@ main(int argc, char *argv[])
 	while (main_run == 0) {
 		unsigned int n_running;
 
-		n_running = g_app_config.num_cores;
+		n_running = g_app_config.num_cores + g_app_config.num_dist_cores;
 		for (n = 0; n < g_app_config.num_cores; n++) {
 			if (rte_eal_get_lcore_state(g_app_config.cores[n]) != RUNNING)
 				n_running--;
 		}
+		for (n = 0; n < g_app_config.num_dist_cores; n++) {
+			if (rte_eal_get_lcore_state(g_app_config.dist_cores[n]) != RUNNING)
+				n_running--;
+		}
 		if (n_running == 0)
 			break;
 
-		rte_delay_us_sleep(US_PER_S);	/* Avoid unnecessary checks */
+		if (ctl_service_lcores_num() == 0) {
+			ctl_service_run();
+			rte_delay_us_sleep(MAIN_SERVICE_WAIT_US);
+			continue;
+		}
+		rte_delay_us_sleep(MAIN_WAIT_US);	/* Avoid unnecessary checks */
 	}
 
 
@@ -578,7 +2678,9 @@ main(int argc, char *argv[])
 __exit_error:
 	printf("Closing application ...\n");
 
-	fwd_engine_stop();
+	/* Draining cores exit by themselves, within the timeout */
+	if (!fwd_engine_draining())
+		fwd_engine_stop();
 	RTE_LCORE_FOREACH_WORKER(n) {
 		if (rte_eal_wait_lcore(n) < 0) {
 			fprintf(stderr, "Cannot wait for lcore=%d\n", n);
@@ -587,9 +2689,57 @@ __exit_error:
 		}
 	}
 	printf("All workers stopped\n");
+	mp_info_stop();
+
+	/* Nothing may touch the ports any more */
+	watchdog_stop();
+	ctl_service_stop();
+	rte_eal_alarm_cancel(port_event_handle, (void *)-1);
+	rte_eal_alarm_cancel(port_attach_retry, (void *)-1);
+	for (n = 0; n < RTE_DIM(g_ports); n++) {
+		if (g_ports[n].id != PORTID_MAX && g_ports[n].detached == 0)
+			port_events_unregister(&g_ports[n]);
+	}
+
+	if (fwd_engine_draining()) {
+		uint64_t deadline = fwd_engine_drain_deadline();
+		unsigned int n_busy = 0;
+
+		for (n = 0; n < RTE_DIM(g_ports); n++) {
+			if (g_ports[n].id != PORTID_MAX && g_ports[n].detached == 0)
+				n_busy += port_tx_done_wait(&g_ports[n], deadline);
+		}
+		fwd_engine_drain_print();
+		if (n_busy != 0)
+			fprintf(stderr, "Warning: %u TX queue(s) not empty at exit\n", n_busy);
+	}
+
+	fwd_stream_stats_print(g_lcore_stream, g_app_config.num_cores);
+	fwd_dist_stats_print(g_dist, g_app_config.num_dist_cores);
+	label_steer_print();
+	port_event_stats_print();
+	for (n = 0; n < RTE_DIM(g_ports); n++) {
+		if (g_ports[n].id != PORTID_MAX && g_ports[n].detached == 0)
+			port_drv_stats_print(g_ports[n].id, g_ports[n].drv);
+	}
+	watchdog_print();
+	ctl_service_print();
+	if (g_handoff_state.generation != 0) {
+		struct fwd_stream_stats sum = g_handoff_state.totals;
+
+		for (n = 0; n < g_app_config.num_cores; n++)
+			fwd_stream_stats_add(&sum, &g_lcore_stream[n].stats);
+		printf("Since the first start (%u restarts): push rx=%"PRIu64" tx=%"PRIu64
+		       " drop=%"PRIu64", pop rx=%"PRIu64" tx=%"PRIu64" drop=%"PRIu64"\n",
+		       g_handoff_state.generation, sum.push_rx, sum.push_tx, sum.push_drop,
+		       sum.pop_rx, sum.pop_tx, sum.pop_drop);
+	}
 
 __wait_lcore_error:
 
+	label_steer_remove();
+	fec_table_free(&g_fec);
+
 	RTE_ETH_FOREACH_DEV(port_id) {
 		printf("Closing port %d...", port_id);
 		r = rte_eth_dev_stop(port_id);
@@ -602,6 +2752,10 @@ __wait_lcore_error:
 		printf(" Done\n");
 	}
 
+	if (handoff_requested())
+		handoff_release();
+
+	rte_pdump_uninit();
 	rte_eal_cleanup();
 
 	return main_ret;
@@ -662,4 +2816,7 @@ port_print_info(struct port_params *port)
 		dev_info.rx_desc_lim.nb_min, dev_info.rx_desc_lim.nb_max,
 		dev_info.tx_desc_lim.nb_min, dev_info.tx_desc_lim.nb_max,
 		dev_info.speed_capa);
+	printf("  TX offloads: supported 0x%"PRIx64", enabled 0x%"PRIx64"\n",
+		dev_info.tx_offload_capa, port->tx_offloads);
+	port_drv_print(port->id, port->drv);
 }
@@ -0,0 +1,161 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_telemetry.h>
+
+#include "stats.h"
+#include "ctl_service.h"
+
+
+/*
+ * Statistics collection: a control service sums the counters of the cores once
+ * per period into a snapshot, which is printed (--stats-period) and served to
+ * telemetry clients (/mplsfwd/stats), so the readers never touch the counters
+ * the cores are writing.
+ */
+
+static struct {
+	struct fwd_stream const *strm;
+	unsigned int n_stream;
+	struct fwd_dist const *dist;
+	unsigned int n_dist;
+
+	uint64_t period_tsc;
+	uint64_t next_tsc;
+	int print;
+
+	/* Written by the service, the readers use snap[cur] */
+	struct stats_snapshot snap[2];
+	volatile unsigned int cur;
+} g_stats;
+
+
+/* ************************************************************************** */
+
+static inline uint64_t
+stats_rate(uint64_t now, uint64_t before, uint64_t tsc)
+{
+	return tsc != 0 ? (now - before) * rte_get_tsc_hz() / tsc : 0;
+}
+
+
+static int32_t
+stats_service(void *arg __rte_unused)
+{
+	struct stats_snapshot const *prev;
+	struct stats_snapshot *s;
+	struct fwd_stream_stats const *t, *p;
+	uint64_t now, tsc;
+	unsigned int n;
+
+
+	now = rte_get_tsc_cycles();
+	if (now < g_stats.next_tsc)
+		return -EAGAIN;
+	g_stats.next_tsc = now + g_stats.period_tsc;
+
+	prev = &g_stats.snap[g_stats.cur];
+	s = &g_stats.snap[g_stats.cur ^ 1];
+	memset(s, 0, sizeof(*s));
+	s->tsc = now;
+	for (n = 0; n < g_stats.n_stream; n++)
+		fwd_stream_stats_add(&s->totals, &g_stats.strm[n].stats);
+	for (n = 0; n < g_stats.n_dist; n++) {
+		s->dist_rx += g_stats.dist[n].stats.rx;
+		s->dist_drop += g_stats.dist[n].stats.drop;
+	}
+
+	t = &s->totals;
+	p = &prev->totals;
+	tsc = prev->tsc != 0 ? now - prev->tsc : 0;
+	s->push_rx_pps = stats_rate(t->push_rx, p->push_rx, tsc);
+	s->push_tx_pps = stats_rate(t->push_tx, p->push_tx, tsc);
+	s->pop_rx_pps = stats_rate(t->pop_rx, p->pop_rx, tsc);
+	s->pop_tx_pps = stats_rate(t->pop_tx, p->pop_tx, tsc);
+	s->drop_pps = stats_rate(t->push_drop + t->pop_drop + s->dist_drop,
+		p->push_drop + p->pop_drop + prev->dist_drop, tsc);
+
+	__atomic_store_n(&g_stats.cur, g_stats.cur ^ 1, __ATOMIC_RELEASE);
+
+	if (g_stats.print && prev->tsc != 0)
+		printf("Stats: push rx=%"PRIu64" tx=%"PRIu64" pps, pop rx=%"PRIu64
+		       " tx=%"PRIu64" pps, drop=%"PRIu64" pps\n", s->push_rx_pps,
+		       s->push_tx_pps, s->pop_rx_pps, s->pop_tx_pps, s->drop_pps);
+
+	return 0;
+}
+
+
+static int
+stats_telemetry(char const *cmd __rte_unused, char const *params __rte_unused,
+	struct rte_tel_data *d)
+{
+	struct stats_snapshot const *s;
+
+	s = &g_stats.snap[__atomic_load_n(&g_stats.cur, __ATOMIC_ACQUIRE)];
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "push_rx", s->totals.push_rx);
+	rte_tel_data_add_dict_u64(d, "push_tx", s->totals.push_tx);
+	rte_tel_data_add_dict_u64(d, "push_drop", s->totals.push_drop);
+	rte_tel_data_add_dict_u64(d, "pop_rx", s->totals.pop_rx);
+	rte_tel_data_add_dict_u64(d, "pop_tx", s->totals.pop_tx);
+	rte_tel_data_add_dict_u64(d, "pop_drop", s->totals.pop_drop);
+	rte_tel_data_add_dict_u64(d, "mirror_tx", s->totals.mirror_tx);
+	rte_tel_data_add_dict_u64(d, "mirror_drop", s->totals.mirror_drop);
+	rte_tel_data_add_dict_u64(d, "sw_rss_rx", s->dist_rx);
+	rte_tel_data_add_dict_u64(d, "sw_rss_drop", s->dist_drop);
+	rte_tel_data_add_dict_u64(d, "push_rx_pps", s->push_rx_pps);
+	rte_tel_data_add_dict_u64(d, "push_tx_pps", s->push_tx_pps);
+	rte_tel_data_add_dict_u64(d, "pop_rx_pps", s->pop_rx_pps);
+	rte_tel_data_add_dict_u64(d, "pop_tx_pps", s->pop_tx_pps);
+	rte_tel_data_add_dict_u64(d, "drop_pps", s->drop_pps);
+
+	return 0;
+}
+
+
+/*
+ * Register the statistics service and the telemetry command. The counters are
+ * collected every period_s seconds, and printed when print is set.
+ */
+int
+stats_start(struct fwd_stream const *strm, unsigned int n_stream,
+	struct fwd_dist const *dist, unsigned int n_dist, unsigned int period_s,
+	int print)
+{
+	if (strm == NULL || n_stream == 0 || period_s == 0) {
+		fprintf(stderr, "Error: %s() invoked with invalid argument\n", __func__);
+		return -1;
+	}
+
+	g_stats.strm = strm;
+	g_stats.n_stream = n_stream;
+	g_stats.dist = dist;
+	g_stats.n_dist = n_dist;
+	g_stats.period_tsc = rte_get_tsc_hz() * period_s;
+	g_stats.next_tsc = rte_get_tsc_cycles();
+	g_stats.print = print;
+
+	if (ctl_service_register("mplsfwd_stats", stats_service, NULL) != 0)
+		return -1;
+
+	if (rte_telemetry_register_cmd("/mplsfwd/stats", stats_telemetry,
+	    "Returns the forwarding counters and rates. Takes no parameters") != 0)
+		fprintf(stderr, "Warning: cannot register telemetry command /mplsfwd/stats\n");
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_STATS_H__
+#define __INCLUDED_STATS_H__
+
+#include <stdint.h>
+
+#include "fwd_engine.h"
+
+
+#define STATS_DEFAULT_PERIOD_S 1
+
+/*
+ * Counters of all cores summed by the statistics service, and the rates over
+ * the last period (frames per second).
+ */
+struct stats_snapshot {
+	uint64_t tsc;
+	struct fwd_stream_stats totals;
+	uint64_t dist_rx;
+	uint64_t dist_drop;
+
+	uint64_t push_rx_pps;
+	uint64_t push_tx_pps;
+	uint64_t pop_rx_pps;
+	uint64_t pop_tx_pps;
+	uint64_t drop_pps;
+};
+
+
+int stats_start(struct fwd_stream const *strm, unsigned int n_stream,
+	struct fwd_dist const *dist, unsigned int n_dist, unsigned int period_s,
+	int print);
+
+#endif /* __INCLUDED_STATS_H__ */
@@ -0,0 +1,331 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+
+#include "watchdog.h"
+#include "ctl_service.h"
+
+
+/*
+ * Each forwarding core bumps its heartbeat on every loop iteration. The watchdog
+ * is a control service (see ctl_service.c) and reports a core whose heartbeat
+ * doesn't move for longer than the timeout, unless the core is stopped or paused.
+ * A pause lasts as long as a port recovery at most: a core paused for longer
+ * is reported as well, so a forwarder left paused doesn't go unnoticed. While
+ * a port is detached (removed, waiting for the device to return) the cores stay
+ * paused for as long as it takes, and the bound applies once it is back.
+ */
+
+#define WATCHDOG_MIN_PERIOD_US  1000
+
+static struct watchdog_core {
+	struct fwd_heartbeat const *hb;
+	struct fwd_ctl const *ctl;
+	unsigned int lcore;
+
+	/* Queues polled by the core, dumped when it stalls */
+	struct watchdog_queue {
+		portid_t port_id;
+		queueid_t rx_queue_id;
+		queueid_t tx_queue_id;
+	} queues[FWD_NUM_DIRS];
+
+	uint64_t last_count;
+	uint64_t last_tsc;          /* the heartbeat moved */
+	uint64_t pause_tsc;         /* a pause was seen requested, 0 = not paused */
+	unsigned int stalled;
+} *g_wd_cores;
+
+static struct {
+	unsigned int n_cores;
+	uint64_t timeout_tsc;
+	uint64_t pause_max_tsc;
+	uint64_t period_tsc;
+	uint64_t next_tsc;
+	int abort_on_stall;
+	volatile int stop;
+	unsigned int n_detached;    /* ports away, see watchdog_port_detached() */
+
+	uint64_t n_stalls;
+	uint64_t max_stall_us;
+} g_wd;
+
+
+/* ************************************************************************** */
+
+static void
+watchdog_queue_dump(struct watchdog_queue const *q)
+{
+	struct rte_eth_txq_info qinfo;
+	int r;
+
+	if (q->port_id == PORTID_MAX)
+		return;
+
+	printf("    port %hu", q->port_id);
+	if (q->rx_queue_id != QUEUEID_MAX) {
+		r = rte_eth_rx_queue_count(q->port_id, q->rx_queue_id);
+		if (r >= 0)
+			printf(" rxq %hu: %d frame(s) waiting", q->rx_queue_id, r);
+		else
+			printf(" rxq %hu: fill level unknown", q->rx_queue_id);
+	}
+	if (q->tx_queue_id != QUEUEID_MAX) {
+		r = -1;
+		if (rte_eth_tx_queue_info_get(q->port_id, q->tx_queue_id, &qinfo) == 0 &&
+		    qinfo.nb_desc != 0)
+			r = rte_eth_tx_descriptor_status(q->port_id, q->tx_queue_id,
+				qinfo.nb_desc - 1);
+		printf(" txq %hu: %s", q->tx_queue_id,
+			r == RTE_ETH_TX_DESC_FULL ? "full (not sent by the NIC)" :
+			r >= 0 ? "has room" : "state unknown");
+	}
+	printf("\n");
+}
+
+
+/* Non-zero extended statistics of the port (errors, misses, ...) */
+static void
+watchdog_xstats_dump(portid_t port_id)
+{
+	struct rte_eth_xstat_name *names = NULL;
+	struct rte_eth_xstat *xstats = NULL;
+	int n, i;
+
+	n = rte_eth_xstats_get(port_id, NULL, 0);
+	if (n <= 0)
+		return;
+
+	names = calloc((size_t)n, sizeof(*names));
+	xstats = calloc((size_t)n, sizeof(*xstats));
+	if (names == NULL || xstats == NULL ||
+	    rte_eth_xstats_get_names(port_id, names, (unsigned int)n) != n ||
+	    rte_eth_xstats_get(port_id, xstats, (unsigned int)n) != n)
+		goto __exit;
+
+	printf("    port %hu xstats:", port_id);
+	for (i = 0; i < n; i++) {
+		if (xstats[i].value != 0 && xstats[i].id < (uint64_t)n)
+			printf(" %s=%"PRIu64, names[xstats[i].id].name, xstats[i].value);
+	}
+	printf("\n");
+
+__exit:
+	free(names);
+	free(xstats);
+}
+
+
+static void
+watchdog_stall_dump(struct watchdog_core const *c, uint64_t us)
+{
+	unsigned int d;
+
+	printf("Watchdog: core %u stalled for %"PRIu64" ms (heartbeat %"PRIu64")\n",
+		c->lcore, us / 1000, c->last_count);
+	printf("    last bursts: push rx=%hu tx=%hu, pop rx=%hu tx=%hu\n",
+		c->hb->last_rx[FWD_DIR_PUSH], c->hb->last_tx[FWD_DIR_PUSH],
+		c->hb->last_rx[FWD_DIR_POP], c->hb->last_tx[FWD_DIR_POP]);
+
+	for (d = 0; d < FWD_NUM_DIRS; d++)
+		watchdog_queue_dump(&c->queues[d]);
+	for (d = 0; d < FWD_NUM_DIRS; d++) {
+		if (c->queues[d].port_id != PORTID_MAX &&
+		    (d == 0 || c->queues[d].port_id != c->queues[0].port_id))
+			watchdog_xstats_dump(c->queues[d].port_id);
+	}
+	fflush(stdout);
+}
+
+
+/*
+ * Check of the heartbeats, the service runs it once per period.
+ */
+static int32_t
+watchdog_service(void *arg __rte_unused)
+{
+	struct watchdog_core *c;
+	uint64_t now, count, us;
+	unsigned int n, paused, detached;
+
+
+	now = rte_get_tsc_cycles();
+	if (g_wd.stop || now < g_wd.next_tsc)
+		return -EAGAIN;
+	g_wd.next_tsc = now + g_wd.period_tsc;
+	detached = __atomic_load_n(&g_wd.n_detached, __ATOMIC_ACQUIRE) != 0;
+
+	for (n = 0; n < g_wd.n_cores; n++) {
+		c = &g_wd_cores[n];
+		count = c->hb->count;
+
+		paused = c->ctl->pause_req != 0 || c->ctl->paused != 0;
+		if (!paused)
+			c->pause_tsc = 0;
+		else if (c->pause_tsc == 0 || detached)
+			c->pause_tsc = now;
+
+		/* A stopped core doesn't bump the heartbeat, nor a paused one for
+		 * the time of a port recovery */
+		if (count != c->last_count || c->ctl->running == 0 ||
+		    (paused && now - c->pause_tsc < g_wd.pause_max_tsc)) {
+			if (c->stalled) {
+				us = (now - c->last_tsc) * US_PER_S / rte_get_tsc_hz();
+				printf("Watchdog: core %u resumed after %"PRIu64" ms\n",
+					c->lcore, us / 1000);
+				g_wd.max_stall_us = RTE_MAX(g_wd.max_stall_us, us);
+			}
+			c->last_count = count;
+			c->last_tsc = paused ? c->pause_tsc : now;
+			c->stalled = 0;
+			continue;
+		}
+
+		if (c->stalled || now - c->last_tsc < (paused ? g_wd.pause_max_tsc :
+		    g_wd.timeout_tsc))
+			continue;
+
+		c->stalled = 1;
+		g_wd.n_stalls++;
+		us = (now - c->last_tsc) * US_PER_S / rte_get_tsc_hz();
+		g_wd.max_stall_us = RTE_MAX(g_wd.max_stall_us, us);
+		watchdog_stall_dump(c, us);
+
+		if (g_wd.abort_on_stall) {
+			fprintf(stderr, "Watchdog: aborting\n");
+			abort();
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * Watch the forwarding cores (strm_lcores[n] runs strm[n], dist_lcores[n] runs
+ * dist[n]). A core whose heartbeat doesn't move for timeout_ms, or which is
+ * paused for longer than pause_max_ms, is reported with the state of its queues;
+ * with abort_on_stall the process is aborted, so a supervisor can restart it.
+ */
+int
+watchdog_start(struct fwd_stream *strm, unsigned int const *strm_lcores,
+	unsigned int n_stream, struct fwd_dist *dist, unsigned int const *dist_lcores,
+	unsigned int n_dist, unsigned int timeout_ms, unsigned int pause_max_ms,
+	int abort_on_stall)
+{
+	struct watchdog_core *c;
+	uint64_t now, period_us;
+	unsigned int n;
+
+
+	if (strm == NULL || n_stream == 0 || timeout_ms == 0 || pause_max_ms == 0 ||
+	    (n_dist != 0 && dist == NULL)) {
+		fprintf(stderr, "Error: %s() invoked with invalid argument\n", __func__);
+		return -1;
+	}
+
+	g_wd_cores = calloc(n_stream + n_dist, sizeof(*g_wd_cores));
+	if (g_wd_cores == NULL) {
+		fprintf(stderr, "Error: failed to allocate memory for the watchdog\n");
+		return -1;
+	}
+
+	now = rte_get_tsc_cycles();
+	for (n = 0; n < n_stream + n_dist; n++) {
+		c = &g_wd_cores[n];
+		if (n < n_stream) {
+			c->hb = &strm[n].hb;
+			c->ctl = &strm[n].ctl;
+			c->lcore = strm_lcores[n];
+			c->queues[FWD_DIR_PUSH].port_id = strm[n].input_port.id;
+			c->queues[FWD_DIR_PUSH].rx_queue_id = strm[n].input_port.rx_queue_id;
+			c->queues[FWD_DIR_PUSH].tx_queue_id = strm[n].output_port.tx_queue_id;
+			c->queues[FWD_DIR_POP].port_id = strm[n].output_port.id;
+			c->queues[FWD_DIR_POP].rx_queue_id = strm[n].output_port.rx_queue_id;
+			c->queues[FWD_DIR_POP].tx_queue_id = strm[n].input_port.tx_queue_id;
+		} else {
+			struct fwd_dist *d = &dist[n - n_stream];
+
+			c->hb = &d->hb;
+			c->ctl = &d->ctl;
+			c->lcore = dist_lcores[n - n_stream];
+			c->queues[FWD_DIR_PUSH].port_id = PORTID_MAX;
+			c->queues[FWD_DIR_POP].port_id = d->port_id;
+			c->queues[FWD_DIR_POP].rx_queue_id = d->rx_queue_id;
+			c->queues[FWD_DIR_POP].tx_queue_id = QUEUEID_MAX;
+			if (d->ret_ring != NULL) {
+				c->queues[FWD_DIR_PUSH].port_id = d->tx_port_id;
+				c->queues[FWD_DIR_PUSH].rx_queue_id = QUEUEID_MAX;
+				c->queues[FWD_DIR_PUSH].tx_queue_id = d->tx_queue_id;
+			}
+		}
+		c->last_tsc = now;
+	}
+
+	g_wd.n_cores = n_stream + n_dist;
+	g_wd.timeout_tsc = rte_get_tsc_hz() / MS_PER_S * timeout_ms;
+	g_wd.pause_max_tsc = rte_get_tsc_hz() / MS_PER_S * pause_max_ms;
+	period_us = RTE_MAX((uint64_t)timeout_ms * 1000 / 4, (uint64_t)WATCHDOG_MIN_PERIOD_US);
+	g_wd.period_tsc = rte_get_tsc_hz() / US_PER_S * period_us;
+	g_wd.next_tsc = now + g_wd.period_tsc;
+	g_wd.abort_on_stall = abort_on_stall;
+	g_wd.stop = 0;
+
+	if (ctl_service_register("mplsfwd_watchdog", watchdog_service, NULL) != 0) {
+		free(g_wd_cores);
+		g_wd_cores = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+void
+watchdog_stop(void)
+{
+	if (g_wd_cores == NULL)
+		return;
+
+	g_wd.stop = 1;
+}
+
+
+/*
+ * A port is removed and the cores are kept paused until the device returns
+ * (detached != 0), or the port is back and the cores are resumed (detached == 0).
+ * May be called before the watchdog is started.
+ */
+void
+watchdog_port_detached(int detached)
+{
+	if (detached)
+		__atomic_add_fetch(&g_wd.n_detached, 1, __ATOMIC_RELEASE);
+	else
+		__atomic_sub_fetch(&g_wd.n_detached, 1, __ATOMIC_RELEASE);
+}
+
+
+void
+watchdog_print(void)
+{
+	if (g_wd_cores == NULL)
+		return;
+
+	printf("Watchdog: %"PRIu64" stall(s), longest %"PRIu64" ms\n",
+		g_wd.n_stalls, g_wd.max_stall_us / 1000);
+}
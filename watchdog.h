@@ -0,0 +1,26 @@
+/*
+ * Copyright(c) 2022-2023 Codilime Sp. z o.o.
+ *
+ * This file is part of the dpdk-mpls-forwarder project. Use of this
+ * source code is governed by a 4-clause BSD license that can be found
+ * in the LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-4-Clause
+ */
+#ifndef __INCLUDED_WATCHDOG_H__
+#define __INCLUDED_WATCHDOG_H__
+
+#include <stdint.h>
+
+#include "fwd_engine.h"
+
+
+int watchdog_start(struct fwd_stream *strm, unsigned int const *strm_lcores,
+	unsigned int n_stream, struct fwd_dist *dist, unsigned int const *dist_lcores,
+	unsigned int n_dist, unsigned int timeout_ms, unsigned int pause_max_ms,
+	int abort_on_stall);
+void watchdog_stop(void);
+void watchdog_port_detached(int detached);
+void watchdog_print(void);
+
+#endif /* __INCLUDED_WATCHDOG_H__ */